@@ -0,0 +1,33 @@
+#ifndef TUE_MANIPULATION_CARTESIAN_PATH_H_
+#define TUE_MANIPULATION_CARTESIAN_PATH_H_
+
+#include "tue/manipulation/ik_solver.h"
+
+#include <kdl/frames.hpp>
+
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Interpolates a straight line in Cartesian space (linear in position, constant rotation axis in orientation)
+// from the tip pose at q_start to the goal pose. The line is divided into steps of at most max_translation_step
+// [m] and max_rotation_step [rad], and the IK of every step is solved using the solution of the previous step
+// as seed. Interpolation stops at the first step for which no IK solution is found, or for which a joint would
+// jump more than max_joint_jump [rad].
+//
+// The path starts with q_start and contains the solutions of all steps reached. Returns the fraction of the
+// line that was reached (1 if the goal was reached).
+double interpolateCartesianPath(IKSolver& solver, const KDL::JntArray& q_start, const KDL::Frame& goal,
+                                double max_translation_step, double max_rotation_step, double max_joint_jump,
+                                std::vector<KDL::JntArray>& path);
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
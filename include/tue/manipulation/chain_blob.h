@@ -0,0 +1,63 @@
+#ifndef TUE_MANIPULATION_CHAIN_BLOB_H_
+#define TUE_MANIPULATION_CHAIN_BLOB_H_
+
+#include "tue/manipulation/chain_model.h"
+
+#include <string>
+#include <stdint.h>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+//
+// Precompiled binary description of a chain model, such that nodes can start without parsing the URDF.
+//
+// Layout (native byte order):
+//
+//     char[4]   magic ("TCHN")
+//     uint32    version
+//     uint64    checksum of the URDF the chain was compiled from (see urdfChecksum)
+//     uint64    checksum of the payload
+//     uint32    payload size in bytes
+//     payload:
+//         uint32    number of segments
+//         per segment:
+//             string    segment name (uint32 length + characters)
+//             string    joint name
+//             uint8     joint type (KDL::Joint::JointType)
+//             double[3] joint origin
+//             double[3] joint axis
+//             double[12] frame to tip (rotation row-major, followed by translation)
+//             if the joint is not fixed: double[3] lower limit, upper limit, seed
+//         uint32    number of collision capsules
+//         per capsule:
+//             int32     segment index (-1 for the root link)
+//             double[3] first end point
+//             double[3] second end point
+//             double    radius
+//
+// ----------------------------------------------------------------------------------------------------
+
+const uint32_t CHAIN_BLOB_VERSION = 2;
+
+// Serializes the chain model into a binary blob
+void writeChainBlob(const ChainModel& model, uint64_t urdf_checksum, std::string& blob);
+
+// Deserializes a chain model. If expected_urdf_checksum is non-zero, the blob must have been compiled from
+// a URDF with that checksum.
+bool readChainBlob(const char* data, size_t size, uint64_t expected_urdf_checksum, ChainModelConstPtr& model,
+                   std::string& error);
+
+// Memory-maps the given file and deserializes the chain model it contains. If urdf is non-empty, the blob is
+// validated against it: loading fails if the blob was compiled from a different URDF.
+bool loadChainBlob(const std::string& filename, const std::string& urdf, ChainModelConstPtr& model,
+                   std::string& error);
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
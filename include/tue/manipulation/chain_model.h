@@ -0,0 +1,76 @@
+#ifndef TUE_MANIPULATION_CHAIN_MODEL_H_
+#define TUE_MANIPULATION_CHAIN_MODEL_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+#include <kdl/chain.hpp>
+#include <kdl/jntarray.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include "tue/manipulation/self_collision.h"
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Kinematic chain from root to tip link, together with the joint limits read from the URDF. Once
+// created, a chain model is never modified, so it can be shared between solvers and threads.
+struct ChainModel
+{
+    KDL::Chain chain;
+
+    KDL::JntArray q_min, q_max, q_seed;
+
+    std::vector<std::string> joint_names;
+
+    std::map<std::string, unsigned int> joint_name_to_index;
+
+    std::vector<unsigned int> joint_index_to_segment_index;
+
+    // Capsules approximating the collision geometry of the root link and all chain links
+    std::vector<Capsule> capsules;
+
+    unsigned int numJoints() const { return joint_names.size(); }
+};
+
+typedef boost::shared_ptr<const ChainModel> ChainModelConstPtr;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Returns a 64-bit FNV-1a hash of the given data
+uint64_t fnv1aHash(const char* data, size_t size);
+
+// Returns a 64-bit FNV-1a hash of the given URDF string
+inline uint64_t urdfChecksum(const std::string& urdf) { return fnv1aHash(urdf.data(), urdf.size()); }
+
+// ----------------------------------------------------------------------------------------------------
+
+// Process-wide cache of chain models, keyed by (URDF hash, root link, tip link). The URDF is only
+// parsed the first time a chain of that URDF is requested; all following requests for the same chain
+// share the same immutable model.
+class ChainModelCache
+{
+
+public:
+
+    // Returns the chain model from root_name to tip_name, or an empty pointer (with error set) on failure
+    static ChainModelConstPtr getChainModel(const std::string& urdf, const std::string& root_name,
+                                            const std::string& tip_name, std::string& error);
+
+    // Removes all cached models. Models that are still in use stay valid.
+    static void clear();
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
@@ -10,6 +10,9 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include "tue/manipulation/chain_model.h"
+#include "tue/manipulation/self_collision.h"
+
 namespace tue
 {
 namespace manipulation
@@ -40,34 +43,91 @@ public:
     bool initFromURDF(const std::string& urdf, const std::string root_name,
                       const std::string& tip_name, std::string& error);
 
+    // Initializes from a precompiled chain blob (see chain_blob.h) instead of parsing the URDF. If urdf is
+    // non-empty, initialization fails if the blob was not compiled from that URDF.
+    bool initFromBlob(const std::string& blob_filename, const std::string& urdf, std::string& error);
+
     void setConstraint(Constraint* c)
     {
         delete constraint_;
         constraint_ = c;
     }
 
-    void calculateVelocity(const KDL::JntArray& q_current, double dt, std::vector<double>& q_wanted) const;
+    // Adds a cost for self-collision to every sample: weight * (margin - clearance)^2 for every pair of links
+    // of which the collision capsules are closer than margin [m]. A weight of 0 disables the cost.
+    void setSelfCollisionCost(double weight, double margin);
+
+    // Sets the range [-max_vel, max_vel] and step size of the velocities that are sampled for every joint
+    void setVelocitySampling(double max_vel, double vel_step)
+    {
+        max_sample_vel_ = max_vel;
+        sample_vel_step_ = vel_step;
+    }
+
+    double velocitySampleStep() const { return sample_vel_step_; }
+
+    // Returns the number of evaluated samples. Uses buffers of the DWA, so must not be called concurrently on the
+    // same instance.
+    unsigned int calculateVelocity(const KDL::JntArray& q_current, double dt, std::vector<double>& q_wanted) const
+    {
+        return calculateVelocity(q_current, dt, sample_vel_step_, q_wanted);
+    }
+
+    // Same, but with a different velocity step size than the one set with setVelocitySampling
+    unsigned int calculateVelocity(const KDL::JntArray& q_current, double dt, double vel_step,
+                                   std::vector<double>& q_wanted) const;
 
     bool getJointIndex(const std::string& name, unsigned int& i_joint) const;
 
-    const std::string& getJointName(unsigned int i_joint) const { return joint_names_[i_joint]; }
+    const std::string& getJointName(unsigned int i_joint) const { return model_->joint_names[i_joint]; }
 
-    const std::vector<std::string>& getJointNames() const { return joint_names_; }
+    const std::vector<std::string>& getJointNames() const { return model_->joint_names; }
 
 private:
 
-    //!Object to describe the (serial) kinematic chain
-    KDL::Chain chain_;
+    //!Shared (serial) kinematic chain and joint limits
+    ChainModelConstPtr model_;
 
-    KDL::JntArray q_min_, q_max_, q_seed_;
+    Constraint* constraint_;
 
-    std::vector<std::string> joint_names_;
+    double max_sample_vel_;
 
-    std::map<std::string, unsigned int> joint_name_to_index_;
+    double sample_vel_step_;
 
-    std::vector<unsigned int> joint_index_to_segment_index_;
+    // Self-collision
 
-    Constraint* constraint_;
+    double self_collision_weight_;
+
+    double self_collision_margin_;
+
+    // Pairs of capsule indices that can collide
+    std::vector<std::pair<unsigned int, unsigned int> > capsule_pairs_;
+
+    void initCapsulePairs();
+
+    // Work buffers of calculateVelocity, sized by initCapsulePairs such that the sampling loop never allocates
+    struct Buffers
+    {
+        std::vector<KDL::Frame> frames;
+
+        std::vector<KDL::Vector> capsule_p0, capsule_p1, capsule_center;
+
+        std::vector<double> bounding_radius;
+
+        std::vector<double> pair_cost;
+
+        std::vector<std::pair<unsigned int, unsigned int> > moving_pairs;
+
+        std::vector<unsigned int> candidate_pairs;
+
+        SegmentBatch batch_a, batch_b;
+
+        std::vector<double> dist_sq;
+    };
+
+    mutable Buffers buffers_;
+
+    double selfCollisionCost(double clearance) const;
 
 };
 
@@ -0,0 +1,120 @@
+#ifndef TUE_MANIPULATION_DWA_CONTROLLER_H_
+#define TUE_MANIPULATION_DWA_CONTROLLER_H_
+
+#include "tue/manipulation/dwa.h"
+#include "tue/manipulation/triple_buffer.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/function.hpp>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+struct DWAControllerStatistics
+{
+    DWAControllerStatistics() : num_ticks(0), num_deadline_misses(0), compute_time(0), max_compute_time(0),
+        mean_compute_time(0), num_samples(0), vel_step(0) {}
+
+    unsigned long num_ticks;
+
+    // Number of ticks of which the computation did not finish within the period
+    unsigned long num_deadline_misses;
+
+    // Computation time of the last tick, the maximum and the mean over all ticks [s]
+    double compute_time;
+    double max_compute_time;
+    double mean_compute_time;
+
+    // Number of samples evaluated in the last tick
+    unsigned int num_samples;
+
+    // Velocity step size used in the last tick
+    double vel_step;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Runs a DWA at a fixed rate on a dedicated thread. Joint positions are handed to the control thread through a
+// lock-free buffer, and the wanted joint positions are passed to a callback on the control thread. If the
+// computation comes close to missing its deadline, the velocity sampling is made coarser; when there is
+// enough time left again, it is gradually refined back to the resolution set on the DWA.
+class DWAController
+{
+
+public:
+
+    typedef boost::function<void(const std::vector<double>& q_wanted)> ReferenceCallback;
+
+    // The DWA must be fully configured (initialized, constraint set) before calling start(), and must not be
+    // modified while the controller is running.
+    DWAController(const DWA& dwa);
+
+    ~DWAController();
+
+    void start(double frequency, const ReferenceCallback& callback);
+
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    // Fraction of the period above which the sampling is coarsened and below which it is refined (default
+    // 0.8 and 0.4)
+    void setLoadThresholds(double coarsen_fraction, double refine_fraction)
+    {
+        coarsen_fraction_ = coarsen_fraction;
+        refine_fraction_ = refine_fraction;
+    }
+
+    // Joint positions in the joint order of the DWA. Must always be called from the same thread.
+    void setJointPositions(const std::vector<double>& q);
+
+    // Updates the given joints; unknown joints are ignored. The controller starts computing once every joint
+    // has been set. Must always be called from the same thread.
+    void setJointPositions(const std::vector<std::string>& names, const std::vector<double>& positions);
+
+    // Returns the latest statistics. Must always be called from the same thread.
+    const DWAControllerStatistics& statistics();
+
+private:
+
+    const DWA& dwa_;
+
+    unsigned int num_joints_;
+
+    ReferenceCallback callback_;
+
+    double period_;
+
+    double coarsen_fraction_;
+
+    double refine_fraction_;
+
+    std::atomic<bool> running_;
+
+    std::thread thread_;
+
+    // Writer side of the joint state handoff
+    std::vector<double> q_measured_;
+    std::vector<bool> q_set_;
+    unsigned int num_joints_set_;
+
+    TripleBuffer<std::vector<double> > joint_buffer_;
+
+    TripleBuffer<DWAControllerStatistics> statistics_buffer_;
+
+    void run();
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef TUE_MANIPULATION_GRASP_CANDIDATE_GENERATOR_H_
+#define TUE_MANIPULATION_GRASP_CANDIDATE_GENERATOR_H_
+
+#include <tf/LinearMath/Transform.h>
+
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+struct ScoredGraspPose
+{
+    // Grasp pose, and its rotation with respect to the requested grasp pose (expressed in the requested grasp frame)
+    tf::Transform pose;
+    tf::Quaternion offset;
+
+    // Heuristic cost: lower is more promising
+    double cost;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Generates alternative grasp poses around a requested grasp pose and ranks them with a cheap analytic
+// heuristic, such that the most promising ones can be evaluated first. The approach axis of the gripper is
+// its x-axis.
+class GraspCandidateGenerator
+{
+
+public:
+
+    enum SamplingMode
+    {
+        // Rotations about the z-axis of the requested grasp only (the default)
+        SAMPLE_YAW,
+
+        // Regular roll / pitch / yaw grid around the requested grasp orientation
+        SAMPLE_GRID,
+
+        // Approach directions evenly spread over a cone around the requested approach axis (Fibonacci sphere),
+        // each combined with the roll samples about the approach axis
+        SAMPLE_APPROACH
+    };
+
+    GraspCandidateGenerator();
+
+    void setSamplingMode(SamplingMode mode) { mode_ = mode; }
+
+    // Sampling steps and maximum offsets [rad] around the requested orientation. A step of zero disables
+    // sampling of that angle.
+    void setRollSampling(double step, double max_offset) { roll_step_ = step; max_roll_ = max_offset; }
+    void setPitchSampling(double step, double max_offset) { pitch_step_ = step; max_pitch_ = max_offset; }
+    void setYawSampling(double step, double max_offset) { yaw_step_ = step; max_yaw_ = max_offset; }
+
+    // Number of approach directions and maximum angle [rad] between them and the requested approach axis
+    void setApproachSampling(unsigned int num_directions, double max_angle)
+    {
+        num_approach_directions_ = num_directions;
+        max_approach_angle_ = max_angle;
+    }
+
+    // Heuristic: cost = orientation_weight * angle to the requested orientation
+    //                 + workspace_weight * distance of the pre-grasp position to the workspace center
+    //                 + alignment_weight * (1 - cos(angle between approach axis and direction from the workspace
+    //                                       center to the grasp position))
+    // The workspace center (e.g., the shoulder) and grasp poses are expressed in the same frame.
+    void setHeuristic(double orientation_weight, const tf::Vector3& workspace_center, double workspace_weight,
+                      double alignment_weight)
+    {
+        orientation_weight_ = orientation_weight;
+        workspace_center_ = workspace_center;
+        workspace_weight_ = workspace_weight;
+        alignment_weight_ = alignment_weight;
+    }
+
+    // Distance between the grasp and pre-grasp position along the approach axis [m]
+    void setPreGraspDistance(double distance) { pre_grasp_distance_ = distance; }
+
+    // Returns all candidates sorted by increasing cost. Candidates with equal cost keep their generation order,
+    // which starts at the requested grasp pose.
+    void generate(const tf::Transform& grasp_pose, std::vector<ScoredGraspPose>& candidates) const;
+
+private:
+
+    SamplingMode mode_;
+
+    double roll_step_, max_roll_;
+    double pitch_step_, max_pitch_;
+    double yaw_step_, max_yaw_;
+
+    unsigned int num_approach_directions_;
+    double max_approach_angle_;
+
+    double orientation_weight_;
+    tf::Vector3 workspace_center_;
+    double workspace_weight_;
+    double alignment_weight_;
+
+    double pre_grasp_distance_;
+
+    double cost(const tf::Transform& grasp_pose, const tf::Quaternion& offset) const;
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
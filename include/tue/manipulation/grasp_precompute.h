@@ -1,6 +1,7 @@
 #ifndef GRASP_PRECOMPUTE_
 #define GRASP_PRECOMPUTE_
 
+#include <actionlib/server/action_server.h>
 #include <actionlib/server/simple_action_server.h>
 #include <actionlib/client/simple_action_client.h>
 
@@ -11,7 +12,19 @@
 
 #include <moveit/move_group_interface/move_group_interface.h>
 
+#include <sensor_msgs/JointState.h>
+
+#include "tue/manipulation/grasp_candidate_generator.h"
+#include "tue/manipulation/ik_solver.h"
+#include "tue/manipulation/latency_histogram.h"
+#include "tue/manipulation/plan_cache.h"
+#include "tue/manipulation/trajectory_metrics.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 
 class GraspPrecompute
 {
@@ -26,12 +39,192 @@ public:
 
 private:
 
+    typedef moveit::planning_interface::MoveGroupInterface MoveGroup;
+
+    typedef actionlib::ActionServer<tue_manipulation_msgs::GraspPrecomputeAction> PlanServer;
+
+    /** MoveIt group with its own IK solver for the Cartesian approach (null if MoveIt computes the approach) */
+    struct PlanningContext
+    {
+        std::shared_ptr<MoveGroup> group;
+        std::shared_ptr<tue::IKSolver> cartesian_solver;
+    };
+
+    /** Grasp candidate: orientation offset with respect to the requested grasp pose, its heuristic cost and the
+        resulting waypoints. The first waypoint is the grasp pose, the last one the pre-grasp pose. */
+    struct GraspCandidate
+    {
+        tf::Quaternion offset;
+        double cost;
+        std::vector<geometry_msgs::Pose> waypoints;
+
+        /** Joint positions of the group for the pre-grasp pose found by the IK pre-filter (empty if none) */
+        std::vector<double> ik_solution;
+    };
+
+    /** Time spent in the stages of a request [s]. Stages that run concurrently are summed. */
+    struct StageTimes
+    {
+        StageTimes() : ik(0), planning(0), cartesian_path(0), time_parameterization(0), execution(0) {}
+
+        double ik;
+        double planning;
+        double cartesian_path;
+        double time_parameterization;
+        double execution;
+
+        void add(const StageTimes& other)
+        {
+            ik += other.ik;
+            planning += other.planning;
+            cartesian_path += other.cartesian_path;
+            time_parameterization += other.time_parameterization;
+            execution += other.execution;
+        }
+    };
+
+    /** A grasp request being processed */
+    struct GraspRequest
+    {
+        GraspRequest() : num_grasp_points(1), first_joint_pos_only(false), num_candidates(0), num_pruned(0),
+            num_planned(0), num_plans(0), from_cache(false), anytime(false), t_start(ros::WallTime::now()) {}
+
+        tf::Transform grasp_pose;
+        unsigned int num_grasp_points;
+        bool first_joint_pos_only;
+
+        /** Start state for planning, as message and as robot state (used to seed IK) */
+        moveit_msgs::RobotState start_state;
+        robot_state::RobotStatePtr start_robot_state;
+
+        /** Number of candidates considered, pruned by the IK pre-filter and sent to the planner */
+        unsigned int num_candidates;
+        unsigned int num_pruned;
+        unsigned int num_planned;
+
+        /** Number of feasible plans found */
+        unsigned int num_plans;
+
+        /** Orientation offset of the candidate for which a plan was found */
+        tf::Quaternion plan_offset;
+
+        /** Whether the plan was taken from a cache */
+        bool from_cache;
+
+        /** Whether the search keeps improving its best plan until the deadline, instead of returning the plan of
+            the best ranked feasible candidate */
+        bool anytime;
+
+        /** Time the request was received, time spent per stage and the cost of the plan */
+        ros::WallTime t_start;
+        StageTimes times;
+        tue::manipulation::TrajectoryMetrics metrics;
+
+        /** Returns true if the goal of this request is to be cancelled */
+        std::function<bool()> preempt_requested;
+
+        /** No new candidates are evaluated after this time (zero if unlimited) */
+        ros::WallTime deadline;
+
+        bool deadlinePassed() const { return !deadline.isZero() && ros::WallTime::now() >= deadline; }
+    };
+
+    /** Shared state of a parallel candidate search. Candidates are ranked by their heuristic cost. */
+    struct ParallelSearch
+    {
+        enum CandidateStatus { PENDING, RUNNING, FAILED, SUCCEEDED };
+
+        ParallelSearch() : next_candidate(0), stop(false) {}
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<GraspCandidate> candidates;
+        std::vector<CandidateStatus> status;
+        std::vector<MoveGroup::Plan> plans;
+        StageTimes times;
+        unsigned int next_candidate;
+        std::atomic<bool> stop;
+        moveit_msgs::RobotState start_state;
+        bool first_joint_pos_only;
+    };
+
     /** Cartesian goal Action server */
     std::shared_ptr<actionlib::SimpleActionServer<tue_manipulation_msgs::GraspPrecomputeAction>> as_;
 
     /** Cartesian goal callback function */
     void execute(const tue_manipulation_msgs::GraspPrecomputeGoalConstPtr& goal);
 
+    /** Plan-only action server: plans several goals concurrently, each on its own planning context, without
+        executing them. The execution server re-uses these plans for the same request and start state. */
+    std::shared_ptr<PlanServer> plan_server_;
+
+    /** Accepts a plan-only goal if a planning context is free, and plans it in a separate thread */
+    void planGoalCallback(PlanServer::GoalHandle gh);
+
+    /** Plans a plan-only goal on the given goal context */
+    void planGoal(PlanServer::GoalHandle gh, unsigned int context_idx);
+
+    /** Determines the grasp pose, options and start state of the request. Returns false on failure. */
+    bool prepareRequest(const tue_manipulation_msgs::GraspPrecomputeGoalConstPtr& goal, GraspRequest& request);
+
+    /** Searches a plan for the request, sequentially on the given context, or in parallel on the planning
+        contexts if the given context is the main context. Anytime searches that are preempted return the best
+        plan found so far, if any. */
+    bool findPlan(GraspRequest& request, PlanningContext& context, MoveGroup::Plan& plan, bool& preempted);
+
+    /** Cost of a plan found for the candidate, by which anytime searches compare their plans */
+    double planCost(const GraspCandidate& candidate, const MoveGroup::Plan& plan) const;
+
+    /** Latched diagnostics with the metrics of the last request of each server */
+    ros::Publisher pub_metrics_;
+
+    /** Returns a one-line report of the candidates, stage times and plan cost of the request, and publishes
+        them as diagnostics of the given server with the given outcome */
+    std::string reportRequest(const GraspRequest& request, const std::string& server, const std::string& outcome,
+                              unsigned char level);
+
+    /** Determines the requested grasp pose from an absolute or delta goal */
+    bool getGraspPose(const tue_manipulation_msgs::GraspPrecomputeGoalConstPtr& goal, tf::Transform& grasp_pose);
+
+    /** Generates the grasp candidates of the request, ranked by their heuristic cost and limited to the
+        maximum number of candidates */
+    void generateCandidates(const GraspRequest& request, std::vector<GraspCandidate>& candidates) const;
+
+    /** Computes the waypoints of the grasp candidate for the given grasp pose */
+    void createCandidate(const tue::manipulation::ScoredGraspPose& grasp_pose, unsigned int num_grasp_points,
+                         GraspCandidate& candidate) const;
+
+    /** IK pre-filter: tries to find joint positions for the pre-grasp pose of the candidate, seeded with the
+        start state, within the IK attempt and timeout budget. Stores the solution in the candidate. */
+    bool checkIK(const robot_state::RobotState& start_state, GraspCandidate& candidate) const;
+
+    /** Plans to the pre-grasp pose of the candidate and, if required, the Cartesian approach to the grasp pose.
+        The candidate must have passed the IK pre-filter; its IK solution is used as joint-space goal. The start
+        state must have been set on the group of the context. */
+    bool planCandidate(PlanningContext& context, const GraspCandidate& candidate, bool first_joint_pos_only,
+                       MoveGroup::Plan& plan, StageTimes& times);
+
+    /** Interpolates the straight approach from the end of the plan to the grasp pose in-process and, if the
+        entire trajectory is to be executed, appends it to the plan, time-parameterized against the joint limits */
+    bool interpolateApproach(tue::IKSolver& solver, const GraspCandidate& candidate, bool first_joint_pos_only,
+                             MoveGroup::Plan& plan, StageTimes& times) const;
+
+    /** Computes the approach from the end of the plan to the grasp pose using MoveIt */
+    bool computeApproachMoveIt(MoveGroup& group, const GraspCandidate& candidate, bool first_joint_pos_only,
+                               MoveGroup::Plan& plan, StageTimes& times);
+
+    /** Tries the candidates one after another, starting at the most promising one. Returns false if no plan was
+        found or the goal was preempted. */
+    bool findPlanSequential(GraspRequest& request, PlanningContext& context, MoveGroup::Plan& plan, bool& preempted);
+
+    /** Screens all candidates for IK feasibility in parallel and plans the remaining candidates concurrently on
+        the planning contexts. Returns the plan of the most promising candidate as soon as all more promising
+        candidates have failed. */
+    bool findPlanParallel(GraspRequest& request, MoveGroup::Plan& plan, bool& preempted);
+
+    /** Plans candidates of a parallel search on one planning context until the search is done */
+    void planWorker(std::shared_ptr<ParallelSearch> search, unsigned int context_idx);
+
     /** TF listener */
     std::shared_ptr<tf::TransformListener> listener_;
 
@@ -47,13 +240,112 @@ private:
     /** Maximum offset from desired yaw [rad] */
     double max_yaw_;
 
+    /** Samples and ranks the grasp orientations around the requested grasp pose */
+    tue::manipulation::GraspCandidateGenerator candidate_generator_;
+
+    /** Maximum number of candidates that are evaluated (0 if unlimited) */
+    int max_candidates_;
+
+    /** Time after receiving a goal after which no new candidates are evaluated [s] (0 if unlimited) */
+    double candidate_time_budget_;
+
+    /** If positive, the search keeps improving its best plan for this time after receiving a goal [s] */
+    double anytime_budget_;
+
+    /** Whether anytime searches compare plans by their duration (otherwise by the heuristic cost of their
+        candidate, e.g., the deviation from the requested orientation) */
+    bool anytime_minimize_duration_;
+
     /** MoveIt group */
     std::shared_ptr<moveit::planning_interface::MoveGroupInterface> moveit_group_;
 
+    /** Planning context of the MoveIt group */
+    PlanningContext main_context_;
+
+    /** Independent planning contexts for parallel candidate evaluation (empty if disabled) */
+    std::vector<PlanningContext> planning_contexts_;
+
+    /** Maximum joint jump between two steps of the Cartesian approach [rad] */
+    double cartesian_max_joint_jump_;
+
+    /** Planning contexts that are still in use by a (possibly abandoned) search */
+    std::vector<bool> planning_context_busy_;
+    std::mutex planning_contexts_mutex_;
+    std::condition_variable planning_contexts_cond_;
+
+    /** Planning contexts for plan-only goals, and whether they are in use */
+    std::vector<PlanningContext> goal_contexts_;
+    std::vector<bool> goal_context_busy_;
+    std::mutex goal_contexts_mutex_;
+
+    /** Number of IK attempts and timeout [s] per attempt of the IK pre-filter */
+    int ik_attempts_;
+    double ik_timeout_;
+
+    /** Joint state monitor, used to acquire the start state for planning */
+    struct JointStateEntry
+    {
+        double position;
+        ros::Time stamp;
+    };
+    ros::Subscriber sub_joint_states_;
+    std::map<std::string, JointStateEntry> joint_states_;
+    std::mutex joint_states_mutex_;
+    std::condition_variable joint_states_cond_;
+    void jointStateCallback(const sensor_msgs::JointState::ConstPtr& msg);
+
+    /** Waits until all joints of the group have a state newer than the given time, and returns the latest
+        joint states. Returns false on timeout [s]. */
+    bool waitForStartState(const ros::Time& newer_than, double timeout, moveit_msgs::RobotState& start_state);
+
+    /** Active joints of the MoveIt group */
+    std::vector<std::string> group_joint_names_;
+
+    /** Time at which the last motion executed by this server ended */
+    ros::Time last_motion_end_;
+
+    /** Guards the time the last motion ended; plan-only goals read it while a motion is being executed */
+    std::mutex last_motion_end_mutex_;
+
+    /** Maximum time to wait for a start state newer than the last motion [s] */
+    double start_state_timeout_;
+
+    /** Cache of executed plans, persisted in a file (disabled if the file name is empty) */
+    tue::manipulation::PlanCache plan_cache_;
+    std::string plan_cache_file_;
+
+    /** Checksum of the robot model, group and links the cached plans are valid for */
+    uint64_t plan_cache_context_;
+
+    /** Quantization of the grasp position [m], orientation (quaternion) and start configuration [rad] */
+    double plan_cache_position_resolution_;
+    double plan_cache_orientation_resolution_;
+    double plan_cache_joint_resolution_;
+
+    /** Determines the plan cache key of the request from its grasp pose, options and start configuration */
+    void getPlanCacheKey(const GraspRequest& request, tue::manipulation::PlanCacheKey& key) const;
+
+    /** Plans found by the plan-only server that have not been executed yet */
+    tue::manipulation::PlanCache precomputed_plans_;
+
+    /** Looks up the request in the given cache and quickly re-validates the plan: the joint limits, the start
+        configuration and the end pose. Invalid plans are removed from the cache. */
+    bool getCachedPlan(tue::manipulation::PlanCache& cache, const GraspRequest& request,
+                       const tue::manipulation::PlanCacheKey& key, MoveGroup::Plan& plan);
+
+    /** Converts a plan for the request into its cached form. Returns false if the plan is incomplete. */
+    bool toCachedPlan(const GraspRequest& request, const MoveGroup::Plan& plan,
+                      tue::manipulation::CachedPlan& cached_plan) const;
+
+    /** Time from receiving a goal until a plan is found */
+    tue::manipulation::LatencyHistogram plan_latency_;
+
     /** Map with joint limits */
     struct limits {
         double lower;
         double upper;
+        double max_velocity;
+        double max_acceleration;
     };
     std::map<std::string, limits> joint_limits_;
 
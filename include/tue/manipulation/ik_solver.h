@@ -7,10 +7,7 @@
 
 #include <boost/shared_ptr.hpp>
 
-namespace urdf
-{
-    class Model;
-}
+#include "tue/manipulation/chain_model.h"
 
 namespace KDL
 {
@@ -35,28 +32,33 @@ public:
                       const std::string& tip_name, unsigned int max_iter, std::string& error,
                       bool use_constrained_solver);
 
+    // Initializes from a precompiled chain blob (see chain_blob.h) instead of parsing the URDF. If urdf is
+    // non-empty, initialization fails if the blob was not compiled from that URDF.
+    bool initFromBlob(const std::string& blob_filename, const std::string& urdf, unsigned int max_iter,
+                      std::string& error, bool use_constrained_solver);
+
     bool jointsToCartesian(const KDL::JntArray& q_in, KDL::Frame& f_out);
 
     bool cartesianToJoints(const KDL::Frame& f_in, KDL::JntArray& q_out);
 
     bool cartesianToJoints(const KDL::Frame& f_in, KDL::JntArray& q_out, const KDL::JntArray& q_seed);
 
-    inline const KDL::JntArray& jointLowerLimits() const { return q_min_; }
+    inline const KDL::JntArray& jointLowerLimits() const { return model_->q_min; }
 
-    inline const KDL::JntArray& jointUpperLimits() const { return q_max_; }
+    inline const KDL::JntArray& jointUpperLimits() const { return model_->q_max; }
 
-    inline const std::vector<std::string>& jointNames() const { return joint_names_; }
+    inline const std::vector<std::string>& jointNames() const { return model_->joint_names; }
 
-    inline unsigned int numJoints() const { return joint_names_.size(); }
+    inline unsigned int numJoints() const { return model_->numJoints(); }
 
-private:
+    inline const manipulation::ChainModelConstPtr& chainModel() const { return model_; }
 
-    //!Object to describe the (serial) kinematic chain
-    KDL::Chain chain_;
+private:
 
-    KDL::JntArray q_min_, q_max_, q_seed_;
+    void initSolvers(unsigned int max_iter, bool use_constrained_solver);
 
-    std::vector<std::string> joint_names_;
+    //!Shared (serial) kinematic chain and joint limits
+    manipulation::ChainModelConstPtr model_;
 
     // Solvers
     boost::shared_ptr<KDL::ChainFkSolverPos> fksolver_;
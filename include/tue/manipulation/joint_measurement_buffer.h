@@ -0,0 +1,78 @@
+#ifndef TUE_MANIPULATION_JOINT_MEASUREMENT_BUFFER_H_
+#define TUE_MANIPULATION_JOINT_MEASUREMENT_BUFFER_H_
+
+#include "tue/manipulation/triple_buffer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Joint positions of a single measurement. position[i] belongs to joint i of the layout, i.e., to
+// (*joint_names)[i]. All measurements with the same joint names share the same layout object, such that a
+// changed layout can be detected by comparing pointers instead of strings.
+struct JointMeasurement
+{
+    JointMeasurement() : stamp(0) {}
+
+    std::shared_ptr<const std::vector<std::string> > joint_names;
+
+    std::vector<double> position;
+
+    // [s]
+    double stamp;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Hands the latest joint measurement from a subscriber callback to an executor thread (exactly one writer thread
+// and one reader thread). Neither side blocks, and the reader always sees a complete measurement. Writing only
+// allocates when the joint names change or the number of joints grows beyond what was preallocated.
+class JointMeasurementBuffer
+{
+
+public:
+
+    // Preallocates the position arrays for the given number of joints
+    JointMeasurementBuffer(unsigned int num_joints = 0);
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Writer side
+
+    // Returns false (and writes nothing) if the numbers of names and positions differ
+    bool write(const std::vector<std::string>& joint_names, const std::vector<double>& position, double stamp);
+
+    // Joint names of the last measurement that was written
+    const std::shared_ptr<const std::vector<std::string> >& writtenLayout() const { return joint_names_; }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Reader side
+
+    // Swaps in the latest measurement, if any. Returns true if there was a new one.
+    bool update() { return buffer_.update(); }
+
+    // Only valid if hasMeasurement()
+    const JointMeasurement& latest() const { return buffer_.readBuffer(); }
+
+    bool hasMeasurement() const { return bool(buffer_.readBuffer().joint_names); }
+
+private:
+
+    TripleBuffer<JointMeasurement> buffer_;
+
+    // Layout of the last measurement that was written, only accessed by the writer
+    std::shared_ptr<const std::vector<std::string> > joint_names_;
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
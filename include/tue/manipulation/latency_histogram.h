@@ -0,0 +1,64 @@
+#ifndef TUE_MANIPULATION_LATENCY_HISTOGRAM_H_
+#define TUE_MANIPULATION_LATENCY_HISTOGRAM_H_
+
+#include <string>
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Histogram of latencies with logarithmically spaced buckets, such that both short and long latencies are
+// resolved with the same relative precision. Not thread-safe.
+class LatencyHistogram
+{
+
+public:
+
+    // Latencies [s] below min_latency and above max_latency end up in the first and last bucket
+    LatencyHistogram(double min_latency = 1e-4, double max_latency = 100, unsigned int buckets_per_decade = 10);
+
+    void add(double latency);
+
+    void clear();
+
+    unsigned long count() const { return count_; }
+
+    double min() const { return count_ > 0 ? min_ : 0; }
+
+    double max() const { return count_ > 0 ? max_ : 0; }
+
+    double mean() const { return count_ > 0 ? sum_ / count_ : 0; }
+
+    // Returns the upper bound of the bucket containing the given fraction (0 - 1) of the latencies
+    double percentile(double fraction) const;
+
+    // One-line summary: count, mean, 50th / 90th / 99th percentile and maximum in milliseconds
+    std::string summary() const;
+
+private:
+
+    double log_min_;
+
+    double buckets_per_decade_;
+
+    std::vector<unsigned long> buckets_;
+
+    unsigned long count_;
+
+    double sum_;
+
+    double min_;
+
+    double max_;
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
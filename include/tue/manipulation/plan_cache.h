@@ -0,0 +1,115 @@
+#ifndef TUE_MANIPULATION_PLAN_CACHE_H_
+#define TUE_MANIPULATION_PLAN_CACHE_H_
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Quantized description of a planning problem (e.g., goal pose, options and start configuration)
+typedef std::vector<int32_t> PlanCacheKey;
+
+// Appends the given values, quantized with the given resolution, to the key
+void appendToKey(const std::vector<double>& values, double resolution, PlanCacheKey& key);
+
+// ----------------------------------------------------------------------------------------------------
+
+struct CachedPlan
+{
+    // Additional data needed to validate the plan (e.g., the grasp pose offset used)
+    std::vector<double> tag;
+
+    std::vector<std::string> joint_names;
+
+    // Per trajectory point: time from start [s], and position and velocity of all joints
+    std::vector<double> times;
+    std::vector<std::vector<double> > positions;
+    std::vector<std::vector<double> > velocities;
+};
+
+// ----------------------------------------------------------------------------------------------------
+//
+// Least-recently-used cache of joint trajectories, which can be stored on disk. All methods are
+// thread-safe.
+//
+// File layout (native byte order):
+//
+//     char[4]   magic ("TPLC")
+//     uint32    version
+//     uint64    context checksum (e.g., of the robot model the plans were made for)
+//     uint64    checksum of the payload
+//     uint32    payload size in bytes
+//     payload:
+//         uint32    number of entries (most recently used first)
+//         per entry:
+//             uint32    key size, followed by the int32 key values
+//             uint32    tag size, followed by the double tag values
+//             uint32    number of joints
+//             per joint: string joint name (uint32 length + characters)
+//             uint32    number of points
+//             per point: double time, double[number of joints] positions, double[number of joints] velocities
+//
+// ----------------------------------------------------------------------------------------------------
+
+const uint32_t PLAN_CACHE_VERSION = 1;
+
+class PlanCache
+{
+
+public:
+
+    PlanCache(unsigned int capacity = 100);
+
+    // Sets the maximum number of plans. If the cache contains more plans, the least recently used are evicted.
+    void setCapacity(unsigned int capacity);
+
+    unsigned int size() const;
+
+    // Returns the plan with the given key and marks it as most recently used. Returns false if not found.
+    bool get(const PlanCacheKey& key, CachedPlan& plan);
+
+    // Adds or replaces the plan with the given key, evicting the least recently used plan if the cache is full
+    void put(const PlanCacheKey& key, const CachedPlan& plan);
+
+    void remove(const PlanCacheKey& key);
+
+    void clear();
+
+    // Writes the cache to the given file. The file is replaced atomically.
+    bool save(const std::string& filename, uint64_t context_checksum, std::string& error) const;
+
+    // Replaces the contents of the cache with those of the given file. Fails if the file was saved for another
+    // context.
+    bool load(const std::string& filename, uint64_t context_checksum, std::string& error);
+
+private:
+
+    typedef std::pair<PlanCacheKey, CachedPlan> Entry;
+
+    unsigned int capacity_;
+
+    // Entries, most recently used first
+    std::list<Entry> entries_;
+
+    std::map<PlanCacheKey, std::list<Entry>::iterator> index_;
+
+    mutable std::mutex mutex_;
+
+    void evict();
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
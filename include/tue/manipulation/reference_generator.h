@@ -24,7 +24,7 @@ enum JointGoalStatus
 
 struct JointGoal
 {
-    JointGoal() : status(JOINT_GOAL_ACTIVE) {}
+    JointGoal() : status(JOINT_GOAL_ACTIVE), time_optimal(false), duration(0) {}
 
     double time_since_start;
 
@@ -40,6 +40,18 @@ struct JointGoal
     bool use_cubic_interpolation;
 
     JointGoalStatus status;
+
+    // True if the trajectory was replaced by its time-optimal parameterization. In that case the original
+    // waypoints and start positions are kept, from which getGoalDurations estimates the duration without the
+    // parameterization, and duration is the optimized duration.
+    bool time_optimal;
+    std::vector<trajectory_msgs::JointTrajectoryPoint> original_points;
+    std::vector<double> start_positions;
+    double duration;
+
+    // Indices of the points that are waypoints of the goal as sent (and of trajectories spliced into it), in
+    // increasing order. Points inserted by the time-optimal parameterization or by splicing are not waypoints.
+    std::vector<unsigned int> waypoint_indices;
 };
 
 // ----------------------------------------------------------------------------------------------------
@@ -107,6 +119,16 @@ public:
         joint_info_[idx].interpolator.setMaxAcceleration(max_acc);
     }
 
+    // If enabled, goals consisting of waypoints only (no velocities) are replaced by a time-optimal cubic
+    // trajectory along the waypoints when they are accepted, as long as all joints of the goal are at rest.
+    // The path is sampled every path_resolution (joint space distance); the limits hold for the cubic
+    // interpolation between the samples.
+    void setTimeOptimalParameterization(bool enabled, double path_resolution = 0.01)
+    {
+        time_optimal_ = enabled;
+        path_resolution_ = path_resolution;
+    }
+
     bool setJointState(unsigned int idx, double pos, double vel);
 
     bool setJointState(const std::string& joint_name, double pos, double vel);
@@ -115,6 +137,18 @@ public:
 
     bool setGoal(const control_msgs::FollowJointTrajectoryGoal& goal, std::string& id, std::stringstream& ss);
 
+    // Checks the goal and, if time-optimal parameterization is enabled and the positions of all joints are given
+    // (indexed like the joint names), replaces its waypoints by the time-optimal trajectory starting at rest at
+    // those positions. Only reads the joint names and limits, so it can be called without holding the lock that
+    // guards the other calls, as long as the limits do not change.
+    bool prepareGoal(const control_msgs::FollowJointTrajectoryGoal& goal_msg, const std::vector<double>& start_positions,
+                     JointGoal& goal, std::stringstream& ss) const;
+
+    // Starts a goal prepared by prepareGoal, which is moved into the reference generator. The time-optimal
+    // trajectory is only kept if all joints of the goal are still at rest at its start positions; otherwise the
+    // original waypoints are followed.
+    bool setGoal(JointGoal& goal, std::string& id, std::stringstream& ss);
+
     bool setGoal(const std::string& joint_name, double position)
     {
         JointGoalInfo info;
@@ -132,8 +166,26 @@ public:
     bool setGoal(const std::vector<std::string>& joint_names, const std::vector<double>& positions,
                  JointGoalInfo& info);
 
+    // Replaces the part of an active goal after a given time by the points of a new trajectory, which starts
+    // delay seconds from now. The state of the goal at that time becomes the start of the new part, so the
+    // references stay continuous in position and velocity; points of the new trajectory at or before its start
+    // are skipped. If the goal ends before that time, the new points are appended after its end. The goal must be
+    // following timed points (all points have velocities) and the new trajectory must have the same joints and
+    // velocities in all points. Returns false, leaving the goal unchanged, if it cannot be spliced.
+    bool spliceGoal(const std::string& id, const control_msgs::FollowJointTrajectoryGoal& goal_msg, double delay,
+                    std::stringstream& ss);
+
+    // Time until the given goal reaches its last point, if it is following timed points [s]. Returns false otherwise.
+    bool getRemainingTime(const std::string& id, double& remaining_time) const;
+
+    // Number of waypoints of the given goal that the references have passed. Returns false if the goal is unknown.
+    bool getNumPassedWaypoints(const std::string& id, unsigned int& num_passed) const;
+
     void cancelGoal(const std::string& id, JointGoalStatus joint_goal_status = JOINT_GOAL_CANCELED);
 
+    // Cancels the goal if it is still active and forgets it, such that finished goals do not accumulate
+    void removeGoal(const std::string& id);
+
     void cancelAllGoals();
     void abortAllGoals();
 
@@ -163,6 +215,11 @@ public:
         return it->second.status;
     }
 
+    // Returns false if the goal does not exist or was not time-optimally parameterized. The nominal duration
+    // (without the parameterization) is determined by simulating the original goal with the current joint
+    // limits, so this takes some time and is meant for diagnostics only.
+    bool getGoalDurations(const std::string& id, double& nominal_duration, double& duration) const;
+
     bool isActiveGoal(const std::string& id) const
     {
         return getGoalStatus(id) == JOINT_GOAL_ACTIVE;
@@ -199,11 +256,19 @@ private:
 
     unsigned int next_goal_id_;
 
+    bool time_optimal_;
+
+    double path_resolution_;
+
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
     bool calculatePositionReferencesInternal(JointGoal& goal, double dt);
 
+    void applyTimeOptimalParameterization(JointGoal& goal, const std::vector<double>& start_positions) const;
+
+    double simulateNominalDuration(const JointGoal& goal) const;
+
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
     bool visualize_;
@@ -0,0 +1,120 @@
+#ifndef TUE_MANIPULATION_RING_BUFFER_H_
+#define TUE_MANIPULATION_RING_BUFFER_H_
+
+#include <atomic>
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Lock-free bounded queue for exactly one writer thread and one reader thread. All slots are allocated up
+// front; the writer fills writeSlot() and calls push(), the reader reads front() and calls pop(). Neither
+// side ever blocks or allocates (as long as assigning a T to a slot of the same size does not allocate).
+// If the reader falls behind and the buffer is full, writeSlot() returns 0 and the new value is dropped and
+// counted; push() then has nothing to publish.
+template<typename T>
+class RingBuffer
+{
+
+public:
+
+    // Initializes all slots, e.g. to preallocate vectors
+    RingBuffer(unsigned int capacity, const T& value = T())
+        : slots_(capacity + 1, value), head_(0), tail_(0), slot_reserved_(false), num_dropped_(0) {}
+
+    unsigned int capacity() const { return slots_.size() - 1; }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Writer side
+
+    // Returns the slot to fill, or 0 (and counts a dropped value) if the buffer is full
+    T* writeSlot()
+    {
+        unsigned int head = head_.load(std::memory_order_relaxed);
+        if (next(head) == tail_.load(std::memory_order_acquire))
+        {
+            slot_reserved_ = false;
+            num_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        slot_reserved_ = true;
+        return &slots_[head];
+    }
+
+    // Makes the slot returned by the last writeSlot() available to the reader. Returns false, without publishing
+    // anything, if writeSlot() did not return a slot (the reader may have freed one since, but it was not filled).
+    bool push()
+    {
+        if (!slot_reserved_)
+            return false;
+
+        slot_reserved_ = false;
+        head_.store(next(head_.load(std::memory_order_relaxed)), std::memory_order_release);
+        return true;
+    }
+
+    // Returns false (and counts a dropped value) if the buffer is full
+    bool push(const T& value)
+    {
+        T* slot = writeSlot();
+        if (!slot)
+            return false;
+
+        *slot = value;
+        return push();
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Reader side
+
+    // Returns the oldest value, or 0 if the buffer is empty
+    const T* front() const
+    {
+        unsigned int tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+            return 0;
+        return &slots_[tail];
+    }
+
+    // Releases the slot returned by front()
+    void pop()
+    {
+        unsigned int tail = tail_.load(std::memory_order_relaxed);
+        if (tail != head_.load(std::memory_order_acquire))
+            tail_.store(next(tail), std::memory_order_release);
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    // Number of values that were dropped because the buffer was full (may be read from either side)
+    unsigned long numDropped() const { return num_dropped_.load(std::memory_order_relaxed); }
+
+private:
+
+    unsigned int next(unsigned int i) const { return i + 1 == slots_.size() ? 0 : i + 1; }
+
+    // One slot more than the capacity, such that a full buffer can be told apart from an empty one
+    std::vector<T> slots_;
+
+    // Next slot to write, only modified by the writer
+    std::atomic<unsigned int> head_;
+
+    // Next slot to read, only modified by the reader
+    std::atomic<unsigned int> tail_;
+
+    // Whether the slot at head_ was returned by writeSlot(), only used by the writer
+    bool slot_reserved_;
+
+    std::atomic<unsigned long> num_dropped_;
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef TUE_MANIPULATION_SELF_COLLISION_H_
+#define TUE_MANIPULATION_SELF_COLLISION_H_
+
+#include <vector>
+
+#include <kdl/frames.hpp>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Capsule (line segment with radius) approximating the collision geometry of a link. The end points are
+// expressed in the frame of the link it is attached to.
+struct Capsule
+{
+    // Index of the chain segment the capsule is attached to, or -1 for the chain root link
+    int segment;
+
+    KDL::Vector p0, p1;
+
+    double radius;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Batch of line segments in structure-of-arrays layout, such that distances between many segment pairs can
+// be calculated in one vectorized loop.
+struct SegmentBatch
+{
+    std::vector<double> x0, y0, z0, x1, y1, z1;
+
+    unsigned int size() const { return x0.size(); }
+
+    void resize(unsigned int n)
+    {
+        x0.resize(n); y0.resize(n); z0.resize(n);
+        x1.resize(n); y1.resize(n); z1.resize(n);
+    }
+
+    void set(unsigned int i, const KDL::Vector& p0, const KDL::Vector& p1)
+    {
+        x0[i] = p0.x(); y0[i] = p0.y(); z0[i] = p0.z();
+        x1[i] = p1.x(); y1[i] = p1.y(); z1[i] = p1.z();
+    }
+};
+
+// Calculates the squared distance between the line segments a[i] and b[i], for i in [0, n). Uses SSE2 to
+// process two pairs at a time if available.
+void segmentDistancesSquared(const SegmentBatch& a, const SegmentBatch& b, unsigned int n, double* dist_sq);
+
+// Squared distance between two line segments
+double segmentDistanceSquared(const KDL::Vector& p1, const KDL::Vector& q1, const KDL::Vector& p2, const KDL::Vector& q2);
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TUE_MANIPULATION_TIME_OPTIMAL_PARAMETERIZATION_H_
+#define TUE_MANIPULATION_TIME_OPTIMAL_PARAMETERIZATION_H_
+
+#include <string>
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+struct TimeParameterizedPath
+{
+    std::vector<double> times;
+
+    std::vector<std::vector<double> > positions;
+
+    std::vector<std::vector<double> > velocities;
+
+    double duration() const { return times.empty() ? 0 : times.back(); }
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Calculates the time-optimal motion along the path through the given waypoints, starting and ending at
+// rest, under per-joint velocity and acceleration limits.
+//
+// The waypoints are connected by a shape-preserving (monotone) cubic spline over the joint-space chord
+// length, such that joints never overshoot between two waypoints. The path is sampled every
+// path_resolution (chord length, at least one sample per waypoint segment) and is parameterized using
+// reachability analysis (TOPP-RA): a backward pass determines for every sample the largest path velocity
+// from which the end can still be reached within the limits, after which a forward pass greedily
+// accelerates as much as the limits and these controllable sets allow.
+//
+// The result contains a time-stamped point with position and velocity for every sample, including all
+// waypoints, such that it can be followed using cubic Hermite interpolation. The limits also hold for that
+// interpolation: where a Hermite segment would exceed them, the limits around it are tightened and the
+// parameterization is repeated.
+bool parameterizeTimeOptimal(const std::vector<std::vector<double> >& waypoints,
+                             const std::vector<double>& max_vel, const std::vector<double>& max_acc,
+                             double path_resolution, TimeParameterizedPath& result, std::string& error);
+
+// Checks that the cubic Hermite interpolation of the path stays within the velocity and acceleration limits
+bool checkLimits(const TimeParameterizedPath& path, const std::vector<double>& max_vel,
+                 const std::vector<double>& max_acc, std::string& error);
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
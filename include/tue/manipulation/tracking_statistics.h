@@ -0,0 +1,91 @@
+#ifndef TUE_MANIPULATION_TRACKING_STATISTICS_H_
+#define TUE_MANIPULATION_TRACKING_STATISTICS_H_
+
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Tracking error statistics of a single trajectory goal: per-joint RMS and maximum error, and the time spent
+// per waypoint. The times of the most recent waypoints are kept in a ring buffer. All storage is allocated by
+// the constructor and start(), such that recording on a control loop never allocates. Not thread-safe.
+class TrackingStatistics
+{
+
+public:
+
+    TrackingStatistics(unsigned int waypoint_capacity = 64);
+
+    // Starts a new goal of the given number of joints at time t_start [s], which should take nominal_duration [s]
+    void start(unsigned int num_joints, double t_start, double nominal_duration);
+
+    // Adds the tracking errors (reference - measured) of all joints of the goal
+    void addSample(const std::vector<double>& errors);
+
+    // Marks that the next waypoint was reached at time t [s]
+    void addWaypoint(double t);
+
+    void finish(double t);
+
+    unsigned int numJoints() const { return sum_squared_error_.size(); }
+
+    unsigned long numSamples() const { return num_samples_; }
+
+    double rmsError(unsigned int j) const;
+
+    double maxError(unsigned int j) const { return max_error_[j]; }
+
+    // Index of the joint with the largest maximum error
+    unsigned int worstJoint() const;
+
+    unsigned long numWaypoints() const { return num_waypoints_; }
+
+    // Mean and maximum time between consecutive waypoints (the first waypoint counts from the start) [s]
+    double meanWaypointTime() const { return num_waypoints_ > 0 ? sum_waypoint_time_ / num_waypoints_ : 0; }
+
+    double maxWaypointTime() const { return max_waypoint_time_; }
+
+    // Times of at most the last waypoint_capacity waypoints, oldest first [s]
+    void recentWaypointTimes(std::vector<double>& times) const;
+
+    // Time from start() to finish() [s]
+    double duration() const { return t_end_ - t_start_; }
+
+    double nominalDuration() const { return nominal_duration_; }
+
+private:
+
+    std::vector<double> sum_squared_error_;
+
+    std::vector<double> max_error_;
+
+    unsigned long num_samples_;
+
+    // Ring buffer of waypoint times; the next one is written at num_waypoints_ modulo its size
+    std::vector<double> waypoint_times_;
+
+    unsigned long num_waypoints_;
+
+    double sum_waypoint_time_;
+
+    double max_waypoint_time_;
+
+    double t_last_waypoint_;
+
+    double t_start_;
+
+    double t_end_;
+
+    double nominal_duration_;
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TUE_MANIPULATION_TRAJECTORY_METRICS_H_
+#define TUE_MANIPULATION_TRAJECTORY_METRICS_H_
+
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+struct TrajectoryMetrics
+{
+    TrajectoryMetrics() : path_length(0), duration(0), rms_jerk(0) {}
+
+    // Length of the path in joint space [rad] (sum of the Euclidean distances between consecutive points)
+    double path_length;
+
+    // Time from the first to the last point [s]
+    double duration;
+
+    // Root mean square over time of the norm of the joint jerk vector [rad/s^3], estimated using finite
+    // differences of the positions (zero if there are less than four points)
+    double rms_jerk;
+};
+
+// Calculates the cost metrics of the trajectory given by the time-stamped positions
+void computeTrajectoryMetrics(const std::vector<double>& times, const std::vector<std::vector<double> >& positions,
+                              TrajectoryMetrics& metrics);
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
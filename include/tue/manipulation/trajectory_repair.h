@@ -0,0 +1,76 @@
+#ifndef TUE_MANIPULATION_TRAJECTORY_REPAIR_H_
+#define TUE_MANIPULATION_TRAJECTORY_REPAIR_H_
+
+#include <string>
+#include <vector>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Joint limits, indexed like the joints of the trajectory they are applied to
+struct JointLimitTable
+{
+    std::vector<double> lower;
+    std::vector<double> upper;
+    std::vector<double> max_velocity;
+    std::vector<double> max_acceleration;
+
+    void resize(unsigned int num_joints)
+    {
+        lower.resize(num_joints);
+        upper.resize(num_joints);
+        max_velocity.resize(num_joints);
+        max_acceleration.resize(num_joints);
+    }
+
+    unsigned int size() const { return lower.size(); }
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+struct TrajectoryRepairStatistics
+{
+    TrajectoryRepairStatistics() : num_position_violations(0), num_velocity_violations(0),
+        num_acceleration_violations(0), num_retimed_segments(0), added_duration(0) {}
+
+    // Number of (point, joint) pairs outside the position limits, and of (segment, joint) pairs exceeding the
+    // velocity or acceleration limits, before repair
+    unsigned int num_position_violations;
+    unsigned int num_velocity_violations;
+    unsigned int num_acceleration_violations;
+
+    // Number of segments that were slowed down, and the resulting increase of the duration [s]
+    unsigned int num_retimed_segments;
+    double added_duration;
+
+    bool repaired() const { return num_position_violations + num_velocity_violations + num_acceleration_violations > 0; }
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Repairs a trajectory (time-stamped positions and velocities) that violates the given joint limits, changing
+// it only locally around the violations. The first and last point (start and goal) are never moved.
+//
+// - Every run of points that exceeds a position limit is pulled back within the limit. The correction is
+//   blended in and out over a period that is long enough to stay well within the velocity and acceleration
+//   limits, but ends at the first and last point at the latest. The velocities of all changed points are
+//   re-estimated from the positions.
+// - Segments of which the cubic Hermite interpolation exceeds a velocity or acceleration limit are slowed down.
+//   The slow-down decays over the neighbouring segments, slowly enough that the change of timing does not
+//   violate the acceleration limits; segments further away keep their timing.
+//
+// Velocities may be empty for some or all points, in which case they are estimated. Returns false if the input
+// is inconsistent, the start or goal is outside the position limits, or the trajectory could not be repaired.
+bool repairTrajectory(const JointLimitTable& limits, std::vector<double>& times,
+                      std::vector<std::vector<double> >& positions, std::vector<std::vector<double> >& velocities,
+                      TrajectoryRepairStatistics& stats, std::string& error);
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TUE_MANIPULATION_TRIPLE_BUFFER_H_
+#define TUE_MANIPULATION_TRIPLE_BUFFER_H_
+
+#include <atomic>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+// Lock-free latest-value buffer for exactly one writer thread and one reader thread. The writer fills
+// writeBuffer() and calls publish(); the reader calls update() and then reads readBuffer(). Neither side
+// ever blocks or allocates, and the reader always sees a complete value. Values that are published
+// while the reader is not looking are overwritten by newer ones.
+template<typename T>
+class TripleBuffer
+{
+
+public:
+
+    TripleBuffer() : shared_(1), write_(0), read_(2) {}
+
+    // Initializes all three buffers, e.g. to preallocate vectors
+    explicit TripleBuffer(const T& value) : shared_(1), write_(0), read_(2)
+    {
+        for(unsigned int i = 0; i < 3; ++i)
+            buffers_[i] = value;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Writer side
+
+    T& writeBuffer() { return buffers_[write_]; }
+
+    // Makes the contents of writeBuffer() available to the reader
+    void publish()
+    {
+        unsigned int prev = shared_.exchange(write_ | FRESH, std::memory_order_acq_rel);
+        write_ = prev & INDEX_MASK;
+    }
+
+    void write(const T& value)
+    {
+        writeBuffer() = value;
+        publish();
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Reader side
+
+    // Swaps in the latest published value, if any. Returns true if there was a new value.
+    bool update()
+    {
+        if (!(shared_.load(std::memory_order_relaxed) & FRESH))
+            return false;
+
+        unsigned int prev = shared_.exchange(read_, std::memory_order_acq_rel);
+        read_ = prev & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const { return buffers_[read_]; }
+
+    // Returns true if a value has been published since the last update
+    bool hasNewValue() const { return shared_.load(std::memory_order_relaxed) & FRESH; }
+
+private:
+
+    static const unsigned int INDEX_MASK = 3;
+
+    static const unsigned int FRESH = 4;
+
+    T buffers_[3];
+
+    // Index of the buffer that is neither being written nor read, plus the FRESH flag if it contains a
+    // value the reader has not seen yet
+    std::atomic<unsigned int> shared_;
+
+    // Only accessed by the writer
+    unsigned int write_;
+
+    // Only accessed by the reader
+    unsigned int read_;
+
+};
+
+} // end namespace tue
+
+} // end namespace manipulation
+
+#endif
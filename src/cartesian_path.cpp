@@ -0,0 +1,56 @@
+#include "tue/manipulation/cartesian_path.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+double interpolateCartesianPath(IKSolver& solver, const KDL::JntArray& q_start, const KDL::Frame& goal,
+                                double max_translation_step, double max_rotation_step, double max_joint_jump,
+                                std::vector<KDL::JntArray>& path)
+{
+    path.assign(1, q_start);
+
+    KDL::Frame start;
+    if (!solver.jointsToCartesian(q_start, start))
+        return 0;
+
+    KDL::Vector translation = goal.p - start.p;
+
+    KDL::Vector axis;
+    double angle = (start.M.Inverse() * goal.M).GetRotAngle(axis);
+
+    unsigned int num_steps = std::max(1.0, std::max(std::ceil(translation.Norm() / max_translation_step),
+                                                    std::ceil(angle / max_rotation_step)));
+
+    KDL::JntArray q(q_start.rows());
+    for(unsigned int i = 1; i <= num_steps; ++i)
+    {
+        double s = (double)i / num_steps;
+        KDL::Frame f(start.M * KDL::Rotation::Rot2(axis, s * angle), start.p + translation * s);
+
+        // Warm-start from the previous step, such that we stay on the same IK branch
+        const KDL::JntArray& q_prev = path.back();
+        if (!solver.cartesianToJoints(f, q, q_prev))
+            return (double)(i - 1) / num_steps;
+
+        for(unsigned int j = 0; j < q.rows(); ++j)
+        {
+            if (std::abs(q(j) - q_prev(j)) > max_joint_jump)
+                return (double)(i - 1) / num_steps;
+        }
+
+        path.push_back(q);
+    }
+
+    return 1;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
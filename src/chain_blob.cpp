@@ -0,0 +1,336 @@
+#include "tue/manipulation/chain_blob.h"
+
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+const char CHAIN_BLOB_MAGIC[4] = { 'T', 'C', 'H', 'N' };
+
+// magic + version + URDF checksum + payload checksum + payload size
+const size_t CHAIN_BLOB_HEADER_SIZE = 4 + 4 + 8 + 8 + 4;
+
+// ----------------------------------------------------------------------------------------------------
+
+template<typename T>
+void write(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::string& out, const std::string& s)
+{
+    write<uint32_t>(out, s.size());
+    out.append(s);
+}
+
+void writeVector(std::string& out, const KDL::Vector& v)
+{
+    for(unsigned int i = 0; i < 3; ++i)
+        write<double>(out, v(i));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+class BlobReader
+{
+
+public:
+
+    BlobReader(const char* data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+    template<typename T>
+    bool read(T& value)
+    {
+        if (pos_ + sizeof(T) > size_)
+            return false;
+        memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string& s)
+    {
+        uint32_t length;
+        if (!read(length) || pos_ + length > size_)
+            return false;
+        s.assign(data_ + pos_, length);
+        pos_ += length;
+        return true;
+    }
+
+    bool readVector(KDL::Vector& v)
+    {
+        for(unsigned int i = 0; i < 3; ++i)
+        {
+            if (!read(v(i)))
+                return false;
+        }
+        return true;
+    }
+
+    bool atEnd() const { return pos_ == size_; }
+
+private:
+
+    const char* data_;
+    size_t size_;
+    size_t pos_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+bool isAxisJoint(KDL::Joint::JointType type)
+{
+    return type == KDL::Joint::RotAxis || type == KDL::Joint::TransAxis;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+void writeChainBlob(const ChainModel& model, uint64_t urdf_checksum, std::string& blob)
+{
+    std::string payload;
+
+    write<uint32_t>(payload, model.chain.getNrOfSegments());
+
+    unsigned int j = 0;
+    for(unsigned int i = 0; i < model.chain.getNrOfSegments(); ++i)
+    {
+        const KDL::Segment& seg = model.chain.getSegment(i);
+        const KDL::Joint& joint = seg.getJoint();
+
+        writeString(payload, seg.getName());
+        writeString(payload, joint.getName());
+        write<uint8_t>(payload, joint.getType());
+        writeVector(payload, joint.JointOrigin());
+        writeVector(payload, joint.JointAxis());
+
+        KDL::Frame f_tip = seg.getFrameToTip();
+        for(unsigned int k = 0; k < 9; ++k)
+            write<double>(payload, f_tip.M.data[k]);
+        writeVector(payload, f_tip.p);
+
+        if (joint.getType() != KDL::Joint::None)
+        {
+            write<double>(payload, model.q_min(j));
+            write<double>(payload, model.q_max(j));
+            write<double>(payload, model.q_seed(j));
+            ++j;
+        }
+    }
+
+    write<uint32_t>(payload, model.capsules.size());
+    for(std::vector<Capsule>::const_iterator it = model.capsules.begin(); it != model.capsules.end(); ++it)
+    {
+        write<int32_t>(payload, it->segment);
+        writeVector(payload, it->p0);
+        writeVector(payload, it->p1);
+        write<double>(payload, it->radius);
+    }
+
+    blob.clear();
+    blob.reserve(CHAIN_BLOB_HEADER_SIZE + payload.size());
+    blob.append(CHAIN_BLOB_MAGIC, 4);
+    write<uint32_t>(blob, CHAIN_BLOB_VERSION);
+    write<uint64_t>(blob, urdf_checksum);
+    write<uint64_t>(blob, fnv1aHash(payload.data(), payload.size()));
+    write<uint32_t>(blob, payload.size());
+    blob.append(payload);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readChainBlob(const char* data, size_t size, uint64_t expected_urdf_checksum, ChainModelConstPtr& model,
+                   std::string& error)
+{
+    if (size < CHAIN_BLOB_HEADER_SIZE || memcmp(data, CHAIN_BLOB_MAGIC, 4) != 0)
+    {
+        error += "Not a chain blob";
+        return false;
+    }
+
+    BlobReader header(data + 4, CHAIN_BLOB_HEADER_SIZE - 4);
+
+    uint32_t version, payload_size;
+    uint64_t urdf_checksum, payload_checksum;
+    header.read(version);
+    header.read(urdf_checksum);
+    header.read(payload_checksum);
+    header.read(payload_size);
+
+    if (version != CHAIN_BLOB_VERSION)
+    {
+        std::stringstream s;
+        s << "Unsupported chain blob version " << version << " (expected " << CHAIN_BLOB_VERSION << ")";
+        error += s.str();
+        return false;
+    }
+
+    if (expected_urdf_checksum != 0 && urdf_checksum != expected_urdf_checksum)
+    {
+        error += "Chain blob was compiled from a different URDF";
+        return false;
+    }
+
+    const char* payload = data + CHAIN_BLOB_HEADER_SIZE;
+    if (payload_size != size - CHAIN_BLOB_HEADER_SIZE || fnv1aHash(payload, payload_size) != payload_checksum)
+    {
+        error += "Chain blob is corrupt";
+        return false;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    BlobReader r(payload, payload_size);
+
+    uint32_t num_segments;
+    if (!r.read(num_segments))
+    {
+        error += "Chain blob is truncated";
+        return false;
+    }
+
+    boost::shared_ptr<ChainModel> m(new ChainModel);
+    std::vector<double> q_min, q_max, q_seed;
+
+    for(unsigned int i = 0; i < num_segments; ++i)
+    {
+        std::string seg_name, joint_name;
+        uint8_t type;
+        KDL::Vector origin, axis;
+        KDL::Frame f_tip;
+
+        bool ok = r.readString(seg_name) && r.readString(joint_name) && r.read(type)
+                && r.readVector(origin) && r.readVector(axis);
+
+        for(unsigned int k = 0; k < 9 && ok; ++k)
+            ok = r.read(f_tip.M.data[k]);
+
+        ok = ok && r.readVector(f_tip.p);
+
+        if (!ok)
+        {
+            error += "Chain blob is truncated";
+            return false;
+        }
+
+        KDL::Joint::JointType joint_type = static_cast<KDL::Joint::JointType>(type);
+        KDL::Joint joint = isAxisJoint(joint_type) ? KDL::Joint(joint_name, origin, axis, joint_type)
+                                                   : KDL::Joint(joint_name, joint_type);
+
+        m->chain.addSegment(KDL::Segment(seg_name, joint, f_tip));
+
+        if (joint_type != KDL::Joint::None)
+        {
+            double lower, upper, seed;
+            if (!r.read(lower) || !r.read(upper) || !r.read(seed))
+            {
+                error += "Chain blob is truncated";
+                return false;
+            }
+
+            m->joint_name_to_index[joint_name] = m->joint_names.size();
+            m->joint_names.push_back(joint_name);
+            m->joint_index_to_segment_index.push_back(i);
+            q_min.push_back(lower);
+            q_max.push_back(upper);
+            q_seed.push_back(seed);
+        }
+    }
+
+    uint32_t num_capsules;
+    if (!r.read(num_capsules))
+    {
+        error += "Chain blob is truncated";
+        return false;
+    }
+
+    m->capsules.resize(num_capsules);
+    for(unsigned int i = 0; i < num_capsules; ++i)
+    {
+        Capsule& capsule = m->capsules[i];
+
+        int32_t segment;
+        if (!r.read(segment) || !r.readVector(capsule.p0) || !r.readVector(capsule.p1) || !r.read(capsule.radius))
+        {
+            error += "Chain blob is truncated";
+            return false;
+        }
+
+        capsule.segment = segment;
+    }
+
+    if (!r.atEnd())
+    {
+        error += "Chain blob contains trailing data";
+        return false;
+    }
+
+    m->q_min.resize(q_min.size());
+    m->q_max.resize(q_max.size());
+    m->q_seed.resize(q_seed.size());
+    for(unsigned int j = 0; j < q_min.size(); ++j)
+    {
+        m->q_min(j) = q_min[j];
+        m->q_max(j) = q_max[j];
+        m->q_seed(j) = q_seed[j];
+    }
+
+    model = m;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool loadChainBlob(const std::string& filename, const std::string& urdf, ChainModelConstPtr& model,
+                   std::string& error)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error += "Could not open chain blob '" + filename + "'.";
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        error += "Could not read chain blob '" + filename + "'.";
+        return false;
+    }
+
+    void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        error += "Could not map chain blob '" + filename + "'.";
+        return false;
+    }
+
+    uint64_t expected_urdf_checksum = urdf.empty() ? 0 : urdfChecksum(urdf);
+    bool ok = readChainBlob(static_cast<const char*>(data), st.st_size, expected_urdf_checksum, model, error);
+
+    munmap(data, st.st_size);
+
+    return ok;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
@@ -0,0 +1,268 @@
+#include "tue/manipulation/chain_model.h"
+
+#include <urdf/model.h>
+
+#include <kdl_parser/kdl_parser.hpp>
+
+#include <kdl/tree.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+// Parsed robot description, shared between all chains extracted from the same URDF
+struct RobotDescription
+{
+    urdf::Model robot_model;
+    KDL::Tree tree;
+};
+
+// URDF strings are identified by their hash and length
+typedef std::pair<uint64_t, size_t> URDFKey;
+
+typedef std::pair<URDFKey, std::pair<std::string, std::string> > ChainKey;
+
+std::mutex cache_mutex_;
+
+std::map<URDFKey, boost::shared_ptr<RobotDescription> > descriptions_;
+
+std::map<ChainKey, ChainModelConstPtr> chain_models_;
+
+// ----------------------------------------------------------------------------------------------------
+
+boost::shared_ptr<RobotDescription> getRobotDescription(const URDFKey& key, const std::string& urdf, std::string& error)
+{
+    std::map<URDFKey, boost::shared_ptr<RobotDescription> >::const_iterator it = descriptions_.find(key);
+    if (it != descriptions_.end())
+        return it->second;
+
+    boost::shared_ptr<RobotDescription> description(new RobotDescription);
+
+    if (!description->robot_model.initString(urdf))
+    {
+        error += "Could not initialize robot model";
+        return boost::shared_ptr<RobotDescription>();
+    }
+
+    if (!kdl_parser::treeFromUrdfModel(description->robot_model, description->tree))
+    {
+        error += "Could not initialize tree object";
+        return boost::shared_ptr<RobotDescription>();
+    }
+
+    descriptions_[key] = description;
+    return description;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Approximates a collision element with a capsule in the link frame. Meshes are not supported: their extents
+// are not known without loading them.
+bool capsuleFromCollision(const urdf::Collision& collision, Capsule& capsule)
+{
+    if (!collision.geometry)
+        return false;
+
+    const urdf::Pose& o = collision.origin;
+    KDL::Frame origin(KDL::Rotation::Quaternion(o.rotation.x, o.rotation.y, o.rotation.z, o.rotation.w),
+                      KDL::Vector(o.position.x, o.position.y, o.position.z));
+
+    KDL::Vector half_axis = KDL::Vector::Zero();
+
+    switch (collision.geometry->type)
+    {
+    case urdf::Geometry::SPHERE:
+    {
+        capsule.radius = static_cast<const urdf::Sphere&>(*collision.geometry).radius;
+        break;
+    }
+    case urdf::Geometry::CYLINDER:
+    {
+        const urdf::Cylinder& cylinder = static_cast<const urdf::Cylinder&>(*collision.geometry);
+        capsule.radius = cylinder.radius;
+        half_axis = KDL::Vector(0, 0, cylinder.length / 2);
+        break;
+    }
+    case urdf::Geometry::BOX:
+    {
+        // Capsule along the longest box axis, with the largest remaining half extent as radius
+        const urdf::Vector3& dim = static_cast<const urdf::Box&>(*collision.geometry).dim;
+        KDL::Vector h(dim.x / 2, dim.y / 2, dim.z / 2);
+
+        int k = 0;
+        for(int j = 1; j < 3; ++j)
+        {
+            if (h(j) > h(k))
+                k = j;
+        }
+
+        capsule.radius = std::max(h((k + 1) % 3), h((k + 2) % 3));
+        half_axis(k) = std::max(h(k) - capsule.radius, 0.0);
+        break;
+    }
+    default:
+        return false;
+    }
+
+    capsule.p0 = origin * (-half_axis);
+    capsule.p1 = origin * half_axis;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void addCapsules(const urdf::Model& robot_model, const std::string& link_name, int segment, std::vector<Capsule>& capsules)
+{
+    auto link = robot_model.getLink(link_name);
+    if (!link)
+        return;
+
+    Capsule capsule;
+    capsule.segment = segment;
+
+    if (link->collision_array.empty())
+    {
+        if (link->collision && capsuleFromCollision(*link->collision, capsule))
+            capsules.push_back(capsule);
+        return;
+    }
+
+    for(unsigned int i = 0; i < link->collision_array.size(); ++i)
+    {
+        if (capsuleFromCollision(*link->collision_array[i], capsule))
+            capsules.push_back(capsule);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+ChainModelConstPtr createChainModel(const RobotDescription& description, const std::string& root_name,
+                                    const std::string& tip_name, std::string& error)
+{
+    const KDL::Tree& tree = description.tree;
+
+    if (tree.getSegment(root_name) == tree.getSegments().end())
+    {
+        error += "Could not find root link '" + root_name + "'.";
+        return ChainModelConstPtr();
+    }
+
+    if (tree.getSegment(tip_name) == tree.getSegments().end())
+    {
+        error += "Could not find tip link '" + tip_name + "'.";
+        return ChainModelConstPtr();
+    }
+
+    boost::shared_ptr<ChainModel> model(new ChainModel);
+    KDL::Chain& chain = model->chain;
+
+    if (!tree.getChain(root_name, tip_name, chain))
+    {
+        error += "Could not initialize chain object";
+        return ChainModelConstPtr();
+    }
+
+    // Get the joint limits from the robot model
+
+    model->q_min.resize(chain.getNrOfJoints());
+    model->q_max.resize(chain.getNrOfJoints());
+    model->q_seed.resize(chain.getNrOfJoints());
+
+    model->joint_names.resize(chain.getNrOfJoints());
+    model->joint_index_to_segment_index.resize(chain.getNrOfJoints());
+
+    unsigned int j = 0;
+    for(unsigned int i = 0; i < chain.getNrOfSegments(); ++i)
+    {
+        const KDL::Joint& kdl_joint = chain.getSegment(i).getJoint();
+        if (kdl_joint.getType() != KDL::Joint::None)
+        {
+            boost::shared_ptr<const urdf::Joint> joint = description.robot_model.getJoint(kdl_joint.getName());
+            if (joint && joint->limits)
+            {
+                model->q_min(j) = joint->limits->lower;
+                model->q_max(j) = joint->limits->upper;
+                model->q_seed(j) = (model->q_min(j) + model->q_max(j)) / 2;
+            }
+            else
+            {
+                model->q_min(j) = -1e9;
+                model->q_max(j) = 1e9;
+                model->q_seed(j) = 0;
+            }
+
+            model->joint_names[j] = kdl_joint.getName();
+            model->joint_index_to_segment_index[j] = i;
+            model->joint_name_to_index[kdl_joint.getName()] = j;
+            ++j;
+        }
+    }
+
+    // Collision geometry of the root link and all links in the chain (segments are named after their link)
+
+    addCapsules(description.robot_model, root_name, -1, model->capsules);
+    for(unsigned int i = 0; i < chain.getNrOfSegments(); ++i)
+        addCapsules(description.robot_model, chain.getSegment(i).getName(), i, model->capsules);
+
+    return model;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+uint64_t fnv1aHash(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+ChainModelConstPtr ChainModelCache::getChainModel(const std::string& urdf, const std::string& root_name,
+                                                  const std::string& tip_name, std::string& error)
+{
+    URDFKey urdf_key(urdfChecksum(urdf), urdf.size());
+    ChainKey chain_key(urdf_key, std::make_pair(root_name, tip_name));
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+
+    std::map<ChainKey, ChainModelConstPtr>::const_iterator it = chain_models_.find(chain_key);
+    if (it != chain_models_.end())
+        return it->second;
+
+    boost::shared_ptr<RobotDescription> description = getRobotDescription(urdf_key, urdf, error);
+    if (!description)
+        return ChainModelConstPtr();
+
+    ChainModelConstPtr model = createChainModel(*description, root_name, tip_name, error);
+    if (model)
+        chain_models_[chain_key] = model;
+
+    return model;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ChainModelCache::clear()
+{
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    chain_models_.clear();
+    descriptions_.clear();
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
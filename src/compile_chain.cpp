@@ -0,0 +1,70 @@
+// Compiles a root -> tip chain of a URDF into a binary chain blob, which can be loaded with
+// IKSolver::initFromBlob and DWA::initFromBlob without parsing the URDF.
+
+#include <tue/manipulation/chain_model.h>
+#include <tue/manipulation/chain_blob.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc < 5) {
+        std::cout << "Usage: 'rosrun tue_manipulation compile_chain [urdf_file] [root_link] [tip_link] [output_file]'" << std::endl;
+        return 1;
+    }
+
+    std::string urdf_path(argv[1]);
+    std::string root_name(argv[2]);
+    std::string tip_name(argv[3]);
+    std::string output_path(argv[4]);
+
+    std::ifstream f(urdf_path.c_str());
+
+    if (!f.is_open())
+    {
+        std::cout << "Could not load URDF description: '" << urdf_path << "'." << std::endl;
+        return 1;
+    }
+
+    std::stringstream buffer;
+    buffer << f.rdbuf();
+    std::string urdf_xml = buffer.str();
+
+    // - - - - - - - - - - - Compile the chain - - - - - - - - - - -
+
+    std::string error;
+    tue::manipulation::ChainModelConstPtr model = tue::manipulation::ChainModelCache::getChainModel(urdf_xml, root_name, tip_name, error);
+    if (!model)
+    {
+        std::cout << error << std::endl;
+        return 1;
+    }
+
+    std::string blob;
+    tue::manipulation::writeChainBlob(*model, tue::manipulation::urdfChecksum(urdf_xml), blob);
+
+    std::ofstream out(output_path.c_str(), std::ios::binary);
+    if (!out.is_open() || !out.write(blob.data(), blob.size()))
+    {
+        std::cout << "Could not write chain blob: '" << output_path << "'." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Compiled chain " << root_name << " -> " << tip_name << " (" << model->numJoints() << " joints, "
+              << blob.size() << " bytes) to '" << output_path << "'." << std::endl;
+
+    // - - - - - - - - - - - Verify the result - - - - - - - - - - -
+
+    tue::manipulation::ChainModelConstPtr loaded;
+    if (!tue::manipulation::readChainBlob(blob.data(), blob.size(), tue::manipulation::urdfChecksum(urdf_xml), loaded, error))
+    {
+        std::cout << "Verification failed: " << error << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
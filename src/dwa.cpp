@@ -1,16 +1,11 @@
 #include "tue/manipulation/dwa.h"
-
-#include <urdf/model.h>
-
-#include <kdl_parser/kdl_parser.hpp>
-
-#include <kdl/tree.hpp>
-#include <kdl/chainiksolverpos_nr_jl.hpp>
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainiksolvervel_pinv.hpp>
+#include "tue/manipulation/chain_blob.h"
 
 #include <geolib/datatypes.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace tue
 {
 namespace manipulation
@@ -25,7 +20,7 @@ geo::Pose3D toGeo(const KDL::Frame& f)
 
 // ----------------------------------------------------------------------------------------------------
 
-DWA::DWA() : constraint_(NULL)
+DWA::DWA() : constraint_(NULL), max_sample_vel_(0.4), sample_vel_step_(0.01), self_collision_weight_(0), self_collision_margin_(0.05)
 {
 }
 
@@ -41,153 +36,270 @@ DWA::~DWA()
 bool DWA::initFromURDF(const std::string& urdf, const std::string root_name,
                        const std::string& tip_name, std::string& error)
 {
-    urdf::Model robot_model;
-    KDL::Tree tree;
-
-    if (!robot_model.initString(urdf))
-    {
-        error += "Could not initialize robot model";
+    model_ = ChainModelCache::getChainModel(urdf, root_name, tip_name, error);
+    if (!model_)
         return false;
-    }
 
-    if (!kdl_parser::treeFromString(urdf, tree))
-    {
-        error += "Could not initialize tree object";
-        return false;
-    }
+    initCapsulePairs();
+    return true;
+}
 
-    if (tree.getSegment(root_name) == tree.getSegments().end())
-    {
-        error += "Could not find root link '" + root_name + "'.";
-        return false;
-    }
+// ----------------------------------------------------------------------------------------------------
 
-    if (tree.getSegment(tip_name) == tree.getSegments().end())
-    {
-        error += "Could not find tip link '" + tip_name + "'.";
+bool DWA::initFromBlob(const std::string& blob_filename, const std::string& urdf, std::string& error)
+{
+    if (!loadChainBlob(blob_filename, urdf, model_, error))
         return false;
-    }
 
-    if (!tree.getChain(root_name, tip_name, chain_))
-    {
-        error += "Could not initialize chain object";
+    initCapsulePairs();
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool DWA::getJointIndex(const std::string& name, unsigned int& i_joint) const
+{
+    std::map<std::string, unsigned int>::const_iterator it = model_->joint_name_to_index.find(name);
+    if (it == model_->joint_name_to_index.end())
         return false;
-    }
 
-    // Get the joint limits from the robot model
+    i_joint = it->second;
+    return true;
+}
 
-    q_min_.resize(chain_.getNrOfJoints());
-    q_max_.resize(chain_.getNrOfJoints());
-    q_seed_.resize(chain_.getNrOfJoints());
+// ----------------------------------------------------------------------------------------------------
 
-    joint_names_.resize(chain_.getNrOfJoints());
-    joint_index_to_segment_index_.resize(chain_.getNrOfJoints());
+void DWA::setSelfCollisionCost(double weight, double margin)
+{
+    self_collision_weight_ = weight;
+    self_collision_margin_ = margin;
+}
 
-    unsigned int j = 0;
-    for(unsigned int i = 0; i < chain_.getNrOfSegments(); ++i)
-    {
-//        std::cout << chain_.getSegment(i).getName() << std::endl;
+// ----------------------------------------------------------------------------------------------------
 
-        const KDL::Joint& kdl_joint = chain_.getSegment(i).getJoint();
-        if (kdl_joint.getType() != KDL::Joint::None)
-        {
-            boost::shared_ptr<const urdf::Joint> joint = robot_model.getJoint(kdl_joint.getName());
-            if (joint && joint->limits)
-            {
-                q_min_(j) = joint->limits->lower;
-                q_max_(j) = joint->limits->upper;
-                q_seed_(j) = (q_min_(j) + q_max_(j)) / 2;
-            }
-            else
-            {
-                q_min_(j) = -1e9;
-                q_max_(j) = 1e9;
-                q_seed_(j) = 0;
+void DWA::initCapsulePairs()
+{
+    const KDL::Chain& chain = model_->chain;
+    const std::vector<Capsule>& capsules = model_->capsules;
 
-            }
+    // Give all links that are rigidly connected the same body index
+    std::vector<unsigned int> segment_body(chain.getNrOfSegments());
+    unsigned int body = 0;
+    for(unsigned int i = 0; i < chain.getNrOfSegments(); ++i)
+    {
+        if (chain.getSegment(i).getJoint().getType() != KDL::Joint::None)
+            ++body;
+        segment_body[i] = body;
+    }
 
-            joint_names_[j] = kdl_joint.getName();
-            joint_index_to_segment_index_[j] = i;
-            joint_name_to_index_[kdl_joint.getName()] = j;
-            ++j;
+    // Capsules on the same body never move with respect to each other, and capsules on neighbouring bodies
+    // always touch at their joint, so only check the remaining pairs
+    capsule_pairs_.clear();
+    for(unsigned int i = 0; i < capsules.size(); ++i)
+    {
+        unsigned int body_i = capsules[i].segment < 0 ? 0 : segment_body[capsules[i].segment];
+        for(unsigned int j = i + 1; j < capsules.size(); ++j)
+        {
+            unsigned int body_j = capsules[j].segment < 0 ? 0 : segment_body[capsules[j].segment];
+            if (std::max(body_i, body_j) - std::min(body_i, body_j) > 1)
+                capsule_pairs_.push_back(std::make_pair(i, j));
         }
     }
 
-    return true;
+    Buffers& b = buffers_;
+    b.frames.resize(chain.getNrOfSegments());
+    b.capsule_p0.resize(capsules.size());
+    b.capsule_p1.resize(capsules.size());
+    b.capsule_center.resize(capsules.size());
+    b.bounding_radius.resize(capsules.size());
+    b.pair_cost.resize(capsule_pairs_.size());
+    b.moving_pairs.reserve(capsule_pairs_.size());
+    b.candidate_pairs.reserve(capsule_pairs_.size());
+    b.batch_a.resize(capsule_pairs_.size());
+    b.batch_b.resize(capsule_pairs_.size());
+    b.dist_sq.resize(capsule_pairs_.size());
 }
 
 // ----------------------------------------------------------------------------------------------------
 
-bool DWA::getJointIndex(const std::string& name, unsigned int& i_joint) const
+double DWA::selfCollisionCost(double clearance) const
 {
-    std::map<std::string, unsigned int>::const_iterator it = joint_name_to_index_.find(name);
-    if (it == joint_name_to_index_.end())
-        return false;
-
-    i_joint = it->second;
-    return true;
+    double penetration = self_collision_margin_ - clearance;
+    if (penetration <= 0)
+        return 0;
+    return self_collision_weight_ * penetration * penetration;
 }
 
 // ----------------------------------------------------------------------------------------------------
 
-void DWA::calculateVelocity(const KDL::JntArray& q_current, double dt, std::vector<double>& q_wanted) const
+unsigned int DWA::calculateVelocity(const KDL::JntArray& q_current, double dt, double vel_step,
+                                    std::vector<double>& q_wanted) const
 {
+    const KDL::Chain& chain = model_->chain;
+
     if (!constraint_)
     {
         for(unsigned int i = 0; i < q_current.rows(); ++i)
             q_wanted[i] = q_current(i);
-        return;
+        return 0;
     }
 
-    for(unsigned int i_joint = 0; i_joint < q_current.rows(); ++i_joint)
+    int num_vel_steps = std::max<int>(1, round(max_sample_vel_ / vel_step));
+    unsigned int num_samples = 0;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Calculate the frames of all segments (root to segment tip) in the current configuration
+
+    unsigned int num_segments = chain.getNrOfSegments();
+    std::vector<KDL::Frame>& frames = buffers_.frames;
+
+    KDL::Frame f_root = KDL::Frame::Identity();
+    unsigned int j = 0;
+    for(unsigned int i = 0; i < num_segments; ++i)
+    {
+        const KDL::Segment& seg = chain.getSegment(i);
+        double pos = 0;
+        if (seg.getJoint().getType() != KDL::Joint::None)
+        {
+            pos = q_current(j);
+            ++j;
+        }
+
+        f_root = f_root * seg.pose(pos);
+        frames[i] = f_root;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Place the collision capsules in the current configuration
+
+    bool check_self_collision = self_collision_weight_ > 0 && !capsule_pairs_.empty();
+
+    const std::vector<Capsule>& capsules = model_->capsules;
+    std::vector<KDL::Vector>& capsule_p0 = buffers_.capsule_p0;
+    std::vector<KDL::Vector>& capsule_p1 = buffers_.capsule_p1;
+    std::vector<KDL::Vector>& capsule_center = buffers_.capsule_center;
+    std::vector<double>& bounding_radius = buffers_.bounding_radius;
+    std::vector<double>& pair_cost = buffers_.pair_cost;
+    double total_pair_cost = 0;
+
+    if (check_self_collision)
     {
+        for(unsigned int i = 0; i < capsules.size(); ++i)
+        {
+            const Capsule& c = capsules[i];
+            const KDL::Frame& f = c.segment < 0 ? KDL::Frame::Identity() : frames[c.segment];
+            capsule_p0[i] = f * c.p0;
+            capsule_p1[i] = f * c.p1;
+            capsule_center[i] = (capsule_p0[i] + capsule_p1[i]) / 2;
+            bounding_radius[i] = (capsule_p1[i] - capsule_p0[i]).Norm() / 2 + c.radius;
+        }
 
-        unsigned int i_seg = joint_index_to_segment_index_[i_joint];
+        for(unsigned int k = 0; k < capsule_pairs_.size(); ++k)
+        {
+            unsigned int a = capsule_pairs_[k].first;
+            unsigned int b = capsule_pairs_[k].second;
+            double dist = sqrt(segmentDistanceSquared(capsule_p0[a], capsule_p1[a], capsule_p0[b], capsule_p1[b]));
+            pair_cost[k] = selfCollisionCost(dist - capsules[a].radius - capsules[b].radius);
+            total_pair_cost += pair_cost[k];
+        }
+    }
 
-        KDL::Frame f_before = KDL::Frame::Identity();
-        KDL::Frame f_after = KDL::Frame::Identity();
+    std::vector<std::pair<unsigned int, unsigned int> >& moving_pairs = buffers_.moving_pairs;
+    std::vector<unsigned int>& candidate_pairs = buffers_.candidate_pairs;
+    SegmentBatch& batch_a = buffers_.batch_a;
+    SegmentBatch& batch_b = buffers_.batch_b;
+    std::vector<double>& dist_sq = buffers_.dist_sq;
 
-        unsigned int j = 0;
-        const KDL::Segment* q_seg = 0;
-        for(unsigned int i = 0; i < chain_.getNrOfSegments(); ++i)
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    for(unsigned int i_joint = 0; i_joint < q_current.rows(); ++i_joint)
+    {
+        unsigned int i_seg = model_->joint_index_to_segment_index[i_joint];
+
+        const KDL::Segment* q_seg = &chain.getSegment(i_seg);
+        KDL::Frame f_before = i_seg > 0 ? frames[i_seg - 1] : KDL::Frame::Identity();
+        KDL::Frame f_after = frames[i_seg].Inverse() * frames[num_segments - 1];
+        KDL::Frame f_seg_inv = frames[i_seg].Inverse();
+
+        // Only pairs of which one capsule moves with this joint and the other does not change distance; the cost
+        // of all other pairs stays the same for every sample
+        double static_pair_cost = total_pair_cost;
+        moving_pairs.clear();
+        for(unsigned int k = 0; check_self_collision && k < capsule_pairs_.size(); ++k)
         {
-            double pos;
-            const KDL::Segment& seg = chain_.getSegment(i);
-            if (seg.getJoint().getType() != KDL::Joint::None)
-            {
-                pos = q_current(j);
-                ++j;
-            }
-            else
+            unsigned int a = capsule_pairs_[k].first;
+            unsigned int b = capsule_pairs_[k].second;
+            bool a_moves = capsules[a].segment >= (int)i_seg;
+            bool b_moves = capsules[b].segment >= (int)i_seg;
+            if (a_moves != b_moves)
             {
-                pos = 0;
+                // First element is the moving capsule
+                moving_pairs.push_back(a_moves ? std::make_pair(a, b) : std::make_pair(b, a));
+                static_pair_cost -= pair_cost[k];
             }
-
-            KDL::Frame f = seg.pose(pos);
-
-            if (i < i_seg)
-                f_before = f_before * f;
-            else if (i > i_seg)
-                f_after = f_after * f;
-            else
-                q_seg = &seg;
         }
 
         double best_dist = 1e10;
         double best_vel = 0;
 
         double pos = q_current(i_joint);
-        for(double vel = -0.4; vel < 0.41; vel += 0.01)
+        for(int i_vel = -num_vel_steps; i_vel <= num_vel_steps; ++i_vel)
         {
+            double vel = i_vel * max_sample_vel_ / num_vel_steps;
             double p = pos + vel;
 
             //        std::cout << q_min_(q) << ", " << q_max_(q) << std::endl;
 
-            if (p > q_min_(i_joint) && p < q_max_(i_joint))
+            if (p > model_->q_min(i_joint) && p < model_->q_max(i_joint))
             {
-                KDL::Frame f = f_before * q_seg->pose(p) * f_after;
+                KDL::Frame f_seg = f_before * q_seg->pose(p);
+                KDL::Frame f = f_seg * f_after;
 
                 double dist = constraint_->test(toGeo(f));
+
+                if (!moving_pairs.empty())
+                {
+                    // Transformation of all capsules that move with this joint
+                    KDL::Frame delta = f_seg * f_seg_inv;
+
+                    // Broad phase: skip pairs of which the bounding spheres are further apart than the margin
+                    candidate_pairs.clear();
+                    for(unsigned int k = 0; k < moving_pairs.size(); ++k)
+                    {
+                        unsigned int a = moving_pairs[k].first;
+                        unsigned int b = moving_pairs[k].second;
+                        double center_dist = (delta * capsule_center[a] - capsule_center[b]).Norm();
+                        if (center_dist - bounding_radius[a] - bounding_radius[b] < self_collision_margin_)
+                            candidate_pairs.push_back(k);
+                    }
+
+                    // Narrow phase: segment distances of all remaining pairs in one batch (the batches hold all pairs,
+                    // only the first n are used)
+                    unsigned int n = candidate_pairs.size();
+                    if (n > 0)
+                    {
+                        for(unsigned int k = 0; k < n; ++k)
+                        {
+                            unsigned int a = moving_pairs[candidate_pairs[k]].first;
+                            unsigned int b = moving_pairs[candidate_pairs[k]].second;
+                            batch_a.set(k, delta * capsule_p0[a], delta * capsule_p1[a]);
+                            batch_b.set(k, capsule_p0[b], capsule_p1[b]);
+                        }
+
+                        segmentDistancesSquared(batch_a, batch_b, n, &dist_sq[0]);
+
+                        for(unsigned int k = 0; k < n; ++k)
+                        {
+                            unsigned int a = moving_pairs[candidate_pairs[k]].first;
+                            unsigned int b = moving_pairs[candidate_pairs[k]].second;
+                            dist += selfCollisionCost(sqrt(dist_sq[k]) - capsules[a].radius - capsules[b].radius);
+                        }
+                    }
+                }
+
+                dist += static_pair_cost;
+                ++num_samples;
+
                 if (dist < best_dist)
                 {
                     best_dist = dist;
@@ -198,6 +310,8 @@ void DWA::calculateVelocity(const KDL::JntArray& q_current, double dt, std::vect
 
         q_wanted[i_joint] = q_current(i_joint) + (best_vel * dt);
     }
+
+    return num_samples;
 }
 
 
@@ -0,0 +1,189 @@
+#include "tue/manipulation/dwa_controller.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+// Number of consecutive fast ticks before the sampling is refined again
+const unsigned int NUM_TICKS_BEFORE_REFINE = 10;
+
+// Maximum coarsening of the velocity step with respect to the nominal step
+const double MAX_VEL_STEP_FACTOR = 16;
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+DWAController::DWAController(const DWA& dwa) : dwa_(dwa), num_joints_(dwa.getJointNames().size()), period_(0),
+    coarsen_fraction_(0.8), refine_fraction_(0.4), running_(false), q_measured_(num_joints_, 0),
+    q_set_(num_joints_, false), num_joints_set_(0), joint_buffer_(std::vector<double>(num_joints_, 0))
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+DWAController::~DWAController()
+{
+    stop();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DWAController::start(double frequency, const ReferenceCallback& callback)
+{
+    stop();
+
+    callback_ = callback;
+    period_ = 1.0 / frequency;
+    running_ = true;
+    thread_ = std::thread(&DWAController::run, this);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DWAController::stop()
+{
+    running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DWAController::setJointPositions(const std::vector<double>& q)
+{
+    if (q.size() != num_joints_)
+        return;
+
+    q_measured_ = q;
+    num_joints_set_ = num_joints_;
+    joint_buffer_.write(q_measured_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DWAController::setJointPositions(const std::vector<std::string>& names, const std::vector<double>& positions)
+{
+    for(unsigned int i = 0; i < names.size() && i < positions.size(); ++i)
+    {
+        unsigned int i_joint;
+        if (!dwa_.getJointIndex(names[i], i_joint))
+            continue;
+
+        q_measured_[i_joint] = positions[i];
+        if (!q_set_[i_joint])
+        {
+            q_set_[i_joint] = true;
+            ++num_joints_set_;
+        }
+    }
+
+    if (num_joints_set_ < num_joints_)
+        return;
+
+    joint_buffer_.write(q_measured_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const DWAControllerStatistics& DWAController::statistics()
+{
+    statistics_buffer_.update();
+    return statistics_buffer_.readBuffer();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void DWAController::run()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period_));
+
+    KDL::JntArray q_current(num_joints_);
+    std::vector<double> q_wanted(num_joints_);
+    bool joints_received = false;
+
+    double nominal_vel_step = dwa_.velocitySampleStep();
+    double vel_step = nominal_vel_step;
+    unsigned int num_fast_ticks = 0;
+
+    DWAControllerStatistics stats;
+    Clock::time_point next_tick = Clock::now();
+
+    while (running_)
+    {
+        next_tick += period;
+
+        if (joint_buffer_.update())
+        {
+            const std::vector<double>& q = joint_buffer_.readBuffer();
+            for(unsigned int i = 0; i < num_joints_; ++i)
+                q_current(i) = q[i];
+            joints_received = true;
+        }
+
+        if (joints_received)
+        {
+            Clock::time_point t_start = Clock::now();
+
+            stats.num_samples = dwa_.calculateVelocity(q_current, period_, vel_step, q_wanted);
+            callback_(q_wanted);
+
+            double compute_time = std::chrono::duration<double>(Clock::now() - t_start).count();
+
+            // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+            // Bookkeeping
+
+            ++stats.num_ticks;
+            if (compute_time > period_)
+                ++stats.num_deadline_misses;
+
+            stats.compute_time = compute_time;
+            stats.max_compute_time = std::max(stats.max_compute_time, compute_time);
+            stats.mean_compute_time += (compute_time - stats.mean_compute_time) / stats.num_ticks;
+            stats.vel_step = vel_step;
+
+            statistics_buffer_.write(stats);
+
+            // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+            // Adapt the sampling resolution to the load
+
+            if (compute_time > coarsen_fraction_ * period_)
+            {
+                vel_step = std::min(2 * vel_step, MAX_VEL_STEP_FACTOR * nominal_vel_step);
+                num_fast_ticks = 0;
+            }
+            else if (compute_time < refine_fraction_ * period_ && vel_step > nominal_vel_step)
+            {
+                if (++num_fast_ticks >= NUM_TICKS_BEFORE_REFINE)
+                {
+                    vel_step = std::max(vel_step / 2, nominal_vel_step);
+                    num_fast_ticks = 0;
+                }
+            }
+            else
+            {
+                num_fast_ticks = 0;
+            }
+        }
+
+        // If we overran, start the next tick right away instead of trying to catch up
+        Clock::time_point now = Clock::now();
+        if (now >= next_tick)
+            next_tick = now;
+        else
+            std::this_thread::sleep_until(next_tick);
+    }
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
@@ -0,0 +1,150 @@
+#include "tue/manipulation/grasp_candidate_generator.h"
+
+#include <tf/transform_datatypes.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+// Tolerance on the maximum offsets, such that a maximum that is a multiple of the step is included
+const double ANGLE_EPS = 1e-9;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Samples 0, -step, step, -2 * step, 2 * step, ... up to max_offset
+void sampleAngles(double step, double max_offset, std::vector<double>& angles)
+{
+    angles.assign(1, 0);
+    if (step <= 0)
+        return;
+
+    for(unsigned int i = 1; i * step <= max_offset + ANGLE_EPS; ++i)
+    {
+        angles.push_back(-(i * step));
+        angles.push_back(i * step);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool compareCost(const ScoredGraspPose& a, const ScoredGraspPose& b)
+{
+    return a.cost < b.cost;
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+GraspCandidateGenerator::GraspCandidateGenerator() : mode_(SAMPLE_YAW), roll_step_(0), max_roll_(0),
+    pitch_step_(0), max_pitch_(0), yaw_step_(0), max_yaw_(0), num_approach_directions_(1),
+    max_approach_angle_(0), orientation_weight_(1), workspace_center_(0, 0, 0), workspace_weight_(0),
+    alignment_weight_(0), pre_grasp_distance_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void GraspCandidateGenerator::generate(const tf::Transform& grasp_pose, std::vector<ScoredGraspPose>& candidates) const
+{
+    std::vector<tf::Quaternion> offsets;
+
+    if (mode_ == SAMPLE_APPROACH)
+    {
+        // Spread the directions over the spherical cap around the x-axis using the golden angle, such that they
+        // cover equal areas. The first direction is the requested approach axis.
+        unsigned int n = std::max(1u, num_approach_directions_);
+        double golden_angle = M_PI * (3 - std::sqrt(5.0));
+        double min_cos = std::cos(max_approach_angle_);
+
+        std::vector<double> rolls;
+        sampleAngles(roll_step_, max_roll_, rolls);
+
+        for(unsigned int k = 0; k < n; ++k)
+        {
+            double cos_theta = n > 1 ? 1 - (1 - min_cos) * k / (n - 1) : 1;
+            double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+            double phi = k * golden_angle;
+
+            tf::Vector3 direction(cos_theta, sin_theta * std::cos(phi), sin_theta * std::sin(phi));
+            tf::Quaternion swing = k == 0 ? tf::Quaternion(0, 0, 0, 1)
+                                          : tf::shortestArcQuat(tf::Vector3(1, 0, 0), direction);
+
+            for(std::vector<double>::const_iterator it = rolls.begin(); it != rolls.end(); ++it)
+                offsets.push_back(swing * tf::Quaternion(tf::Vector3(1, 0, 0), *it));
+        }
+    }
+    else
+    {
+        std::vector<double> rolls, pitches, yaws;
+        sampleAngles(yaw_step_, max_yaw_, yaws);
+        if (mode_ == SAMPLE_GRID)
+        {
+            sampleAngles(roll_step_, max_roll_, rolls);
+            sampleAngles(pitch_step_, max_pitch_, pitches);
+        }
+        else
+        {
+            rolls.assign(1, 0);
+            pitches.assign(1, 0);
+        }
+
+        for(std::vector<double>::const_iterator it_y = yaws.begin(); it_y != yaws.end(); ++it_y)
+            for(std::vector<double>::const_iterator it_p = pitches.begin(); it_p != pitches.end(); ++it_p)
+                for(std::vector<double>::const_iterator it_r = rolls.begin(); it_r != rolls.end(); ++it_r)
+                    offsets.push_back(tf::createQuaternionFromRPY(*it_r, *it_p, *it_y));
+    }
+
+    candidates.resize(offsets.size());
+    for(unsigned int i = 0; i < offsets.size(); ++i)
+    {
+        ScoredGraspPose& c = candidates[i];
+        c.offset = offsets[i];
+        c.pose = grasp_pose * tf::Transform(offsets[i], tf::Vector3(0, 0, 0));
+        c.cost = cost(c.pose, c.offset);
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), compareCost);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double GraspCandidateGenerator::cost(const tf::Transform& grasp_pose, const tf::Quaternion& offset) const
+{
+    double c = 0;
+
+    if (orientation_weight_ != 0)
+    {
+        // Rotation angle of the offset, taking the shortest way around
+        double angle = 2 * std::acos(std::min(1.0, std::abs(offset.getW())));
+        c += orientation_weight_ * angle;
+    }
+
+    if (workspace_weight_ != 0)
+    {
+        tf::Vector3 pre_grasp = grasp_pose * tf::Vector3(-pre_grasp_distance_, 0, 0);
+        c += workspace_weight_ * (pre_grasp - workspace_center_).length();
+    }
+
+    if (alignment_weight_ != 0)
+    {
+        // Approaching the object from the workspace center is easiest for the wrist
+        tf::Vector3 approach = grasp_pose.getBasis().getColumn(0);
+        tf::Vector3 reach = grasp_pose.getOrigin() - workspace_center_;
+        if (reach.length() > 0)
+            c += alignment_weight_ * (1 - approach.dot(reach.normalized()));
+    }
+
+    return c;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
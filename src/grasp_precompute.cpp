@@ -1,4 +1,9 @@
 #include "tue/manipulation/grasp_precompute.h"
+#include "tue/manipulation/cartesian_path.h"
+#include "tue/manipulation/time_optimal_parameterization.h"
+#include "tue/manipulation/trajectory_repair.h"
+
+#include <diagnostic_msgs/DiagnosticArray.h>
 
 #include <ros/ros.h>
 #include <moveit/robot_state/robot_state.h>
@@ -6,9 +11,53 @@
 #include <moveit/trajectory_processing/iterative_time_parameterization.h>
 
 #include <moveit/robot_model/joint_model.h>
+#include <moveit/robot_state/conversions.h>
+
+#include <Eigen/Geometry>
+
+#include <tf_conversions/tf_kdl.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <thread>
 
 const double EPS = 1e-6;
 
+// Cartesian approach: maximum translation [m] and rotation [rad] per step, and path resolution for the
+// time-parameterization (joint space chord length)
+const double CARTESIAN_TRANSLATION_STEP = 0.01;
+const double CARTESIAN_ROTATION_STEP = 0.05;
+const double CARTESIAN_PATH_RESOLUTION = 0.01;
+
+// Tolerances on the end pose of cached plans, on top of the quantization of the grasp pose [m, rad]
+const double PLAN_CACHE_POSITION_TOLERANCE = 0.01;
+const double PLAN_CACHE_ORIENTATION_TOLERANCE = 0.1;
+
+// Velocity [rad/s] and acceleration [rad/s^2] limits for joints for which the robot model does not specify them
+const double DEFAULT_MAX_VELOCITY = 1.0;
+const double DEFAULT_MAX_ACCELERATION = 1.0;
+
+// Returns the wall-clock time since the given time [s]
+double secondsSince(const ros::WallTime& t)
+{
+    return (ros::WallTime::now() - t).toSec();
+}
+
+// Adds a key-value pair to the diagnostic status
+template<typename T>
+void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value)
+{
+    std::stringstream s;
+    s << value;
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = s.str();
+    status.values.push_back(kv);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 bool GraspPrecompute::initialize()
@@ -46,12 +95,119 @@ bool GraspPrecompute::initialize()
     nh_private.param("max_yaw_delta", max_yaw_, 2.0);
     nh_private.param("yaw_sampling_step", yaw_sampling_step_, 0.2);
 
+    /// Grasp candidate sampling: "yaw" (only yaw offsets), "grid" (roll / pitch / yaw grid) or "approach"
+    /// (approach directions within a cone, combined with roll offsets)
+    std::string grasp_sampling;
+    nh_private.param<std::string>("grasp_sampling", grasp_sampling, "yaw");
+    if (grasp_sampling == "grid")
+        candidate_generator_.setSamplingMode(tue::manipulation::GraspCandidateGenerator::SAMPLE_GRID);
+    else if (grasp_sampling == "approach")
+        candidate_generator_.setSamplingMode(tue::manipulation::GraspCandidateGenerator::SAMPLE_APPROACH);
+    else if (grasp_sampling != "yaw")
+    {
+        ROS_ERROR("Unknown grasp sampling '%s', should be 'yaw', 'grid' or 'approach'.", grasp_sampling.c_str());
+        return false;
+    }
+
+    double roll_sampling_step, max_roll, pitch_sampling_step, max_pitch, max_approach_angle;
+    int num_approach_directions;
+    nh_private.param("roll_sampling_step", roll_sampling_step, 0.0);
+    nh_private.param("max_roll_delta", max_roll, 0.0);
+    nh_private.param("pitch_sampling_step", pitch_sampling_step, 0.0);
+    nh_private.param("max_pitch_delta", max_pitch, 0.0);
+    nh_private.param("num_approach_directions", num_approach_directions, 50);
+    nh_private.param("max_approach_angle", max_approach_angle, 1.0);
+    candidate_generator_.setRollSampling(roll_sampling_step, max_roll);
+    candidate_generator_.setPitchSampling(pitch_sampling_step, max_pitch);
+    candidate_generator_.setYawSampling(yaw_sampling_step_, max_yaw_);
+    candidate_generator_.setApproachSampling(std::max(1, num_approach_directions), max_approach_angle);
+    candidate_generator_.setPreGraspDistance(pre_grasp_delta_);
+
+    // Candidates are ranked by their deviation from the requested orientation and, optionally, by their distance
+    // to and alignment with the workspace center (e.g., the shoulder) expressed in the root link
+    double orientation_weight, workspace_weight, wrist_alignment_weight;
+    tf::Vector3 workspace_center;
+    nh_private.param("orientation_weight", orientation_weight, 1.0);
+    nh_private.param("workspace_weight", workspace_weight, 0.0);
+    nh_private.param("wrist_alignment_weight", wrist_alignment_weight, 0.0);
+    nh_private.param("workspace_center_x", workspace_center[0], 0.0);
+    nh_private.param("workspace_center_y", workspace_center[1], 0.0);
+    nh_private.param("workspace_center_z", workspace_center[2], 0.0);
+    candidate_generator_.setHeuristic(orientation_weight, workspace_center, workspace_weight, wrist_alignment_weight);
+
+    nh_private.param("max_candidates", max_candidates_, 0);
+    nh_private.param("candidate_time_budget", candidate_time_budget_, 0.0);
+
+    // Anytime mode: keep searching for better plans, compared by "duration" or "candidate_cost", until the budget
+    // has passed, and return the best plan found
+    std::string anytime_objective;
+    nh_private.param("anytime_budget", anytime_budget_, 0.0);
+    nh_private.param<std::string>("anytime_objective", anytime_objective, "duration");
+    if (anytime_objective != "duration" && anytime_objective != "candidate_cost")
+    {
+        ROS_ERROR("Unknown anytime objective '%s': should be 'duration' or 'candidate_cost'", anytime_objective.c_str());
+        return false;
+    }
+    anytime_minimize_duration_ = (anytime_objective == "duration");
+
+    // If more than one, yaw candidates are evaluated in parallel on this number of planning contexts
+    int num_planning_threads;
+    nh_private.param("num_planning_threads", num_planning_threads, 1);
+    nh_private.param("ik_attempts", ik_attempts_, 10);
+    nh_private.param("ik_timeout", ik_timeout_, 0.1);
+    nh_private.param("start_state_timeout", start_state_timeout_, 1.0);
+
+    // If positive, a second action server plans (without executing) up to this number of goals concurrently
+    int num_concurrent_goals;
+    nh_private.param("num_concurrent_goals", num_concurrent_goals, 0);
+    nh_private.param("cartesian_max_joint_jump", cartesian_max_joint_jump_, 0.2);
+
+    // Executed plans are cached in this file and re-used for similar requests. Note that cached plans are not
+    // checked for collisions with the current environment.
+    int plan_cache_size;
+    nh_private.param<std::string>("plan_cache_file", plan_cache_file_, "");
+    nh_private.param("plan_cache_size", plan_cache_size, 100);
+    nh_private.param("plan_cache_position_resolution", plan_cache_position_resolution_, 0.01);
+    nh_private.param("plan_cache_orientation_resolution", plan_cache_orientation_resolution_, 0.02);
+    nh_private.param("plan_cache_joint_resolution", plan_cache_joint_resolution_, 0.01);
+    plan_cache_.setCapacity(std::max(1, plan_cache_size));
+
+    std::string joint_states_topic;
+    nh_private.param<std::string>("joint_states_topic", joint_states_topic, "joint_states");
+
     /// MoveIt
     moveit::planning_interface::MoveGroupInterface::Options options(side+"_arm", "/amigo/robot_description", nh);
     moveit_group_ = std::shared_ptr<moveit::planning_interface::MoveGroupInterface>(
           new moveit::planning_interface::MoveGroupInterface(options));
     moveit_group_->setPoseReferenceFrame(root_link_);
     moveit_group_->setEndEffectorLink(tip_link_);
+    main_context_.group = moveit_group_;
+
+    for (int i = 0; i < num_planning_threads && num_planning_threads > 1; ++i)
+    {
+        planning_contexts_.push_back(PlanningContext());
+        planning_contexts_.back().group.reset(new MoveGroup(options));
+    }
+    planning_context_busy_.resize(planning_contexts_.size(), false);
+
+    for (int i = 0; i < num_concurrent_goals; ++i)
+    {
+        goal_contexts_.push_back(PlanningContext());
+        goal_contexts_.back().group.reset(new MoveGroup(options));
+    }
+    goal_context_busy_.resize(goal_contexts_.size(), false);
+
+    std::vector<PlanningContext*> contexts(1, &main_context_);
+    for (unsigned int i = 0; i < planning_contexts_.size(); ++i)
+        contexts.push_back(&planning_contexts_[i]);
+    for (unsigned int i = 0; i < goal_contexts_.size(); ++i)
+        contexts.push_back(&goal_contexts_[i]);
+
+    for (unsigned int i = 1; i < contexts.size(); ++i)
+    {
+        contexts[i]->group->setPoseReferenceFrame(root_link_);
+        contexts[i]->group->setEndEffectorLink(tip_link_);
+    }
 
     // try to fetch the robot state
     robot_state::RobotModelConstPtr robot_model = 0;
@@ -83,17 +239,81 @@ bool GraspPrecompute::initialize()
             limits climits;
             climits.lower = bounds[0].min_position_;
             climits.upper = bounds[0].max_position_;
+            climits.max_velocity = bounds[0].velocity_bounded_ ? bounds[0].max_velocity_ : DEFAULT_MAX_VELOCITY;
+            climits.max_acceleration = bounds[0].acceleration_bounded_ ? bounds[0].max_acceleration_
+                                                                       : DEFAULT_MAX_ACCELERATION;
 //            ROS_INFO("Joint %s: lower: %f, upper: %f", name.c_str(), lower, upper);
             joint_limits_[name] = climits;
         }
     }
 
+    /// Monitor the joint states, such that the start state can be acquired without waiting a fixed time
+    group_joint_names_ = moveit_group_->getActiveJoints();
+    const std::vector<std::string>& variable_names = robot_model->getVariableNames();
+    for (std::vector<std::string>::const_iterator it = variable_names.begin(); it != variable_names.end(); ++it)
+        joint_states_[*it].stamp = ros::Time(0);
+    sub_joint_states_ = nh.subscribe(joint_states_topic, 10, &GraspPrecompute::jointStateCallback, this);
+
+    /// IK solvers for interpolating the Cartesian approach in-process, one per planning context. The chain must
+    /// only contain joints of the group, otherwise MoveIt computes the approach.
+    std::string urdf, error;
+    bool cartesian_ok = nh.getParam(options.robot_description_, urdf);
+    if (!cartesian_ok)
+        error = "no robot description";
+
+    for (unsigned int i = 0; i < contexts.size() && cartesian_ok; ++i)
+    {
+        contexts[i]->cartesian_solver.reset(new tue::IKSolver);
+        cartesian_ok = contexts[i]->cartesian_solver->initFromURDF(urdf, root_link_, tip_link_, 500, error, false);
+    }
+
+    for (unsigned int i = 0; cartesian_ok && i < main_context_.cartesian_solver->numJoints(); ++i)
+    {
+        const std::string& name = main_context_.cartesian_solver->jointNames()[i];
+        if (std::find(group_joint_names_.begin(), group_joint_names_.end(), name) == group_joint_names_.end())
+        {
+            error = "joint '" + name + "' is not part of the group";
+            cartesian_ok = false;
+        }
+    }
+
+    if (!cartesian_ok)
+    {
+        ROS_WARN("Cannot interpolate the Cartesian approach in-process (%s), using MoveIt instead", error.c_str());
+        for (unsigned int i = 0; i < contexts.size(); ++i)
+            contexts[i]->cartesian_solver.reset();
+    }
+
+    /// Load the plan cache. Plans are only valid for the same robot model, group and links.
+    if (!plan_cache_file_.empty())
+    {
+        std::string context = urdf + "\n" + moveit_group_->getName() + "\n" + root_link_ + "\n" + tip_link_;
+        plan_cache_context_ = tue::manipulation::fnv1aHash(context.data(), context.size());
+
+        std::string cache_error;
+        if (plan_cache_.load(plan_cache_file_, plan_cache_context_, cache_error))
+            ROS_INFO("Loaded %u cached plans from '%s'", plan_cache_.size(), plan_cache_file_.c_str());
+        else
+            ROS_INFO("Starting with an empty plan cache: %s", cache_error.c_str());
+    }
+
+    /// Metrics of the last request of each server, latched such that they can be inspected afterwards
+    pub_metrics_ = nh_private.advertise<diagnostic_msgs::DiagnosticArray>("metrics", 1, true);
+
     /// Start Cartesian action server
     as_ = std::shared_ptr<actionlib::SimpleActionServer<tue_manipulation_msgs::GraspPrecomputeAction>>(
           new actionlib::SimpleActionServer<tue_manipulation_msgs::GraspPrecomputeAction>(nh, "grasp_precompute",
                     boost::bind(&GraspPrecompute::execute, this, _1), false));
     as_->start();
 
+    /// Start the plan-only action server, which accepts multiple goals at once
+    if (!goal_contexts_.empty())
+    {
+        plan_server_.reset(new PlanServer(nh, "grasp_precompute_plan",
+                                          boost::bind(&GraspPrecompute::planGoalCallback, this, _1), false));
+        plan_server_->start();
+    }
+
     ROS_INFO("Grasp precompute action server started");
 
     return true;
@@ -101,15 +321,379 @@ bool GraspPrecompute::initialize()
 
 ////////////////////////////////////////////////////////////////////////////////
 
+
 void GraspPrecompute::execute(const tue_manipulation_msgs::GraspPrecomputeGoalConstPtr& goal)
 {
     /// Initialize variables
-    unsigned int num_grasp_points = 1;
-    unsigned int pre_grasp_inbetween_sampling_steps = 20; // Hardcoded, we might not need this... //PRE_GRASP_INBETWEEN_SAMPLING_STEPS
+    GraspRequest request;
+    request.preempt_requested = [this]() { return as_->isPreemptRequested(); };
     moveit::planning_interface::MoveGroupInterface::Plan my_plan;
-    robot_state::RobotState kinematic_state(moveit_group_->getRobotModel());
-    const moveit::core::JointModelGroup* joint_model_group = kinematic_state.getJointModelGroup(moveit_group_->getName());
 
+    if (!prepareRequest(goal, request))
+    {
+        as_->setAborted();
+        return;
+    }
+
+    /// Re-use a plan precomputed by the plan-only server or a cached plan if we have planned a similar request before
+    tue::manipulation::PlanCacheKey cache_key;
+    getPlanCacheKey(request, cache_key);
+
+    bool cache_hit = false;
+    bool from_plan_cache = false;
+    if (getCachedPlan(precomputed_plans_, request, cache_key, my_plan))
+    {
+        ROS_INFO("Using precomputed plan");
+        precomputed_plans_.remove(cache_key);
+        cache_hit = true;
+    }
+    else if (!plan_cache_file_.empty() && getCachedPlan(plan_cache_, request, cache_key, my_plan))
+    {
+        ROS_INFO("Using cached plan");
+        cache_hit = true;
+        from_plan_cache = true;
+    }
+    request.from_cache = cache_hit;
+
+    /// Try to determine a trajectory
+    bool preempted = false;
+    bool grasp_feasible = cache_hit || findPlan(request, main_context_, my_plan, preempted);
+
+    if (preempted)
+    {
+        ROS_INFO("Goal cancelled");
+        as_->setPreempted(tue_manipulation_msgs::GraspPrecomputeResult(),
+                          reportRequest(request, "grasp_precompute", "preempted", diagnostic_msgs::DiagnosticStatus::OK));
+        return;
+    }
+
+    if (!grasp_feasible)
+    {
+        ROS_WARN("Sampling boundaries reached. No feasible sample found\n");
+        as_->setAborted(tue_manipulation_msgs::GraspPrecomputeResult(),
+                        reportRequest(request, "grasp_precompute", "no plan found",
+                                      diagnostic_msgs::DiagnosticStatus::WARN)); // ToDo: set failed
+        return;
+    }
+
+    double latency = secondsSince(request.t_start);
+    plan_latency_.add(latency);
+    ROS_INFO("Found plan in %f seconds (%s)", latency, plan_latency_.summary().c_str());
+
+    /// Double check the joint limits: MoveIt might provide trajectories that are just outside the bounds. Repair
+    /// the trajectory locally instead of clamping, which would introduce velocity discontinuities.
+    trajectory_msgs::JointTrajectory& trajectory = my_plan.trajectory_.joint_trajectory;
+
+    tue::manipulation::JointLimitTable limit_table;
+    limit_table.resize(trajectory.joint_names.size());
+    for (unsigned int i = 0; i < trajectory.joint_names.size(); ++i)
+    {
+        std::map<std::string, limits>::const_iterator it = joint_limits_.find(trajectory.joint_names[i]);
+        if (it != joint_limits_.end())
+        {
+            limit_table.lower[i] = it->second.lower;
+            limit_table.upper[i] = it->second.upper;
+            limit_table.max_velocity[i] = it->second.max_velocity;
+            limit_table.max_acceleration[i] = it->second.max_acceleration;
+        }
+        else
+        {
+            limit_table.lower[i] = -std::numeric_limits<double>::infinity();
+            limit_table.upper[i] = std::numeric_limits<double>::infinity();
+            limit_table.max_velocity[i] = DEFAULT_MAX_VELOCITY;
+            limit_table.max_acceleration[i] = DEFAULT_MAX_ACCELERATION;
+        }
+    }
+
+    std::vector<double> times(trajectory.points.size());
+    std::vector<std::vector<double> > positions(trajectory.points.size());
+    std::vector<std::vector<double> > velocities(trajectory.points.size());
+    for (unsigned int i = 0; i < trajectory.points.size(); ++i)
+    {
+        times[i] = trajectory.points[i].time_from_start.toSec();
+        positions[i] = trajectory.points[i].positions;
+        velocities[i] = trajectory.points[i].velocities;
+    }
+
+    tue::manipulation::TrajectoryRepairStatistics repair_stats;
+    std::string repair_error;
+    if (!tue::manipulation::repairTrajectory(limit_table, times, positions, velocities, repair_stats, repair_error))
+    {
+        ROS_WARN("Could not repair trajectory: %s", repair_error.c_str());
+        as_->setAborted(tue_manipulation_msgs::GraspPrecomputeResult(),
+                        reportRequest(request, "grasp_precompute", "trajectory repair failed",
+                                      diagnostic_msgs::DiagnosticStatus::ERROR));
+        return;
+    }
+
+    if (repair_stats.repaired())
+    {
+        ROS_INFO("Repaired trajectory: %u position, %u velocity and %u acceleration violations, %u segments "
+                 "retimed, %f seconds added", repair_stats.num_position_violations,
+                 repair_stats.num_velocity_violations, repair_stats.num_acceleration_violations,
+                 repair_stats.num_retimed_segments, repair_stats.added_duration);
+
+        for (unsigned int i = 0; i < trajectory.points.size(); ++i)
+        {
+            trajectory_msgs::JointTrajectoryPoint& point = trajectory.points[i];
+            point.time_from_start = ros::Duration(times[i]);
+            point.positions = positions[i];
+            point.velocities = velocities[i];
+            point.accelerations.clear();
+        }
+    }
+
+    tue::manipulation::computeTrajectoryMetrics(times, positions, request.metrics);
+
+    /// Planning succeeded, so execute it!
+    ros::WallTime t_execute = ros::WallTime::now();
+    if (moveit_group_->execute(my_plan) == moveit_msgs::MoveItErrorCodes::SUCCESS)
+    {
+        grasp_feasible = true;
+    }
+    else
+    {
+        grasp_feasible = false;
+    }
+    request.times.execution = secondsSince(t_execute);
+
+    {
+        std::lock_guard<std::mutex> lock(last_motion_end_mutex_);
+        last_motion_end_ = ros::Time::now();
+    }
+
+    /// Remember executed plans, including precomputed ones, such that they survive a restart; forget cached plans
+    /// that could not be executed
+    if (!plan_cache_file_.empty() && grasp_feasible != from_plan_cache)
+    {
+        tue::manipulation::CachedPlan cached_plan;
+        if (!grasp_feasible)
+            plan_cache_.remove(cache_key);
+        else if (toCachedPlan(request, my_plan, cached_plan))
+            plan_cache_.put(cache_key, cached_plan);
+
+        std::string cache_error;
+        if (!plan_cache_.save(plan_cache_file_, plan_cache_context_, cache_error))
+            ROS_WARN("%s", cache_error.c_str());
+    }
+
+    if (grasp_feasible)
+    {
+        ROS_INFO("Arm motion succeeded");
+        as_->setSucceeded(tue_manipulation_msgs::GraspPrecomputeResult(),
+                          reportRequest(request, "grasp_precompute", "succeeded", diagnostic_msgs::DiagnosticStatus::OK));
+    } else {
+        ROS_INFO("Arm motion failed");
+        as_->setAborted(tue_manipulation_msgs::GraspPrecomputeResult(),
+                        reportRequest(request, "grasp_precompute", "execution failed",
+                                      diagnostic_msgs::DiagnosticStatus::ERROR)); // ToDo: set failed
+    }
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::planGoalCallback(PlanServer::GoalHandle gh)
+{
+    /// Claim a free planning context, or reject the goal if all are in use
+    unsigned int context_idx = 0;
+    {
+        std::lock_guard<std::mutex> lock(goal_contexts_mutex_);
+        while (context_idx < goal_context_busy_.size() && goal_context_busy_[context_idx])
+            ++context_idx;
+
+        if (context_idx == goal_context_busy_.size())
+        {
+            gh.setRejected(tue_manipulation_msgs::GraspPrecomputeResult(), "All planning contexts are busy");
+            return;
+        }
+
+        goal_context_busy_[context_idx] = true;
+    }
+
+    gh.setAccepted();
+    std::thread(&GraspPrecompute::planGoal, this, gh, context_idx).detach();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::planGoal(PlanServer::GoalHandle gh, unsigned int context_idx)
+{
+    GraspRequest request;
+    request.preempt_requested = [&gh]()
+    {
+        uint8_t status = gh.getGoalStatus().status;
+        return status == actionlib_msgs::GoalStatus::PREEMPTING || status == actionlib_msgs::GoalStatus::RECALLING;
+    };
+
+    MoveGroup::Plan plan;
+    bool preempted = false;
+    bool ok = prepareRequest(gh.getGoal(), request) && findPlan(request, goal_contexts_[context_idx], plan, preempted);
+
+    /// Release the planning context
+    {
+        std::lock_guard<std::mutex> lock(goal_contexts_mutex_);
+        goal_context_busy_[context_idx] = false;
+    }
+
+    /// Preempted anytime searches still provide the best plan found so far
+    if (preempted && !ok)
+    {
+        gh.setCanceled(tue_manipulation_msgs::GraspPrecomputeResult(),
+                       reportRequest(request, "grasp_precompute_plan", "preempted", diagnostic_msgs::DiagnosticStatus::OK));
+        return;
+    }
+
+    /// Keep the plan, such that the execution server re-uses it for the same request and start state
+    tue::manipulation::CachedPlan cached_plan;
+    if (!ok || !toCachedPlan(request, plan, cached_plan))
+    {
+        gh.setAborted(tue_manipulation_msgs::GraspPrecomputeResult(),
+                      reportRequest(request, "grasp_precompute_plan", "no plan found",
+                                    diagnostic_msgs::DiagnosticStatus::WARN));
+        return;
+    }
+
+    tue::manipulation::PlanCacheKey cache_key;
+    getPlanCacheKey(request, cache_key);
+    precomputed_plans_.put(cache_key, cached_plan);
+
+    tue::manipulation::computeTrajectoryMetrics(cached_plan.times, cached_plan.positions, request.metrics);
+    gh.setSucceeded(tue_manipulation_msgs::GraspPrecomputeResult(),
+                    reportRequest(request, "grasp_precompute_plan", "succeeded", diagnostic_msgs::DiagnosticStatus::OK));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::prepareRequest(const tue_manipulation_msgs::GraspPrecomputeGoalConstPtr& goal, GraspRequest& request)
+{
+    unsigned int pre_grasp_inbetween_sampling_steps = 20; // Hardcoded, we might not need this... //PRE_GRASP_INBETWEEN_SAMPLING_STEPS
+
+    if (candidate_time_budget_ > 0)
+        request.deadline = ros::WallTime::now() + ros::WallDuration(candidate_time_budget_);
+
+    if (anytime_budget_ > 0)
+    {
+        ros::WallTime anytime_deadline = request.t_start + ros::WallDuration(anytime_budget_);
+        if (request.deadline.isZero() || anytime_deadline < request.deadline)
+            request.deadline = anytime_deadline;
+        request.anytime = true;
+    }
+
+    /// Determine the requested grasp pose
+    if (!getGraspPose(goal, request.grasp_pose))
+        return false;
+
+    /// Check if a pre-grasp is required
+    if (goal->PERFORM_PRE_GRASP)
+    {
+        request.num_grasp_points = pre_grasp_inbetween_sampling_steps + 2; // Inbetween sample points + Pre-grasp + Grasp point
+    }
+
+    request.first_joint_pos_only = goal->FIRST_JOINT_POS_ONLY;
+
+    /// Acquire the start state: the latest joint states, received after our previous motion ended
+    ros::Time last_motion_end;
+    {
+        std::lock_guard<std::mutex> lock(last_motion_end_mutex_);
+        last_motion_end = last_motion_end_;
+    }
+
+    if (!waitForStartState(last_motion_end, start_state_timeout_, request.start_state))
+    {
+        ROS_WARN("No joint states received since the last motion, using the current state of MoveIt");
+        robot_state::RobotStatePtr current_state = moveit_group_->getCurrentState();
+        if (!current_state)
+        {
+            ROS_ERROR("Could not get the current robot state");
+            return false;
+        }
+        moveit::core::robotStateToRobotStateMsg(*current_state, request.start_state);
+    }
+
+    request.start_robot_state.reset(new robot_state::RobotState(moveit_group_->getRobotModel()));
+    request.start_robot_state->setToDefaultValues();
+    moveit::core::robotStateMsgToRobotState(request.start_state, *request.start_robot_state);
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string GraspPrecompute::reportRequest(const GraspRequest& request, const std::string& server,
+                                           const std::string& outcome, unsigned char level)
+{
+    const StageTimes& t = request.times;
+    const tue::manipulation::TrajectoryMetrics& m = request.metrics;
+
+    std::stringstream report;
+    if (request.from_cache)
+        report << "cached plan";
+    else
+        report << request.num_candidates << " candidates, " << request.num_pruned << " pruned by IK, "
+               << request.num_planned << " planned, " << request.num_plans << " feasible";
+    report << "; ik " << t.ik << " s, planning " << t.planning << " s, cartesian path " << t.cartesian_path
+           << " s, time parameterization " << t.time_parameterization << " s, execution " << t.execution << " s"
+           << "; path length " << m.path_length << " rad, duration " << m.duration << " s, rms jerk " << m.rms_jerk
+           << " rad/s^3";
+    ROS_INFO("Grasp request %s: %s", outcome.c_str(), report.str().c_str());
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = server;
+    status.hardware_id = moveit_group_->getName();
+    status.level = level;
+    status.message = outcome;
+    addDiagnosticValue(status, "candidates", request.num_candidates);
+    addDiagnosticValue(status, "pruned_by_ik", request.num_pruned);
+    addDiagnosticValue(status, "planned", request.num_planned);
+    addDiagnosticValue(status, "feasible", request.num_plans);
+    addDiagnosticValue(status, "from_cache", request.from_cache);
+    addDiagnosticValue(status, "total_time", secondsSince(request.t_start));
+    addDiagnosticValue(status, "ik_time", t.ik);
+    addDiagnosticValue(status, "planning_time", t.planning);
+    addDiagnosticValue(status, "cartesian_path_time", t.cartesian_path);
+    addDiagnosticValue(status, "time_parameterization_time", t.time_parameterization);
+    addDiagnosticValue(status, "execution_time", t.execution);
+    addDiagnosticValue(status, "path_length", m.path_length);
+    addDiagnosticValue(status, "duration", m.duration);
+    addDiagnosticValue(status, "rms_jerk", m.rms_jerk);
+
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    msg.status.push_back(status);
+    pub_metrics_.publish(msg);
+
+    return report.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::findPlan(GraspRequest& request, PlanningContext& context, MoveGroup::Plan& plan, bool& preempted)
+{
+    ROS_INFO("Starting sampling...");
+
+    // The planning contexts serve the execution server only; plan-only goals search on their own context
+    if (planning_contexts_.empty() || &context != &main_context_)
+        return findPlanSequential(request, context, plan, preempted);
+    else
+        return findPlanParallel(request, plan, preempted);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+double GraspPrecompute::planCost(const GraspCandidate& candidate, const MoveGroup::Plan& plan) const
+{
+    const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = plan.trajectory_.joint_trajectory.points;
+    if (!anytime_minimize_duration_ || points.empty())
+        return candidate.cost;
+
+    return points.back().time_from_start.toSec();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::getGraspPose(const tue_manipulation_msgs::GraspPrecomputeGoalConstPtr& goal, tf::Transform& grasp_pose)
+{
     /// Check for absolute or delta (and ambiqious goals)
     bool absolute_requested=false, delta_requested=false;
     if(fabs(goal->goal.x)>EPS || fabs(goal->goal.y)>EPS || fabs(goal->goal.z)>EPS || fabs(goal->goal.roll)>EPS || fabs(goal->goal.pitch)>EPS || fabs(goal->goal.yaw)>EPS)
@@ -118,9 +702,8 @@ void GraspPrecompute::execute(const tue_manipulation_msgs::GraspPrecomputeGoalCo
         delta_requested = true;
     if(absolute_requested && delta_requested)
     {
-        as_->setAborted();
         ROS_WARN("grasp_precompute_action: goal consists out of both absolute AND delta values. Choose only one!");
-        return;
+        return false;
     }
 
     /// Create input variable which we will work with
@@ -147,15 +730,13 @@ void GraspPrecompute::execute(const tue_manipulation_msgs::GraspPrecomputeGoalCo
             }
             catch (tf::TransformException ex)
             {
-                as_->setAborted();
                 ROS_ERROR("%s",ex.what());
-                return;
+                return false;
             }
         } else
         {
-            as_->setAborted();
             ROS_ERROR("grasp_precompute_action: listener__ could not find transform from gripper to %s:",goal->delta.header.frame_id.c_str());
-            return;
+            return false;
         }
 
         // Print the transform
@@ -173,220 +754,760 @@ void GraspPrecompute::execute(const tue_manipulation_msgs::GraspPrecomputeGoalCo
         stamped_in.pose.orientation = tf::createQuaternionMsgFromRollPitchYaw(roll + goal->delta.roll, pitch + goal->delta.pitch, yaw + goal->delta.yaw);
     }
 
-    /// Check if a pre-grasp is required
-    if (goal->PERFORM_PRE_GRASP)
+    tf::poseMsgToTF(stamped_in.pose, grasp_pose);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::generateCandidates(const GraspRequest& request, std::vector<GraspCandidate>& candidates) const
+{
+    std::vector<tue::manipulation::ScoredGraspPose> grasp_poses;
+    candidate_generator_.generate(request.grasp_pose, grasp_poses);
+
+    if (max_candidates_ > 0 && grasp_poses.size() > (unsigned int)max_candidates_)
+        grasp_poses.resize(max_candidates_);
+
+    candidates.resize(grasp_poses.size());
+    for (unsigned int i = 0; i < grasp_poses.size(); ++i)
+        createCandidate(grasp_poses[i], request.num_grasp_points, candidates[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::createCandidate(const tue::manipulation::ScoredGraspPose& grasp_pose, unsigned int num_grasp_points,
+                                      GraspCandidate& candidate) const
+{
+    unsigned int pre_grasp_inbetween_sampling_steps = num_grasp_points > 1 ? num_grasp_points - 2 : 0;
+
+    candidate.offset = grasp_pose.offset;
+    candidate.cost = grasp_pose.cost;
+
+    // Define new_grasp_pose
+    const tf::Transform& new_grasp_pose = grasp_pose.pose;
+
+    candidate.waypoints.resize(num_grasp_points);
+    for (int i = num_grasp_points - 1; i >= 0; --i) {
+
+        tf::Transform pre_grasp_offset(tf::Quaternion(0,0,0,1),tf::Point(-pre_grasp_delta_*i/(pre_grasp_inbetween_sampling_steps+1.0),0,0));
+        tf::Transform new_pre_grasp_pose = new_grasp_pose * pre_grasp_offset;
+
+        tf::poseTFToMsg(new_pre_grasp_pose, candidate.waypoints[i]);
+
+    }
+
+    /// Test: put the first point 5 cm higher
+    if (candidate.waypoints.size() > 1)
     {
-        num_grasp_points = pre_grasp_inbetween_sampling_steps + 2; // Inbetween sample points + Pre-grasp + Grasp point
+        candidate.waypoints[num_grasp_points-1].position.z += 0.05;
     }
+}
 
-    /// Evaluate if grasp is feasible
-    tf::Transform grasp_pose;
-    tf::poseMsgToTF(stamped_in.pose,grasp_pose);
+////////////////////////////////////////////////////////////////////////////////
 
-    tf::Transform new_grasp_pose;
-    tf::Transform new_pre_grasp_pose;
+bool GraspPrecompute::checkIK(const robot_state::RobotState& start_state, GraspCandidate& candidate) const
+{
+    robot_state::RobotState state(start_state);
+    const moveit::core::JointModelGroup* joint_model_group = state.getJointModelGroup(moveit_group_->getName());
 
-    bool grasp_feasible = false;
-    bool sampling_boundaries_reached = false;
-    double yaw_delta = 0.0;
-    int yaw_sampling_direction = 1;
+    candidate.ik_solution.clear();
+    if (!state.setFromIK(joint_model_group, candidate.waypoints.back(), ik_attempts_, ik_timeout_))
+        return false;
 
-    ROS_INFO("Starting sampling...");
+    state.copyJointGroupPositions(joint_model_group, candidate.ik_solution);
+    return true;
+}
 
-    /// Try to determine a trajectory
-    while(ros::ok() && !grasp_feasible && !sampling_boundaries_reached )
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::planCandidate(PlanningContext& context, const GraspCandidate& candidate, bool first_joint_pos_only,
+                                    MoveGroup::Plan& plan, StageTimes& times)
+{
+    MoveGroup& group = *context.group;
+
+    const std::vector<geometry_msgs::Pose>& waypoints = candidate.waypoints;
+    unsigned int num_grasp_points = waypoints.size();
+
+    /// Compute a plan to the first waypoint. Candidates only get here with the IK solution of the pre-check, which
+    /// is used as a joint-space goal: that is much faster to plan for than a pose goal.
+    group.setJointValueTarget(candidate.ik_solution);
+    ros::WallTime t_plan = ros::WallTime::now();
+    bool planned = (group.plan(plan) == moveit_msgs::MoveItErrorCodes::SUCCESS);
+    times.planning += secondsSince(t_plan);
+    if (!planned)
+        return false;
+
+    if (num_grasp_points == 1)
+        return true;
+
+    /// If we have a pre-grasp vector, compute the rest of the path
+    if (context.cartesian_solver)
+        return interpolateApproach(*context.cartesian_solver, candidate, first_joint_pos_only, plan, times);
+    else
+        return computeApproachMoveIt(group, candidate, first_joint_pos_only, plan, times);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::interpolateApproach(tue::IKSolver& solver, const GraspCandidate& candidate,
+                                          bool first_joint_pos_only, MoveGroup::Plan& plan, StageTimes& times) const
+{
+    trajectory_msgs::JointTrajectory& trajectory = plan.trajectory_.joint_trajectory;
+    std::vector<double> q_plan_end = trajectory.points.back().positions;
+    ros::Duration t_plan_end = trajectory.points.back().time_from_start;
+
+    /// Map the joints of the chain onto the joints of the plan
+    const std::vector<std::string>& chain_joint_names = solver.jointNames();
+    std::vector<unsigned int> chain_to_plan(chain_joint_names.size());
+    KDL::JntArray q_start(chain_joint_names.size());
+    for (unsigned int i = 0; i < chain_joint_names.size(); ++i)
     {
+        std::vector<std::string>::const_iterator it = std::find(trajectory.joint_names.begin(),
+                                                                trajectory.joint_names.end(), chain_joint_names[i]);
+        if (it == trajectory.joint_names.end())
+        {
+            ROS_WARN("Joint '%s' is not part of the plan", chain_joint_names[i].c_str());
+            return false;
+        }
 
-        /// Check if a cancel has been requested
-        if (as_->isPreemptRequested()) {
-            ROS_INFO("Goal cancelled");
-            as_->setPreempted();
-            return;
+        chain_to_plan[i] = it - trajectory.joint_names.begin();
+        q_start(i) = q_plan_end[chain_to_plan[i]];
+    }
+
+    /// Interpolate the straight line to the grasp pose
+    KDL::Frame grasp_pose;
+    tf::poseMsgToKDL(candidate.waypoints[0], grasp_pose);
+
+    std::vector<KDL::JntArray> path;
+    ros::WallTime t_path = ros::WallTime::now();
+    double res = tue::manipulation::interpolateCartesianPath(solver, q_start, grasp_pose, CARTESIAN_TRANSLATION_STEP,
+                                                             CARTESIAN_ROTATION_STEP, cartesian_max_joint_jump_, path);
+    times.cartesian_path += secondsSince(t_path);
+
+    // Check if more than 90% of the trajectory has been computed
+    if (res <= 0.9 || path.size() < 2)
+        return false;
+
+    // If only the first joint position is to be executed (FIRST_JOINT_POS_ONLY is true), we are done
+    if (first_joint_pos_only)
+        return true;
+
+    /// Time-parameterize the approach against the joint limits
+    std::vector<std::vector<double> > waypoints(path.size(), q_plan_end);
+    for (unsigned int i = 0; i < path.size(); ++i)
+    {
+        for (unsigned int j = 0; j < chain_to_plan.size(); ++j)
+            waypoints[i][chain_to_plan[j]] = path[i](j);
+    }
+
+    std::vector<double> max_vel(trajectory.joint_names.size(), DEFAULT_MAX_VELOCITY);
+    std::vector<double> max_acc(trajectory.joint_names.size(), DEFAULT_MAX_ACCELERATION);
+    for (unsigned int i = 0; i < trajectory.joint_names.size(); ++i)
+    {
+        std::map<std::string, limits>::const_iterator it = joint_limits_.find(trajectory.joint_names[i]);
+        if (it != joint_limits_.end())
+        {
+            max_vel[i] = it->second.max_velocity;
+            max_acc[i] = it->second.max_acceleration;
         }
+    }
 
-        // Define new_grasp_pose
-        ROS_INFO("Computing new grasp pose...");
-        tf::Transform yaw_offset(tf::createQuaternionFromYaw(yaw_sampling_direction * yaw_delta),tf::Point(0,0,0));
-        new_grasp_pose = grasp_pose * yaw_offset;
+    tue::manipulation::TimeParameterizedPath timed_path;
+    std::string error;
+    ros::WallTime t_parameterize = ros::WallTime::now();
+    bool parameterized = tue::manipulation::parameterizeTimeOptimal(waypoints, max_vel, max_acc,
+                                                                    CARTESIAN_PATH_RESOLUTION, timed_path, error);
+    times.time_parameterization += secondsSince(t_parameterize);
+    if (!parameterized)
+    {
+        ROS_WARN("Failed to calculate velocities for cartesian path: %s", error.c_str());
+        return false;
+    }
 
-        ROS_INFO("Computing intermediate points...");
-        std::vector<geometry_msgs::Pose> waypoints(num_grasp_points);
-        for (int i = num_grasp_points - 1; i >= 0; --i) {
+    // Never hand a trajectory to the controllers that exceeds the joint limits
+    if (!tue::manipulation::checkLimits(timed_path, max_vel, max_acc, error))
+    {
+        ROS_WARN("Time-parameterized cartesian path exceeds the joint limits: %s", error.c_str());
+        return false;
+    }
 
-            //cout << i << " offset = " << -PRE_GRASP_DELTA*i/(PRE_GRASP_INBETWEEN_SAMPLING_STEPS+1.0) << endl;
-            tf::Transform pre_grasp_offset(tf::Quaternion(0,0,0,1),tf::Point(-pre_grasp_delta_*i/(pre_grasp_inbetween_sampling_steps+1.0),0,0));
-            new_pre_grasp_pose = new_grasp_pose * pre_grasp_offset;
+    /// Append the approach to the plan
+    for (unsigned int i = 1; i < timed_path.times.size(); ++i)
+    {
+        trajectory_msgs::JointTrajectoryPoint p;
+        p.positions = timed_path.positions[i];
+        p.velocities = timed_path.velocities[i];
+        p.time_from_start = t_plan_end + ros::Duration(timed_path.times[i]);
+        trajectory.points.push_back(p);
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
-            tf::poseTFToMsg(new_pre_grasp_pose, waypoints[i]);
+bool GraspPrecompute::computeApproachMoveIt(MoveGroup& group, const GraspCandidate& candidate,
+                                            bool first_joint_pos_only, MoveGroup::Plan& plan, StageTimes& times)
+{
+    const std::vector<geometry_msgs::Pose>& waypoints = candidate.waypoints;
+    unsigned int num_grasp_points = waypoints.size();
 
+    moveit_msgs::RobotState start_state;
+    start_state.joint_state.name = plan.trajectory_.joint_trajectory.joint_names;
+    unsigned int size = plan.trajectory_.joint_trajectory.points.size();
+    start_state.joint_state.position = plan.trajectory_.joint_trajectory.points[size-1].positions;
+    group.setStartState(start_state);
+
+    /*
+    Currently, we have two approaches to make sure we follow the approach vector.
+    * The 'Plan' approach, which simply calls group->plan, hence using an RRT. This seems to be fast
+      but there is no guarantee for a straight path in Cartesian space
+    * Explicitly computing a Cartesian path. Seems less robust (gives no results more often) but
+      will always result in a straight path
+    */
+
+    // 'computeCartesianPath' approach
+    std::vector<geometry_msgs::Pose> wps(2);
+    wps[0] = waypoints[num_grasp_points-1];
+    wps[1] = waypoints[0];
+    moveit_msgs::RobotTrajectory cartesian_moveit_trajectory;
+    ros::WallTime t_path = ros::WallTime::now();
+    double res = group.computeCartesianPath(wps, 0.01, 10.0, cartesian_moveit_trajectory, false);
+    times.cartesian_path += secondsSince(t_path);
+
+    // Check if more than 90% of the trajectory has been computed
+    if (res <= 0.9 || cartesian_moveit_trajectory.joint_trajectory.points.empty())
+        return false;
+
+    /// Interpolate to get velocities
+    // First to create a RobotTrajectory object
+    robot_trajectory::RobotTrajectory rt(group.getRobotModel(), group.getName());
+
+    // Second get a RobotTrajectory from trajectory
+    robot_state::RobotState rs(group.getRobotModel());
+    for (unsigned int i = 0; i < cartesian_moveit_trajectory.joint_trajectory.joint_names.size(); i++){
+        rs.setJointPositions(cartesian_moveit_trajectory.joint_trajectory.joint_names[i], &cartesian_moveit_trajectory.joint_trajectory.points[0].positions[i]);
+    }
+    rt.setRobotTrajectoryMsg(rs, cartesian_moveit_trajectory);
+
+    // Third create a IterativeParabolicTimeParameterization object
+    trajectory_processing::IterativeParabolicTimeParameterization iptp;
+
+    // Fourth compute computeTimeStamps
+    ros::WallTime t_parameterize = ros::WallTime::now();
+    bool parameterized = iptp.computeTimeStamps(rt);
+    times.time_parameterization += secondsSince(t_parameterize);
+    if (!parameterized){
+        ROS_WARN("Failed to calculate velocities for cartesian path.");
+        return false;
+    }
+
+    // If the entire trajectory is to be executed (FIRST_JOINT_POS_ONLY is false), append trajectory
+    if (!first_joint_pos_only)
+    {
+        rt.getRobotTrajectoryMsg(cartesian_moveit_trajectory);
+        const trajectory_msgs::JointTrajectory& approach = cartesian_moveit_trajectory.joint_trajectory;
+        for (unsigned int i = 1; i < approach.points.size(); i++)
+        {
+            trajectory_msgs::JointTrajectoryPoint p = approach.points[i];
+            p.time_from_start += plan.trajectory_.joint_trajectory.points[size-1].time_from_start;
+            plan.trajectory_.joint_trajectory.points.push_back(p);
         }
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::findPlanSequential(GraspRequest& request, PlanningContext& context, MoveGroup::Plan& plan,
+                                         bool& preempted)
+{
+    std::vector<GraspCandidate> candidates;
+    generateCandidates(request, candidates);
+
+    /// Candidates are ranked by their heuristic cost, so the first plan found is the best one, unless plans are
+    /// compared by their duration
+    bool minimize_duration = request.anytime && anytime_minimize_duration_;
+    bool found = false;
+    double best_cost = 0;
 
-        // ToDo: reverse vector for clarity???
-        
-        /// Test: put the first point 5 cm higher
-        if (waypoints.size() > 1)
+    for (std::vector<GraspCandidate>::iterator it = candidates.begin(); it != candidates.end() && ros::ok(); ++it)
+    {
+        /// Check if a cancel has been requested
+        if (request.preempt_requested()) {
+            preempted = true;
+            return found;
+        }
+
+        if (request.deadlinePassed())
         {
-            waypoints[num_grasp_points-1].position.z += 0.05;
+            if (!found)
+                ROS_WARN("Candidate time budget exceeded");
+            return found;
         }
 
+        ROS_INFO("Computing new grasp pose...");
+        GraspCandidate& candidate = *it;
+        ++request.num_candidates;
+
         /// Sanity check if it is feasible at all
-        bool found_ik = kinematic_state.setFromIK(joint_model_group, waypoints[num_grasp_points-1], 10, 0.1);
+        ros::WallTime t_ik = ros::WallTime::now();
+        bool found_ik = checkIK(*request.start_robot_state, candidate);
+        request.times.ik += secondsSince(t_ik);
         ROS_DEBUG("FOUND IK: %d",found_ik);
-        found_ik = true;
 
         if (found_ik)
         {
-            /// Compute a plan to the first waypoint
-            ros::Duration(0.1).sleep(); // Make sure the robot is at the robot state before setStartState is called
-            moveit_group_->setStartStateToCurrentState();
-            moveit_group_->setPoseTarget(waypoints[num_grasp_points-1]);
-            moveit_group_->setGoalPositionTolerance(0.01);
-            moveit_group_->setGoalOrientationTolerance(0.1);
-//          ROS_INFO("x: %f, y: %f, z: %f", waypoints[num_grasp_points-1].position.x, waypoints[num_grasp_points-1].position.y, waypoints[num_grasp_points-1].position.z);
-            if (moveit_group_->plan(my_plan) == moveit_msgs::MoveItErrorCodes::SUCCESS)
-            {
-                grasp_feasible = true;
-            }
-            else
+            ++request.num_planned;
+            context.group->setStartState(request.start_state);
+
+            MoveGroup::Plan candidate_plan;
+            if (planCandidate(context, candidate, request.first_joint_pos_only, candidate_plan, request.times))
             {
-                grasp_feasible = false;
+                ++request.num_plans;
+                double cost = planCost(candidate, candidate_plan);
+                ROS_INFO("Found plan for candidate with cost %f (plan cost %f)", candidate.cost, cost);
+                if (!found || cost < best_cost)
+                {
+                    plan = candidate_plan;
+                    request.plan_offset = candidate.offset;
+                    best_cost = cost;
+                    found = true;
+                }
+
+                if (!minimize_duration)
+                    return true;
             }
-//          ROS_INFO("Grasp feasible: %i", grasp_feasible);
         }
         else
         {
-            grasp_feasible = false;
+            ++request.num_pruned;
         }
 
-        /// If we have a pre-grasp vector, compute the rest of the path
-        if (num_grasp_points > 1 && grasp_feasible)
+        /// If grasp not feasible, try the next candidate
+        ROS_DEBUG("Not all grasp points feasible: resampling");
+    }
+
+    return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::findPlanParallel(GraspRequest& request, MoveGroup::Plan& plan, bool& preempted)
+{
+    /// Generate all candidates up front, ranked by their heuristic cost
+    std::vector<GraspCandidate> candidates;
+    generateCandidates(request, candidates);
+    if (candidates.empty())
+        return false;
+
+    /// Screen the candidates for IK feasibility of the pre-grasp pose in parallel
+    std::vector<char> ik_feasible(candidates.size(), 0);
+    {
+        unsigned int num_threads = std::min<unsigned int>(std::max(1u, std::thread::hardware_concurrency()), candidates.size());
+        std::vector<double> ik_times(num_threads, 0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < num_threads; ++t)
         {
-            moveit_msgs::RobotState start_state;
-            start_state.joint_state.name = my_plan.trajectory_.joint_trajectory.joint_names;
-            unsigned int size = my_plan.trajectory_.joint_trajectory.points.size();
-            start_state.joint_state.position = my_plan.trajectory_.joint_trajectory.points[size-1].positions;
-            moveit_group_->setStartState(start_state);
-
-            moveit::planning_interface::MoveGroupInterface::Plan my_second_plan;
-
-            /*
-            Currently, we have two approaches to make sure we follow the approach vector.
-            * The 'Plan' approach, which simply calls group->plan, hence using an RRT. This seems to be fast
-              but there is no guarantee for a straight path in Cartesian space
-            * Explicitly computing a Cartesian path. Seems less robust (gives no results more often) but
-              will always result in a straight path
-            */
-
-            // 'Plan' approach
-//            group->setPoseTarget(waypoints[0]);
-//            GRASP_FEASIBLE = group->plan(my_second_plan);
-
-            // Alternative: 'computeCartesianPath' approach
-            std::vector<geometry_msgs::Pose> wps(2);
-            wps[0] = waypoints[num_grasp_points-1];
-            wps[1] = waypoints[0];
-            moveit_msgs::RobotTrajectory cartesian_moveit_trajectory;
-            double res = moveit_group_->computeCartesianPath(wps, 0.01, 10.0, cartesian_moveit_trajectory, false);
-            // Check if more than 90% of the trajectory has been computed
-            if (res > 0.9)
+            threads.push_back(std::thread([&, t]()
             {
-                grasp_feasible = true;
-            } else{
-                grasp_feasible = false;
-            }
+                ros::WallTime t_ik = ros::WallTime::now();
+                for (unsigned int i = t; i < candidates.size() && !request.deadlinePassed(); i += num_threads)
+                    ik_feasible[i] = checkIK(*request.start_robot_state, candidates[i]);
+                ik_times[t] = secondsSince(t_ik);
+            }));
+        }
 
-            /// Interpolate to get velocities
-            // First to create a RobotTrajectory object
-            robot_trajectory::RobotTrajectory rt(moveit_group_->getCurrentState()->getRobotModel(), moveit_group_->getName());
+        for (unsigned int t = 0; t < threads.size(); ++t)
+        {
+            threads[t].join();
+            request.times.ik += ik_times[t];
+        }
+    }
 
-            // Second get a RobotTrajectory from trajectory
-            robot_state::RobotState rs(moveit_group_->getCurrentState()->getRobotModel());
-            for (unsigned int i = 0; i < cartesian_moveit_trajectory.joint_trajectory.joint_names.size(); i++){
-                rs.setJointPositions(cartesian_moveit_trajectory.joint_trajectory.joint_names[i], &cartesian_moveit_trajectory.joint_trajectory.points[0].positions[i]);
-            }
-            rt.setRobotTrajectoryMsg(rs, cartesian_moveit_trajectory);
+    std::shared_ptr<ParallelSearch> search(new ParallelSearch);
+    for (unsigned int i = 0; i < candidates.size(); ++i)
+    {
+        if (ik_feasible[i])
+            search->candidates.push_back(candidates[i]);
+    }
 
-            // Third create a IterativeParabolicTimeParameterization object
-            trajectory_processing::IterativeParabolicTimeParameterization iptp;
+    request.num_candidates = candidates.size();
+    request.num_pruned = candidates.size() - search->candidates.size();
 
-            // Fourth compute computeTimeStamps
-            if (!iptp.computeTimeStamps(rt)){
-                ROS_WARN("Failed to calculate velocities for cartesian path.");
-                grasp_feasible = false;
-            }
+    if (search->candidates.empty())
+        return false;
 
-            // If still feasible and the entire trajectory is to be executed (FIRST_JOINT_POS_ONLY is false), append trajectory
-            // ToDo: make nice!
-            if (grasp_feasible && !goal->FIRST_JOINT_POS_ONLY)
-            {
-                rt.getRobotTrajectoryMsg(cartesian_moveit_trajectory);
-                my_second_plan.trajectory_ = cartesian_moveit_trajectory;
-                for (unsigned int i = 1; i < my_second_plan.trajectory_.joint_trajectory.points.size(); i++)
-                {
-                    my_second_plan.trajectory_.joint_trajectory.points[i].time_from_start += my_plan.trajectory_.joint_trajectory.points[size-1].time_from_start;
-                    my_plan.trajectory_.joint_trajectory.points.push_back(my_second_plan.trajectory_.joint_trajectory.points[i]);
-                }
-            }
+    search->status.resize(search->candidates.size(), ParallelSearch::PENDING);
+    search->plans.resize(search->candidates.size());
+    search->first_joint_pos_only = request.first_joint_pos_only;
+    search->start_state = request.start_state;
+
+    /// Plan the candidates concurrently. Contexts that are still finishing an abandoned plan of a previous
+    /// search join as soon as they are free.
+    for (unsigned int i = 0; i < planning_contexts_.size(); ++i)
+        std::thread(&GraspPrecompute::planWorker, this, search, i).detach();
+
+    /// Wait until the best remaining candidate has succeeded or all candidates have finished. Anytime searches
+    /// that compare plans by their duration wait for all candidates.
+    bool minimize_duration = request.anytime && anytime_minimize_duration_;
+    bool budget_exceeded = false;
+    int selected = -1;
+
+    std::unique_lock<std::mutex> lock(search->mutex);
+    while (true)
+    {
+        request.num_planned = search->next_candidate;
+
+        unsigned int best = 0;
+        while (best < search->status.size() && (search->status[best] == ParallelSearch::FAILED
+                                                || (minimize_duration && search->status[best] == ParallelSearch::SUCCEEDED)))
+            ++best;
+
+        if (best == search->status.size())
+            break;
+
+        if (search->status[best] == ParallelSearch::SUCCEEDED)
+        {
+            selected = best;
+            break;
         }
 
-        /// If grasp not feasible, resample yaw
-        if (!grasp_feasible)
+        if (request.preempt_requested())
         {
-            ROS_DEBUG("Not all grasp points feasible: resampling yaw");
-            if (yaw_sampling_direction > 0)
-            {
-                yaw_delta = yaw_delta + yaw_sampling_step_;
-            }
-            yaw_sampling_direction = -1 * yaw_sampling_direction;
+            preempted = true;
+            break;
+        }
 
-            if(yaw_delta > max_yaw_)
-            {
-                ROS_WARN("Sampling boundaries reached. No feasible sample found\n");
-                sampling_boundaries_reached = true;
-                as_->setAborted(); // ToDo: set failed
+        if (request.deadlinePassed())
+        {
+            if (!request.anytime)
+                ROS_WARN("Candidate time budget exceeded");
+            budget_exceeded = true;
+            break;
+        }
+
+        if (!ros::ok())
+            break;
+
+        search->cond.wait_for(lock, std::chrono::milliseconds(100));
+    }
+
+    /// Anytime searches return the best plan found so far, even if better ranked candidates are still running.
+    /// Other searches that ran out of time return the best ranked plan found so far, like the sequential search
+    /// returns the first feasible plan.
+    double selected_cost = 0;
+    for (unsigned int i = 0; i < search->status.size(); ++i)
+    {
+        if (search->status[i] != ParallelSearch::SUCCEEDED)
+            continue;
+
+        ++request.num_plans;
+        double cost = planCost(search->candidates[i], search->plans[i]);
+        if (request.anytime && (selected < 0 || cost < selected_cost))
+        {
+            selected = i;
+            selected_cost = cost;
+        }
+        else if (!request.anytime && budget_exceeded && selected < 0)
+        {
+            selected = i;
+        }
+    }
+
+    request.times.add(search->times);
+    search->stop = true;
+
+    if (selected < 0)
+    {
+        if (request.anytime && request.deadlinePassed())
+            ROS_WARN("Candidate time budget exceeded");
+        return false;
+    }
+
+    ROS_INFO("Found plan for candidate with cost %f (plan cost %f)", search->candidates[selected].cost,
+             planCost(search->candidates[selected], search->plans[selected]));
+    plan = search->plans[selected];
+    request.plan_offset = search->candidates[selected].offset;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::planWorker(std::shared_ptr<ParallelSearch> search, unsigned int context_idx)
+{
+    /// Claim the planning context
+    {
+        std::unique_lock<std::mutex> lock(planning_contexts_mutex_);
+        while (planning_context_busy_[context_idx])
+        {
+            if (search->stop)
                 return;
+            planning_contexts_cond_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        planning_context_busy_[context_idx] = true;
+    }
 
-            }
+    PlanningContext& context = planning_contexts_[context_idx];
+
+    while (true)
+    {
+        unsigned int idx;
+        {
+            std::lock_guard<std::mutex> lock(search->mutex);
+            if (search->stop || search->next_candidate >= search->candidates.size())
+                break;
+
+            idx = search->next_candidate++;
+            search->status[idx] = ParallelSearch::RUNNING;
+        }
+
+        context.group->setStartState(search->start_state);
+
+        MoveGroup::Plan candidate_plan;
+        StageTimes times;
+        bool ok = planCandidate(context, search->candidates[idx], search->first_joint_pos_only, candidate_plan, times);
+
+        {
+            std::lock_guard<std::mutex> lock(search->mutex);
+            search->times.add(times);
+            search->status[idx] = ok ? ParallelSearch::SUCCEEDED : ParallelSearch::FAILED;
+            if (ok)
+                search->plans[idx] = candidate_plan;
         }
+        search->cond.notify_all();
+    }
+
+    /// Release the planning context
+    {
+        std::lock_guard<std::mutex> lock(planning_contexts_mutex_);
+        planning_context_busy_[context_idx] = false;
     }
+    planning_contexts_cond_.notify_all();
+}
 
-    // ToDo: make nice
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::jointStateCallback(const sensor_msgs::JointState::ConstPtr& msg)
+{
+    // Some drivers do not stamp their joint states
+    ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
 
-    /// Double check joint limits (MoveIt might provide trajectories that are just outside the bounds
-    // Loop over all joints
-    for (unsigned int i = 0; i < my_plan.trajectory_.joint_trajectory.joint_names.size(); i++)
     {
-        std::string joint_name = my_plan.trajectory_.joint_trajectory.joint_names[i];
-        limits climits = joint_limits_[joint_name];
+        std::lock_guard<std::mutex> lock(joint_states_mutex_);
+        for (unsigned int i = 0; i < msg->name.size() && i < msg->position.size(); ++i)
+        {
+            // Only keep the joints of the robot model
+            std::map<std::string, JointStateEntry>::iterator it = joint_states_.find(msg->name[i]);
+            if (it == joint_states_.end())
+                continue;
+
+            it->second.position = msg->position[i];
+            it->second.stamp = stamp;
+        }
+    }
+
+    joint_states_cond_.notify_all();
+}
 
-        // Loop over all trajectory points
-        for (unsigned int j = 0; j < my_plan.trajectory_.joint_trajectory.points.size(); j++)
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::waitForStartState(const ros::Time& newer_than, double timeout, moveit_msgs::RobotState& start_state)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+
+    std::unique_lock<std::mutex> lock(joint_states_mutex_);
+    while (true)
+    {
+        bool up_to_date = true;
+        for (std::vector<std::string>::const_iterator it = group_joint_names_.begin(); it != group_joint_names_.end() && up_to_date; ++it)
         {
-            my_plan.trajectory_.joint_trajectory.points[j].positions[i] = std::min(std::max(climits.lower,
-                                                                                  my_plan.trajectory_.joint_trajectory.points[j].positions[i]),
-                                                                         climits.upper);
+            std::map<std::string, JointStateEntry>::const_iterator it_state = joint_states_.find(*it);
+            up_to_date = (it_state != joint_states_.end() && !it_state->second.stamp.isZero()
+                          && it_state->second.stamp >= newer_than);
         }
+
+        if (up_to_date)
+            break;
+
+        if (joint_states_cond_.wait_until(lock, deadline) == std::cv_status::timeout)
+            return false;
     }
 
-    /// Planning succeeded, so execute it!
-    if (moveit_group_->execute(my_plan) == moveit_msgs::MoveItErrorCodes::SUCCESS)
+    /// Only specify the joints we received; MoveIt fills in the rest from its planning scene
+    start_state = moveit_msgs::RobotState();
+    start_state.is_diff = true;
+    for (std::map<std::string, JointStateEntry>::const_iterator it = joint_states_.begin(); it != joint_states_.end(); ++it)
     {
-        grasp_feasible = true;
+        if (it->second.stamp.isZero())
+            continue;
+
+        start_state.joint_state.name.push_back(it->first);
+        start_state.joint_state.position.push_back(it->second.position);
     }
-    else
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void GraspPrecompute::getPlanCacheKey(const GraspRequest& request, tue::manipulation::PlanCacheKey& key) const
+{
+    key.clear();
+
+    /// Options
+    key.push_back(request.num_grasp_points > 1 ? 1 : 0);
+    key.push_back(request.first_joint_pos_only ? 1 : 0);
+
+    /// Grasp pose in the root frame. Both q and -q represent the same orientation, so pick the one with w >= 0.
+    const tf::Vector3& p = request.grasp_pose.getOrigin();
+    tf::Quaternion q = request.grasp_pose.getRotation();
+    if (q.getW() < 0)
+        q = tf::Quaternion(-q.getX(), -q.getY(), -q.getZ(), -q.getW());
+
+    std::vector<double> position(3), orientation(4);
+    for (unsigned int i = 0; i < 3; ++i)
+        position[i] = p[i];
+    orientation[0] = q.getX(); orientation[1] = q.getY(); orientation[2] = q.getZ(); orientation[3] = q.getW();
+
+    tue::manipulation::appendToKey(position, plan_cache_position_resolution_, key);
+    tue::manipulation::appendToKey(orientation, plan_cache_orientation_resolution_, key);
+
+    /// Start configuration of the group
+    std::vector<double> start_configuration;
+    for (std::vector<std::string>::const_iterator it = group_joint_names_.begin(); it != group_joint_names_.end(); ++it)
+        start_configuration.push_back(request.start_robot_state->getVariablePosition(*it));
+
+    tue::manipulation::appendToKey(start_configuration, plan_cache_joint_resolution_, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::getCachedPlan(tue::manipulation::PlanCache& cache, const GraspRequest& request,
+                                    const tue::manipulation::PlanCacheKey& key, MoveGroup::Plan& plan)
+{
+    tue::manipulation::CachedPlan cached_plan;
+    if (!cache.get(key, cached_plan))
+        return false;
+
+    std::string reason;
+    const std::vector<std::string>& joint_names = cached_plan.joint_names;
+    const robot_state::RobotState& start_state = *request.start_robot_state;
+
+    /// Check the joint limits and start configuration
+    for (unsigned int i = 0; i < joint_names.size() && reason.empty(); ++i)
     {
-        grasp_feasible = false;
+        std::map<std::string, limits>::const_iterator it = joint_limits_.find(joint_names[i]);
+        if (it == joint_limits_.end())
+        {
+            reason = "unknown joint '" + joint_names[i] + "'";
+            break;
+        }
+
+        for (unsigned int j = 0; j < cached_plan.positions.size() && reason.empty(); ++j)
+        {
+            double q = cached_plan.positions[j][i];
+            if (q < it->second.lower || q > it->second.upper)
+                reason = "joint '" + joint_names[i] + "' exceeds its limits";
+        }
+
+        if (reason.empty() && !cached_plan.positions.empty())
+        {
+            double start_error = cached_plan.positions[0][i] - start_state.getVariablePosition(joint_names[i]);
+            if (std::abs(start_error) > plan_cache_joint_resolution_)
+                reason = "joint '" + joint_names[i] + "' does not start at the current position";
+        }
     }
 
-    if (grasp_feasible)
+    if (cached_plan.positions.empty() || cached_plan.tag.size() != 4)
+        reason = "invalid plan";
+
+    /// Check that the end of the plan reaches the grasp (or pre-grasp) pose of the current request
+    if (reason.empty())
     {
-        ROS_INFO("Arm motion succeeded");
-        as_->setSucceeded();
-    } else {
-        ROS_INFO("Arm motion failed");
-        as_->setAborted(); // ToDo: set failed
+        GraspCandidate candidate;
+        tue::manipulation::ScoredGraspPose grasp_pose;
+        grasp_pose.offset = tf::Quaternion(cached_plan.tag[0], cached_plan.tag[1], cached_plan.tag[2], cached_plan.tag[3]);
+        grasp_pose.pose = request.grasp_pose * tf::Transform(grasp_pose.offset, tf::Vector3(0, 0, 0));
+        grasp_pose.cost = 0;
+        createCandidate(grasp_pose, request.num_grasp_points, candidate);
+
+        const geometry_msgs::Pose& expected = request.first_joint_pos_only ? candidate.waypoints.back()
+                                                                           : candidate.waypoints.front();
+
+        robot_state::RobotState end_state(start_state);
+        for (unsigned int i = 0; i < joint_names.size(); ++i)
+            end_state.setVariablePosition(joint_names[i], cached_plan.positions.back()[i]);
+        end_state.update();
+
+        auto tip_pose = end_state.getGlobalLinkTransform(root_link_).inverse()
+                * end_state.getGlobalLinkTransform(tip_link_);
+        Eigen::Vector3d expected_position(expected.position.x, expected.position.y, expected.position.z);
+        Eigen::Quaterniond expected_orientation(expected.orientation.w, expected.orientation.x,
+                                               expected.orientation.y, expected.orientation.z);
+
+        double position_error = (tip_pose.translation() - expected_position).norm();
+        double orientation_error = Eigen::Quaterniond(tip_pose.rotation()).angularDistance(expected_orientation);
+        if (position_error > PLAN_CACHE_POSITION_TOLERANCE + plan_cache_position_resolution_)
+            reason = "end position does not match the grasp pose";
+        else if (orientation_error > PLAN_CACHE_ORIENTATION_TOLERANCE + 2 * plan_cache_orientation_resolution_)
+            reason = "end orientation does not match the grasp pose";
+    }
+
+    if (!reason.empty())
+    {
+        ROS_INFO("Discarding cached plan: %s", reason.c_str());
+        cache.remove(key);
+        return false;
+    }
+
+    /// Convert to a MoveIt plan
+    plan = MoveGroup::Plan();
+    plan.start_state_ = request.start_state;
+    trajectory_msgs::JointTrajectory& trajectory = plan.trajectory_.joint_trajectory;
+    trajectory.joint_names = joint_names;
+    trajectory.points.resize(cached_plan.times.size());
+    for (unsigned int i = 0; i < cached_plan.times.size(); ++i)
+    {
+        trajectory.points[i].positions = cached_plan.positions[i];
+        trajectory.points[i].velocities = cached_plan.velocities[i];
+        trajectory.points[i].time_from_start = ros::Duration(cached_plan.times[i]);
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool GraspPrecompute::toCachedPlan(const GraspRequest& request, const MoveGroup::Plan& plan,
+                                   tue::manipulation::CachedPlan& cached_plan) const
+{
+    const trajectory_msgs::JointTrajectory& trajectory = plan.trajectory_.joint_trajectory;
+    unsigned int num_joints = trajectory.joint_names.size();
+
+    cached_plan = tue::manipulation::CachedPlan();
+    cached_plan.tag.resize(4);
+    cached_plan.tag[0] = request.plan_offset.getX();
+    cached_plan.tag[1] = request.plan_offset.getY();
+    cached_plan.tag[2] = request.plan_offset.getZ();
+    cached_plan.tag[3] = request.plan_offset.getW();
+    cached_plan.joint_names = trajectory.joint_names;
+
+    for (unsigned int i = 0; i < trajectory.points.size(); ++i)
+    {
+        const trajectory_msgs::JointTrajectoryPoint& p = trajectory.points[i];
+        if (p.positions.size() != num_joints)
+            return false;
+
+        cached_plan.times.push_back(p.time_from_start.toSec());
+        cached_plan.positions.push_back(p.positions);
+        cached_plan.velocities.push_back(p.velocities.size() == num_joints ? p.velocities
+                                                                           : std::vector<double>(num_joints, 0));
     }
 
+    return !cached_plan.times.empty();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -4,44 +4,105 @@
 #include <tue_manipulation_msgs/GripperCommandAction.h>
 //#include <tue_msgs/GripperMeasurement.h>
 
+#include <tue/manipulation/latency_histogram.h>
+
+#include <condition_variable>
+#include <mutex>
+
 //std::string gripper_measurement_topic_;
 
 actionlib::SimpleActionServer<tue_manipulation_msgs::GripperCommandAction>* as_;
 
 ros::Publisher gripper_pub_;
+ros::Subscriber gripper_sub_;
 
 tue_msgs::GripperCommand gripper_command_;
-tue_msgs::GripperMeasurement gripper_meas_;
 
+// Handoff from the measurement callback to executeCB, which waits on meas_cv_ instead of polling. The action
+// server is never called with meas_mutex_ locked, since the action server calls preemptCb with its own lock held.
+std::mutex meas_mutex_;
+std::condition_variable meas_cv_;
+tue_msgs::GripperMeasurement gripper_meas_;
+ros::Time gripper_meas_received_;
 bool new_measurement_available = false;
+bool preempt_requested = false;
+
+// Time from the measurement that completed a goal to the completion of the goal, only used by executeCB
+tue::manipulation::LatencyHistogram completion_latency_;
 
 
 void gripperMeasurementCb(const tue_msgs::GripperMeasurementConstPtr& meas) {
-    if (as_->isActive()) {
-        gripper_meas_ = *meas;
-        new_measurement_available = true;
-    }
+    std::lock_guard<std::mutex> lock(meas_mutex_);
+    gripper_meas_ = *meas;
+    gripper_meas_received_ = ros::Time::now();
+    new_measurement_available = true;
+    meas_cv_.notify_all();
+}
+
+void preemptCb() {
+    std::lock_guard<std::mutex> lock(meas_mutex_);
+    preempt_requested = true;
+    meas_cv_.notify_all();
+}
+
+void setSucceeded(const tue_msgs::GripperMeasurement& meas, const ros::Time& received, const std::string& text) {
+    tue_manipulation_msgs::GripperCommandResult result;
+    result.measurement = meas;
+    as_->setSucceeded(result, text);
+
+    // Measurements without a stamp count from their arrival
+    ros::Time stamp = meas.header.stamp.isZero() ? received : meas.header.stamp;
+    double latency = (ros::Time::now() - stamp).toSec();
+    completion_latency_.add(latency);
+    ROS_INFO("Gripper goal completed %.1f ms after the measurement (%s)", latency * 1000,
+             completion_latency_.summary().c_str());
 }
 
 void executeCB(const tue_manipulation_msgs::GripperCommandGoalConstPtr& gripper_goal) {
     ros::NodeHandle n;
 
-    //std::stringstream meas_topic;
-    //meas_topic << "/arm_" << side_ << "_controller/gripper_measurement";
-    ros::Subscriber gripper_sub = n.subscribe("measurements", 1, &gripperMeasurementCb);
+    // Only measurements that arrive after the command, and were taken after it, count
+    {
+        std::lock_guard<std::mutex> lock(meas_mutex_);
+        new_measurement_available = false;
+    }
 
     gripper_command_ = gripper_goal->command;
     gripper_pub_.publish(gripper_command_);
+    ros::Time command_time = ros::Time::now();
 
     //gripper_executing_ = true;
-    ros::Rate r(10);
-    new_measurement_available = false;
     while(n.ok() && as_->isActive()) {
 
+        // Wake up on a measurement, a new goal or preemption. The timeout only bounds the reaction to a shutdown.
+        tue_msgs::GripperMeasurement meas;
+        ros::Time meas_received;
+        bool measurement_available;
+        {
+            std::unique_lock<std::mutex> lock(meas_mutex_);
+            meas_cv_.wait_for(lock, std::chrono::milliseconds(100),
+                              []() { return new_measurement_available || preempt_requested; });
+            measurement_available = new_measurement_available;
+            if (measurement_available) {
+                meas = gripper_meas_;
+                meas_received = gripper_meas_received_;
+            }
+            new_measurement_available = false;
+            preempt_requested = false;
+        }
+
         if (as_->isNewGoalAvailable()) {
             gripper_command_ = as_->acceptNewGoal()->command;
             ROS_DEBUG("New goal received.");
             gripper_pub_.publish(gripper_command_);
+            command_time = ros::Time::now();
+            measurement_available = false;
+        }
+
+        // A measurement taken before the command was sent may still report that the previous command completed.
+        // Measurements without a stamp count from their arrival, which is always after the command.
+        if (measurement_available && !meas.header.stamp.isZero() && meas.header.stamp < command_time) {
+            measurement_available = false;
         }
 
         // check that preempt has not been requested by the client
@@ -51,31 +112,23 @@ void executeCB(const tue_manipulation_msgs::GripperCommandGoalConstPtr& gripper_
             break;
         }
 
-        if(new_measurement_available)
+        if(measurement_available)
         {
-            if (gripper_meas_.end_position_reached) {
+            if (meas.end_position_reached) {
                 ROS_DEBUG("Gripper server reports: End position reached");
-                tue_manipulation_msgs::GripperCommandResult result;
-                result.measurement = gripper_meas_;
-                as_->setSucceeded(result, "End position reached.");
+                setSucceeded(meas, meas_received, "End position reached.");
                 break;
-            } else if (gripper_meas_.max_torque_reached) {
+            } else if (meas.max_torque_reached) {
                 ROS_DEBUG("Gripper server reports: Max torque reached");
-                tue_manipulation_msgs::GripperCommandResult result;
-                result.measurement = gripper_meas_;
-                as_->setSucceeded(result, "Max torque reached.");
+                setSucceeded(meas, meas_received, "Max torque reached.");
                 break;
             } else {
                 tue_manipulation_msgs::GripperCommandFeedback feedback;
-                feedback.measurement = gripper_meas_;
+                feedback.measurement = meas;
                 as_->publishFeedback(feedback);
             }
-            new_measurement_available = false;
         }
-        r.sleep();
     }
-
-    gripper_sub.shutdown();
 }
 
 int main(int argc, char** argv) {
@@ -86,6 +139,12 @@ int main(int argc, char** argv) {
     //std::stringstream as_name;
     //as_name << "/gripper_server_" << side_;
     as_ = new actionlib::SimpleActionServer<tue_manipulation_msgs::GripperCommandAction>(nh, "action", &executeCB, false);
+    as_->registerPreemptCallback(&preemptCb);
+
+    // Subscribed once, such that goals do not wait for a connection to be set up
+    //std::stringstream meas_topic;
+    //meas_topic << "/arm_" << side_ << "_controller/gripper_measurement";
+    gripper_sub_ = nh.subscribe("measurements", 1, &gripperMeasurementCb);
 
     //std::stringstream cmd_topic;
     //cmd_topic << "/arm_" << side_ << "_controller/gripper_command";
@@ -0,0 +1,53 @@
+#include "tue/manipulation/joint_measurement_buffer.h"
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// Copies of a vector only get the capacity of its size, so the positions are sized instead of reserved
+JointMeasurement preallocatedMeasurement(unsigned int num_joints)
+{
+    JointMeasurement m;
+    m.position.resize(num_joints, 0);
+    return m;
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+JointMeasurementBuffer::JointMeasurementBuffer(unsigned int num_joints)
+    : buffer_(preallocatedMeasurement(num_joints))
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool JointMeasurementBuffer::write(const std::vector<std::string>& joint_names, const std::vector<double>& position,
+                                   double stamp)
+{
+    if (joint_names.size() != position.size())
+        return false;
+
+    // Comparing the names does not allocate; a new layout is only created when they differ
+    if (!joint_names_ || *joint_names_ != joint_names)
+        joint_names_ = std::make_shared<const std::vector<std::string> >(joint_names);
+
+    JointMeasurement& m = buffer_.writeBuffer();
+    m.joint_names = joint_names_;
+    m.position.assign(position.begin(), position.end());
+    m.stamp = stamp;
+    buffer_.publish();
+
+    return true;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
@@ -2,6 +2,7 @@
 
 #include <ros/ros.h>
 #include <actionlib/server/action_server.h>
+#include <realtime_tools/realtime_publisher.h>
 
 #include <control_msgs/FollowJointTrajectoryAction.h>
 
@@ -10,13 +11,58 @@
 
 #include <diagnostic_msgs/DiagnosticArray.h>
 
+#include "tue/manipulation/reference_generator.h"
+#include "tue/manipulation/triple_buffer.h"
+#include "tue/manipulation/latency_histogram.h"
+#include "tue/manipulation/ring_buffer.h"
+#include "tue/manipulation/tracking_statistics.h"
+
+#include <boost/scoped_ptr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include <pthread.h>
+
 using namespace std;
 
+namespace
+{
+
+// Number of tracking error samples that can be queued for the debug topic, and the rate at which they are
+// published [Hz]
+const unsigned int TRACKING_SAMPLE_CAPACITY = 1000;
+const double TRACKING_ERROR_PUBLISH_RATE = 50;
+
+// Number of reports of ended goals that can be queued, and the rate at which they are published [Hz]
+const unsigned int GOAL_REPORT_CAPACITY = 16;
+const double GOAL_REPORT_PUBLISH_RATE = 10;
+
+// Adds a key-value pair to the diagnostic status
+template<typename T>
+void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value)
+{
+    std::stringstream s;
+    s << value;
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = s.str();
+    status.values.push_back(kv);
+}
+
+} // end anonymous namespace
+
 class JointTrajectoryExecuter
 {
 private:
     typedef actionlib::ActionServer<control_msgs::FollowJointTrajectoryAction> JTAS;
     typedef JTAS::GoalHandle GoalHandle;
+    typedef boost::shared_ptr<const control_msgs::FollowJointTrajectoryGoal> GoalConstPtr;
 
 public:
     JointTrajectoryExecuter(ros::NodeHandle &n) :
@@ -26,41 +72,48 @@ public:
                        boost::bind(&JointTrajectoryExecuter::cancelCB, this, _1),
                        false),
         has_active_goal_(false),
-        current_point(0)
+        current_point(0),
+        refgen_passed_waypoints_(0),
+        streaming_(false),
+        control_running_(false),
+        num_dropped_references_(0)
     {
-        using namespace XmlRpc;
         ros::NodeHandle pn("~");
 
-        // Gets all of the joints
-        XmlRpc::XmlRpcValue joint_names;
-        if (!pn.getParam("joint_names", joint_names))
-        {
-            ROS_FATAL("No joints given. (namespace: %s)", pn.getNamespace().c_str());
-            exit(1);
-        }
-        if (joint_names.getType() != XmlRpc::XmlRpcValue::TypeArray)
-        {
-            ROS_FATAL("Malformed joint specification.  (namespace: %s)", pn.getNamespace().c_str());
-            exit(1);
-        }
-        for (int i = 0; i < joint_names.size(); ++i)
+        // Gets all of the joints, grouped per controller
+        if (pn.hasParam("groups"))
+            readGroups(pn);
+        else
+            createDefaultGroups(pn);
+
+        for (unsigned int g = 0; g < groups_.size(); ++g)
         {
-            XmlRpcValue &name_value = joint_names[i];
-            if (name_value.getType() != XmlRpcValue::TypeString)
+            for (unsigned int i = 0; i < groups_[g].msg.name.size(); ++i)
             {
-                ROS_FATAL("Array of joint names should contain all strings.  (namespace: %s)",
-                          pn.getNamespace().c_str());
-                exit(1);
-            }
-
-            joint_index_[(std::string)name_value] = joint_names_.size();
-            joint_names_.push_back((std::string)name_value);
+                const std::string& name = groups_[g].msg.name[i];
+                if (joint_index_.find(name) != joint_index_.end())
+                {
+                    ROS_FATAL("Joint %s is part of more than one group.  (namespace: %s)", name.c_str(),
+                              pn.getNamespace().c_str());
+                    exit(1);
+                }
 
+                joint_index_[name] = joint_names_.size();
+                joint_names_.push_back(name);
+                joint_group_.push_back(g);
+                joint_group_slot_.push_back(i);
+            }
+            groups_[g].msg.position.resize(groups_[g].msg.name.size());
         }
 
         pn.param("constraints/goal_time", goal_time_constraint_, 0.0);
 
         // Gets the constraints for each joint.
+        intermediate_goal_constraints_.resize(joint_names_.size());
+        final_goal_constraints_.resize(joint_names_.size());
+        trajectory_constraints_.resize(joint_names_.size());
+        joint_min_constraints_.resize(joint_names_.size());
+        joint_max_constraints_.resize(joint_names_.size());
         for (size_t i = 0; i < joint_names_.size(); ++i)
         {
             ROS_WARN_ONCE("ToDo: parse from URDF as much as possible");
@@ -71,192 +124,1137 @@ public:
             pn.param(ns + "/trajectory", t, -1.0);
             pn.param(ns + "/min_pos", mip, -1.0);
             pn.param(ns + "/max_pos", map, -1.0);
-            intermediate_goal_constraints_[joint_names_[i]] = ig;
-            final_goal_constraints_[joint_names_[i]] = fg;
-            trajectory_constraints_[joint_names_[i]] = t;
-            joint_min_constraints_[joint_names_[i]] = mip;
-            joint_max_constraints_[joint_names_[i]] = map;
+            intermediate_goal_constraints_[i] = ig;
+            final_goal_constraints_[i] = fg;
+            trajectory_constraints_[i] = t;
+            joint_min_constraints_[i] = mip;
+            joint_max_constraints_[i] = map;
             ROS_DEBUG("Joint %s, min = %f, max = %f, int = %f, final = %f, traj = %f", joint_names_[i].c_str(), mip, map, ig, fg, t);
         }
-        nr_torso_joints_ = joint_names.size() - 7;// Assume 7 DoF arm... // ToDo: make nice
 
-        // Here we start sending the references
-        pub = node_.advertise<sensor_msgs::JointState>("references", 1);
-        torso_pub = node_.advertise<sensor_msgs::JointState>("torso/references",1);
-        // Here we start listening for the measured positions
-        sub = node_.subscribe("measurements", 1, &JointTrajectoryExecuter::armCB, this);
-        torso_sub = node_.subscribe("torso/measurements", 1, &JointTrajectoryExecuter::armCB, this);
+        cur_pos_.assign(joint_names_.size(), 0.0);
+        ref_pos_.assign(joint_names_.size(), 0.0);
+
+        // With a control rate, the controller runs on a dedicated thread at that rate, instead of on every
+        // measurement (or, when interpolating, on a timer)
+        double control_rate;
+        pn.param("control_rate", control_rate, 0.0);
+        pn.param("cpu_affinity", cpu_affinity_, -1);
+        use_control_thread_ = (control_rate > 0);
+
+        // In interpolation mode, goals are fed into a reference generator and smooth references are published at a
+        // fixed rate, instead of stepping through the waypoints at the measurement rate. Timed goals that start in
+        // the future are then spliced into the active goal; with queue_goals, every goal starts after the active one.
+        pn.param("interpolate", interpolate_, false);
+        pn.param("queue_goals", queue_goals_, false);
+        if (interpolate_)
+        {
+            double rate;
+            bool time_optimal;
+            pn.param("rate", rate, 100.0);
+            pn.param("time_optimal", time_optimal, false);
+
+            refgen_.setJointNames(joint_names_);
+            refgen_.setTimeOptimalParameterization(time_optimal);
+            for (size_t i = 0; i < joint_names_.size(); ++i)
+            {
+                std::string ns = std::string("constraints/") + joint_names_[i];
+                double max_vel, max_acc;
+                if (!pn.getParam(ns + "/max_vel", max_vel) || !pn.getParam(ns + "/max_acc", max_acc))
+                {
+                    ROS_FATAL("Interpolation requires max_vel and max_acc constraints for joint %s.  (namespace: %s)",
+                              joint_names_[i].c_str(), pn.getNamespace().c_str());
+                    exit(1);
+                }
+                refgen_.initJoint(i, max_vel, max_acc, joint_min_constraints_[i], joint_max_constraints_[i]);
+            }
+
+            references_.resize(joint_names_.size());
+            goal_joint_mask_.assign(joint_names_.size(), false);
+            if (use_control_thread_)
+                stream_dt_ = 1.0 / control_rate;
+            else
+            {
+                stream_dt_ = 1.0 / rate;
+                stream_timer_ = node_.createTimer(ros::Duration(stream_dt_), &JointTrajectoryExecuter::streamCB, this);
+            }
+        }
+
+        for (unsigned int g = 0; g < groups_.size(); ++g)
+        {
+            ControllerGroup& group = groups_[g];
+
+            // Here we start sending the references. The control thread publishes through a non-blocking publisher,
+            // of which the names are filled in once.
+            if (use_control_thread_)
+            {
+                group.rt_pub.reset(new realtime_tools::RealtimePublisher<sensor_msgs::JointState>(
+                                       node_, group.reference_topic, 1));
+                group.rt_pub->msg_ = group.msg;
+            }
+            else
+                group.pub = node_.advertise<sensor_msgs::JointState>(group.reference_topic, 1);
+
+            // Here we start listening for the measured positions
+            group.sub = node_.subscribe<sensor_msgs::JointState>(group.measurement_topic, 1,
+                                                                 boost::bind(&JointTrajectoryExecuter::armCB, this, _1, g));
+
+            // Start with hardware status OK
+            group.status = 2;
+            group.in_goal = false;
+
+            ROS_INFO("Group %u: %zu joints, references on %s, measurements on %s, diag name = %s", g,
+                     group.msg.name.size(), node_.resolveName(group.reference_topic).c_str(), group.sub.getTopic().c_str(),
+                     group.diagnostics_name.c_str());
+        }
 
         // Diagnostics sub
         diag_sub = node_.subscribe("hardware_status", 1, &JointTrajectoryExecuter::diagnosticsCB, this);
 
-        // Start with hardware status OK
-        torso_status = 2;
-        arm_status = 2;
-        torso_diag_name = "spindle"; // ToDo: don't hardcode
-        std::string leftstr = "left";
-        std::string rightstr= "right";
-        for (unsigned int i = 0; i < joint_names_.size(); i++ ) {
-            if (joint_names_[i].find(leftstr) != std::string::npos) {
-                arm_diag_name = "left_arm";
-                break;
-            } else if (joint_names_[i].find(rightstr) != std::string::npos) {
-                arm_diag_name = "right_arm";
-                break;
-            }
+        // A summary of the tracking performance is published when a goal ends. Optionally, the reference and
+        // measured positions of every tick are published as well. They are queued by the controller and published
+        // in batches, such that the controller itself never publishes them.
+        goal_statistics_pub_ = pn.advertise<diagnostic_msgs::DiagnosticArray>("goal_statistics", 1, true);
+
+        GoalReport report;
+        report.goal_joint_indices.resize(joint_names_.size());
+        goal_reports_.reset(new tue::manipulation::RingBuffer<GoalReport>(GOAL_REPORT_CAPACITY, report));
+        goal_report_timer_ = node_.createWallTimer(ros::WallDuration(1.0 / GOAL_REPORT_PUBLISH_RATE),
+                                                   &JointTrajectoryExecuter::goalReportCB, this);
+
+        bool publish_tracking_error;
+        pn.param("publish_tracking_error", publish_tracking_error, false);
+        if (publish_tracking_error)
+        {
+            TrackingSample sample;
+            sample.reference.resize(joint_names_.size());
+            sample.measured.resize(joint_names_.size());
+            tracking_samples_.reset(new tue::manipulation::RingBuffer<TrackingSample>(TRACKING_SAMPLE_CAPACITY, sample));
+
+            tracking_error_msg_.joint_names = joint_names_;
+            tracking_error_msg_.desired.positions.resize(joint_names_.size());
+            tracking_error_msg_.actual.positions.resize(joint_names_.size());
+            tracking_error_msg_.error.positions.resize(joint_names_.size());
+            tracking_error_pub_ = pn.advertise<control_msgs::FollowJointTrajectoryFeedback>(
+                                      "tracking_error", TRACKING_SAMPLE_CAPACITY);
+            tracking_error_timer_ = node_.createWallTimer(ros::WallDuration(1.0 / TRACKING_ERROR_PUBLISH_RATE),
+                                                          &JointTrajectoryExecuter::trackingErrorCB, this);
+        }
+
+        if (use_control_thread_)
+        {
+            double statistics_period;
+            pn.param("statistics_period", statistics_period, 10.0);
+
+            measured_pos_.assign(joint_names_.size(), 0.0);
+            measurement_buffer_.reset(new tue::manipulation::TripleBuffer<std::vector<double> >(measured_pos_));
+            statistics_buffer_.reset(new tue::manipulation::TripleBuffer<ControlLoopStatistics>());
+
+            if (statistics_period > 0)
+                statistics_timer_ = node_.createWallTimer(ros::WallDuration(statistics_period),
+                                                          &JointTrajectoryExecuter::statisticsCB, this);
+
+            control_dt_ = 1.0 / control_rate;
+            control_running_ = true;
+            control_thread_ = std::thread(&JointTrajectoryExecuter::controlLoop, this);
+            setAffinity(control_thread_, cpu_affinity_);
+
+            ROS_INFO("Control thread running at %g Hz", control_rate);
         }
-        ROS_INFO("Torso diag name = %s, arm diag name = %s", torso_diag_name.c_str(), arm_diag_name.c_str());
 
         action_server_.start();
     }
 
     ~JointTrajectoryExecuter()
     {
-        pub.shutdown();
-        sub.shutdown();
+        control_running_ = false;
+        if (control_thread_.joinable())
+            control_thread_.join();
+
+        for (unsigned int g = 0; g < groups_.size(); ++g)
+        {
+            groups_[g].pub.shutdown();
+            groups_[g].rt_pub.reset();
+            groups_[g].sub.shutdown();
+        }
     }
 
 private:
 
-    void goalCB(GoalHandle gh)
+    // Joint names of the last measurement of a topic, and their indices (-1 if unknown). The indices are only
+    // resolved again if the names change.
+    struct MeasurementIndex
     {
-        current_point = 0;
-        now = ros::Time::now();
+        std::vector<std::string> names;
+        std::vector<int> indices;
+    };
 
-        // Cancels the currently active goal.
-        if (has_active_goal_)
+    // A set of joints that is driven by one hardware controller, with its own reference and measurement topic and
+    // hardware status
+    struct ControllerGroup
+    {
+        std::string reference_topic;
+        std::string measurement_topic;
+        std::string diagnostics_name; // Name of the group in the diagnostics message array
+
+        ros::Publisher pub;
+        boost::shared_ptr<realtime_tools::RealtimePublisher<sensor_msgs::JointState> > rt_pub;
+        ros::Subscriber sub;
+        MeasurementIndex meas_index;
+        unsigned int status;
+
+        // Reference message, of which the names are filled in once
+        sensor_msgs::JointState msg;
+
+        // Whether the active goal contains joints of this group
+        bool in_goal;
+    };
+
+    // Reads the groups from a list of {joints: [...], references: topic, measurements: topic, diagnostics: name}
+    void readGroups(ros::NodeHandle& pn)
+    {
+        using namespace XmlRpc;
+
+        XmlRpcValue groups;
+        pn.getParam("groups", groups);
+        if (groups.getType() != XmlRpcValue::TypeArray || groups.size() == 0)
         {
-            // Stops the controller.
+            ROS_FATAL("Malformed group specification: should be a list of groups.  (namespace: %s)",
+                      pn.getNamespace().c_str());
+            exit(1);
+        }
 
-            // Torso
-            sensor_msgs::JointState torso_msg;
-            for (uint i = 0; i < nr_torso_joints_; i++) {
-                torso_msg.name.push_back(joint_names_[i]);
-                torso_msg.position.push_back(cur_pos_[joint_names_[i]]);
+        for (int g = 0; g < groups.size(); ++g)
+        {
+            XmlRpcValue& group_value = groups[g];
+            if (group_value.getType() != XmlRpcValue::TypeStruct || !group_value.hasMember("joints")
+                    || group_value["joints"].getType() != XmlRpcValue::TypeArray)
+            {
+                ROS_FATAL("Group %d should have a list of joints.  (namespace: %s)", g, pn.getNamespace().c_str());
+                exit(1);
             }
-            torso_pub.publish(torso_msg);
 
-            // arm
-            sensor_msgs::JointState arm_msg;
-            for (uint i = 0; i < 7; i++) {
-                arm_msg.name.push_back(joint_names_[i+nr_torso_joints_]);
-                arm_msg.position.push_back(cur_pos_[joint_names_[i+nr_torso_joints_]]);
+            groups_.push_back(ControllerGroup());
+            ControllerGroup& group = groups_.back();
+
+            XmlRpcValue& joints = group_value["joints"];
+            for (int i = 0; i < joints.size(); ++i)
+            {
+                if (joints[i].getType() != XmlRpcValue::TypeString)
+                {
+                    ROS_FATAL("Array of joint names should contain all strings.  (namespace: %s)",
+                              pn.getNamespace().c_str());
+                    exit(1);
+                }
+                group.msg.name.push_back((std::string)joints[i]);
             }
-            pub.publish(arm_msg);
 
-            // Marks the current goal as canceled.
-            active_goal_.setCanceled();
-            has_active_goal_ = false;
-            ROS_WARN("Canceling previous goal");
+            if (!readString(group_value, "references", group.reference_topic)
+                    || !readString(group_value, "measurements", group.measurement_topic))
+            {
+                ROS_FATAL("Group %d should have a references and a measurements topic.  (namespace: %s)", g,
+                          pn.getNamespace().c_str());
+                exit(1);
+            }
+            readString(group_value, "diagnostics", group.diagnostics_name);
+        }
+    }
+
+    static bool readString(XmlRpc::XmlRpcValue& value, const std::string& member, std::string& s)
+    {
+        if (!value.hasMember(member) || value[member].getType() != XmlRpc::XmlRpcValue::TypeString)
+            return false;
+        s = (std::string)value[member];
+        return true;
+    }
+
+    // Without a group specification, the last seven joints form an arm and the joints before them a torso
+    void createDefaultGroups(ros::NodeHandle& pn)
+    {
+        using namespace XmlRpc;
+
+        XmlRpc::XmlRpcValue joint_names;
+        if (!pn.getParam("joint_names", joint_names))
+        {
+            ROS_FATAL("No joints given. (namespace: %s)", pn.getNamespace().c_str());
+            exit(1);
+        }
+        if (joint_names.getType() != XmlRpc::XmlRpcValue::TypeArray || joint_names.size() < 7)
+        {
+            ROS_FATAL("Malformed joint specification.  (namespace: %s)", pn.getNamespace().c_str());
+            exit(1);
         }
 
-        number_of_goal_joints_ = gh.getGoal()->trajectory.joint_names.size();
+        groups_.resize(2);
+        ControllerGroup& torso = groups_[0];
+        ControllerGroup& arm = groups_[1];
+
+        unsigned int nr_torso_joints = joint_names.size() - 7; // Assume 7 DoF arm...
+        for (int i = 0; i < joint_names.size(); ++i)
+        {
+            XmlRpcValue &name_value = joint_names[i];
+            if (name_value.getType() != XmlRpcValue::TypeString)
+            {
+                ROS_FATAL("Array of joint names should contain all strings.  (namespace: %s)",
+                          pn.getNamespace().c_str());
+                exit(1);
+            }
+
+            if ((unsigned int)i < nr_torso_joints)
+                torso.msg.name.push_back((std::string)name_value);
+            else
+                arm.msg.name.push_back((std::string)name_value);
+        }
+
+        torso.reference_topic = "torso/references";
+        torso.measurement_topic = "torso/measurements";
+        torso.diagnostics_name = "spindle";
+
+        arm.reference_topic = "references";
+        arm.measurement_topic = "measurements";
+        for (unsigned int i = 0; i < arm.msg.name.size(); i++ ) {
+            if (arm.msg.name[i].find("left") != std::string::npos) {
+                arm.diagnostics_name = "left_arm";
+                break;
+            } else if (arm.msg.name[i].find("right") != std::string::npos) {
+                arm.diagnostics_name = "right_arm";
+                break;
+            }
+        }
+
+        // An empty torso group would only publish empty references
+        if (torso.msg.name.empty())
+            groups_.erase(groups_.begin());
+    }
+
+    void goalCB(GoalHandle gh)
+    {
+        GoalConstPtr goal = gh.getGoal();
+        const trajectory_msgs::JointTrajectory& trajectory = goal->trajectory;
+        uint number_of_goal_joints = trajectory.joint_names.size();
+
+        // Resolve the goal joints to their indices, such that the controller does not need to look them up. The
+        // goal is checked before it affects the active goal.
+        std::vector<unsigned int> goal_joint_indices(number_of_goal_joints);
+        for (uint i = 0; i < number_of_goal_joints; i++) {
+            std::map<std::string, unsigned int>::const_iterator it = joint_index_.find(trajectory.joint_names[i]);
+            if (it == joint_index_.end()) {
+                ROS_WARN("Goal contains unknown joint %s.", trajectory.joint_names[i].c_str());
+                gh.setRejected();
+                return;
+            }
+            goal_joint_indices[i] = it->second;
+        }
 
         // Check feasibility of arm joint goals
-        for (uint i = 0; i < number_of_goal_joints_; i++) {
-            std::string joint_name = gh.getGoal()->trajectory.joint_names[i];
-            for (uint j = 0; j < gh.getGoal()->trajectory.points.size(); j++) {
-                double ref = gh.getGoal()->trajectory.points[j].positions[i];
-                if (ref < joint_min_constraints_[joint_name] || ref > joint_max_constraints_[joint_name]) {
-                    ROS_WARN("Reference for joint %s is %f but should be between %f and %f.",joint_name.c_str(),ref,joint_min_constraints_[joint_name],joint_max_constraints_[joint_name]);
+        if (trajectory.points.empty()) {
+            ROS_WARN("Goal contains no trajectory points.");
+            gh.setRejected();
+            return;
+        }
+        for (uint j = 0; j < trajectory.points.size(); j++) {
+            if (trajectory.points[j].positions.size() != number_of_goal_joints) {
+                ROS_WARN("Trajectory point %u has %zu positions, but the goal has %u joints.", j,
+                         trajectory.points[j].positions.size(), number_of_goal_joints);
+                gh.setRejected();
+                return;
+            }
+        }
+
+        for (uint i = 0; i < number_of_goal_joints; i++) {
+            unsigned int k = goal_joint_indices[i];
+            for (uint j = 0; j < trajectory.points.size(); j++) {
+                double ref = trajectory.points[j].positions[i];
+                if (ref < joint_min_constraints_[k] || ref > joint_max_constraints_[k]) {
+                    ROS_WARN("Reference for joint %s is %f but should be between %f and %f.",joint_names_[k].c_str(),ref,joint_min_constraints_[k],joint_max_constraints_[k]);
                     gh.setRejected();
-                    has_active_goal_=false;
                     return;
                 }
             }
         }
 
+        // Prepare the goal for the reference generator, which may include its time-optimal parameterization,
+        // before taking the lock, such that the controller is not held up meanwhile
+        tue::manipulation::JointGoal refgen_goal;
+        std::vector<double> start_positions;
+        if (interpolate_ && !prepareInterpolation(*goal, goal_joint_indices, refgen_goal, start_positions, gh)) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // A goal that starts in the future (or, when queueing, any goal) takes over the active goal at its start
+        // time, without stopping the joints
+        if (has_active_goal_ && interpolate_ && spliceGoal(gh, goal_joint_indices)) {
+            return;
+        }
+
+        // Cancels the currently active goal.
+        if (has_active_goal_)
+        {
+            // Stops the controller. When interpolating, the joints brake smoothly unless the new goal takes over.
+            if (interpolate_)
+                refgen_.removeGoal(refgen_goal_id_);
+            else
+                publishReferences(cur_pos_);
+
+            // Marks the current goal as canceled.
+            active_goal_.setCanceled();
+            has_active_goal_ = false;
+            ROS_WARN("Canceling previous goal");
+            queueGoalReport("preempted", "", diagnostic_msgs::DiagnosticStatus::OK);
+        }
+
+        current_point = 0;
+        now = ros::Time::now();
+        number_of_goal_joints_ = number_of_goal_joints;
+        goal_joint_indices_ = goal_joint_indices;
+
+        if (interpolate_ && !startInterpolation(refgen_goal, start_positions, gh)) {
+            return;
+        }
+
+        // Only the groups of the goal joints are driven (and, when interpolating, those of joints that are still
+        // braking). Their joints that are not part of the goal hold their current position.
+        for (unsigned int g = 0; g < groups_.size(); ++g) {
+            groups_[g].in_goal = false;
+        }
+        for (uint i = 0; i < number_of_goal_joints_; i++) {
+            groups_[joint_group_[goal_joint_indices_[i]]].in_goal = true;
+        }
+        for (unsigned int k = 0; k < joint_names_.size() && interpolate_; ++k) {
+            if (isBraking(k))
+                groups_[joint_group_[k]].in_goal = true;
+        }
+        ref_pos_ = cur_pos_;
+        for (unsigned int k = 0; k < joint_names_.size(); ++k) {
+            groups_[joint_group_[k]].msg.position[joint_group_slot_[k]] = ref_pos_[k];
+        }
+
+        acceptGoal(gh, trajectory.points.back().time_from_start.toSec());
+    }
+
+    void acceptGoal(GoalHandle& gh, double nominal_duration)
+    {
+        goal_errors_.assign(number_of_goal_joints_, 0.0);
+        tracking_stats_.start(number_of_goal_joints_, ros::Time::now().toSec(), nominal_duration);
+
         ///ROS_INFO("Number of goal joints = %i",number_of_goal_joints_);
         gh.setAccepted();
         active_goal_ = gh;
+        active_goal_msg_ = gh.getGoal();
         has_active_goal_ = true;
 
         // Start by assuming hardware works
-        arm_status = 2;
-        torso_status = 2;
+        for (unsigned int g = 0; g < groups_.size(); ++g) {
+            groups_[g].status = 2;
+        }
+    }
 
+    // Splices the trajectory of a new goal into the references of the active goal, if it starts in the future or,
+    // when queueing, after the active goal. The new goal takes over from the active goal, which is canceled. The
+    // references stay continuous in position and velocity. Returns false if the goal should replace the active
+    // goal instead.
+    bool spliceGoal(GoalHandle& gh, const std::vector<unsigned int>& goal_joint_indices)
+    {
+        const trajectory_msgs::JointTrajectory& trajectory = gh.getGoal()->trajectory;
+
+        double delay = 0;
+        if (!trajectory.header.stamp.isZero())
+            delay = (trajectory.header.stamp - ros::Time::now()).toSec();
+
+        double remaining_time;
+        if (queue_goals_ && refgen_.getRemainingTime(refgen_goal_id_, remaining_time))
+            delay = std::max(delay, remaining_time);
+
+        if (delay <= 0)
+            return false;
+
+        std::stringstream error;
+        if (!refgen_.spliceGoal(refgen_goal_id_, *gh.getGoal(), delay, error)) {
+            ROS_WARN("Could not splice goal, replacing the active goal instead: %s", error.str().c_str());
+            return false;
+        }
+
+        active_goal_.setCanceled(control_msgs::FollowJointTrajectoryResult(), "Spliced into a newer goal");
+        ROS_INFO("Spliced goal into the active goal, starting in %f seconds", delay);
+        queueGoalReport("spliced", "", diagnostic_msgs::DiagnosticStatus::OK);
+
+        // The joints and references stay the same, only their order in the goal may differ. The waypoints the
+        // references have passed belong to the spliced goal.
+        goal_joint_indices_ = goal_joint_indices;
+        refgen_.getNumPassedWaypoints(refgen_goal_id_, refgen_passed_waypoints_);
+        reference_end_ = ros::Time(0);
+
+        acceptGoal(gh, delay + trajectory.points.back().time_from_start.toSec());
+        return true;
     }
 
     void cancelCB(GoalHandle gh)
     {
-        if (active_goal_ == gh)
-        {
-            // Stops the controller.
+        std::lock_guard<std::mutex> lock(mutex_);
 
-            //spindle
-            sensor_msgs::JointState torso_msg;
-            for (uint i = 0; i < nr_torso_joints_; i++) {
-                torso_msg.name.push_back(joint_names_[i]);
-                torso_msg.position.push_back(cur_pos_[joint_names_[i]]);
-            }
-            torso_pub.publish(torso_msg);
-
-            // arm
-            sensor_msgs::JointState arm_msg;
-            for (uint i = 0; i < 7; i++) {
-                arm_msg.name.push_back(joint_names_[i+nr_torso_joints_]);
-                arm_msg.position.push_back(cur_pos_[joint_names_[i+nr_torso_joints_]]);
-            }
-            pub.publish(arm_msg);
+        if (has_active_goal_ && active_goal_ == gh)
+        {
+            // Stops the controller. When interpolating, the joints brake smoothly.
+            if (interpolate_)
+                refgen_.removeGoal(refgen_goal_id_);
+            else
+                publishReferences(cur_pos_);
 
             // Marks the current goal as canceled.
             active_goal_.setCanceled();
             has_active_goal_ = false;
+            queueGoalReport("canceled", "", diagnostic_msgs::DiagnosticStatus::OK);
         }
     }
 
 
     ros::NodeHandle node_;
     JTAS action_server_;
-    ros::Publisher pub;
-    ros::Subscriber sub;
-
-    ros::Publisher torso_pub;
-    ros::Subscriber torso_sub;
     ros::Subscriber diag_sub;
 
-    unsigned int torso_status, arm_status;
-    std::string torso_diag_name; // Name of the torso in the diagnostics message array
-    std::string arm_diag_name; // Name of the arm in the diagnostics message array
+    std::vector<ControllerGroup> groups_;
 
     ros::Time now;
 
     bool has_active_goal_;
     int current_point;
     GoalHandle active_goal_;
-    ///bool goal_includes_spindle_;
+    GoalConstPtr active_goal_msg_;
     uint number_of_goal_joints_;
-    uint nr_torso_joints_;
 
+    // Goal that was ended by the controller, of which the result and statistics are yet to be sent
+    enum GoalResult { GOAL_NONE, GOAL_SUCCEEDED, GOAL_ABORTED };
+    struct FinishedGoal
+    {
+        FinishedGoal() : result(GOAL_NONE) {}
+
+        GoalHandle gh;
+        GoalResult result;
+        std::string reason;
+    };
+    FinishedGoal finished_goal_;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Tracking statistics
+
+    // Tracking error statistics of the active goal, and the errors of its joints in the last tick
+    tue::manipulation::TrackingStatistics tracking_stats_;
+    std::vector<double> goal_errors_;
+
+    // Summary of a goal that ended, queued with mutex_ locked and published by goalReportCB, such that the
+    // controller never formats or publishes it
+    struct GoalReport
+    {
+        GoalReport() : outcome(""), level(0) {}
+
+        const char* outcome;
+        std::string reason;
+        unsigned char level;
+        tue::manipulation::TrackingStatistics stats;
+        std::vector<unsigned int> goal_joint_indices;
+    };
+    boost::scoped_ptr<tue::manipulation::RingBuffer<GoalReport> > goal_reports_;
+    ros::Publisher goal_statistics_pub_;
+    ros::WallTimer goal_report_timer_;
+
+    struct TrackingSample
+    {
+        ros::Time stamp;
+        std::vector<double> reference;
+        std::vector<double> measured;
+    };
+
+    // Reference and measured positions of all joints in every tick, queued for the debug topic (only if enabled)
+    boost::scoped_ptr<tue::manipulation::RingBuffer<TrackingSample> > tracking_samples_;
+    control_msgs::FollowJointTrajectoryFeedback tracking_error_msg_;
+    ros::Publisher tracking_error_pub_;
+    ros::WallTimer tracking_error_timer_;
+
+    // All per-joint data is indexed like joint_names_
     std::vector<std::string> joint_names_;
     std::map<std::string, unsigned int> joint_index_;
-    std::map<std::string,double> intermediate_goal_constraints_;
-    std::map<std::string,double> final_goal_constraints_;
-    std::map<std::string,double> trajectory_constraints_;
-    std::map<std::string,double> joint_min_constraints_;
-    std::map<std::string,double> joint_max_constraints_;
-    std::map<std::string,double> cur_pos_;                          // Current position
-    std::map<std::string,double> ref_pos_;                          // Desired position
+    std::vector<double> intermediate_goal_constraints_;
+    std::vector<double> final_goal_constraints_;
+    std::vector<double> trajectory_constraints_;
+    std::vector<double> joint_min_constraints_;
+    std::vector<double> joint_max_constraints_;
+    std::vector<double> cur_pos_;                                   // Current position
+    std::vector<double> ref_pos_;                                   // Desired position
     double goal_time_constraint_;
 
-    void armCB(const sensor_msgs::JointState& joint_meas)
+    // Scatter table: group of every joint, and its position in the reference message of that group
+    std::vector<unsigned int> joint_group_;
+    std::vector<unsigned int> joint_group_slot_;
+
+    // Index of every joint of the active goal
+    std::vector<unsigned int> goal_joint_indices_;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Interpolation mode
+
+    bool interpolate_;
+
+    // Whether a new goal is executed after the active goal, instead of replacing it
+    bool queue_goals_;
+
+    // Generates the references of all joints, indexed like joint_names_
+    tue::manipulation::ReferenceGenerator refgen_;
+    std::string refgen_goal_id_;
+    std::vector<double> references_;
+
+    // Number of waypoints of the reference generator goal that have been recorded in tracking_stats_
+    unsigned int refgen_passed_waypoints_;
+
+    // Whether a joint is part of the active goal
+    std::vector<bool> goal_joint_mask_;
+
+    // References are published every stream_dt_ [s] as long as streaming_ is set
+    ros::Timer stream_timer_;
+    double stream_dt_;
+    bool streaming_;
+
+    // Time at which the references reached the end of the goal trajectory (zero if not yet)
+    ros::Time reference_end_;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Control thread
+
+    struct ControlLoopStatistics
+    {
+        ControlLoopStatistics() : jitter(1e-6, 1), num_ticks(0), num_overruns(0), num_dropped_references(0),
+            max_compute_time(0) {}
+
+        // Lateness of the start of every tick with respect to its schedule [s]
+        tue::manipulation::LatencyHistogram jitter;
+
+        unsigned long num_ticks;
+        unsigned long num_overruns;
+        unsigned long num_dropped_references;   // Not sent because the previous one was still being published
+        double max_compute_time;
+    };
+
+    bool use_control_thread_;
+    int cpu_affinity_;
+    double control_dt_;
+    std::thread control_thread_;
+    std::atomic<bool> control_running_;
+
+    // Guards everything that is shared between the control thread and the ROS callbacks: the goal, the
+    // references, the current positions and the hardware status. The ROS callbacks only hold it briefly.
+    std::mutex mutex_;
+
+    // Measured positions of all joints, written by the measurement callbacks and read by the control thread
+    std::vector<double> measured_pos_;
+    boost::scoped_ptr<tue::manipulation::TripleBuffer<std::vector<double> > > measurement_buffer_;
+
+    // Statistics of the control thread, read by the statistics timer
+    boost::scoped_ptr<tue::manipulation::TripleBuffer<ControlLoopStatistics> > statistics_buffer_;
+    ros::WallTimer statistics_timer_;
+    unsigned long num_dropped_references_;
+
+    bool isBraking(unsigned int k)
+    {
+        return refgen_.joint_state(k).goal_id.empty() && refgen_.joint_state(k).velocity() != 0;
+    }
+
+    // Prepares the goal for the reference generator. Must be called without mutex_ locked, which is only taken
+    // briefly to read the measured positions from which the goal starts if all its joints are at rest
+    // (start_positions is left empty otherwise). Waypoint goals that start at rest are time-optimally
+    // parameterized if enabled. Rejects the goal on failure.
+    bool prepareInterpolation(const control_msgs::FollowJointTrajectoryGoal& goal,
+                              const std::vector<unsigned int>& goal_joint_indices,
+                              tue::manipulation::JointGoal& refgen_goal, std::vector<double>& start_positions,
+                              GoalHandle& gh)
     {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            start_positions = cur_pos_;
+            for (unsigned int i = 0; i < goal_joint_indices.size(); ++i) {
+                const tue::manipulation::JointInfo& js = refgen_.joint_state(goal_joint_indices[i]);
+                if (js.is_set && js.velocity() != 0)
+                    start_positions.clear();
+            }
+        }
+
+        std::stringstream error;
+        if (!refgen_.prepareGoal(goal, start_positions, refgen_goal, error)) {
+            ROS_WARN("Could not interpolate goal: %s", error.str().c_str());
+            gh.setRejected();
+            return false;
+        }
+        return true;
+    }
+
+    // Feeds the prepared goal into the reference generator. Joints that are at rest start from their measured
+    // position (as read by prepareInterpolation), moving joints continue smoothly from their current reference.
+    // Rejects the goal on failure.
+    bool startInterpolation(tue::manipulation::JointGoal& refgen_goal, const std::vector<double>& start_positions,
+                            GoalHandle& gh)
+    {
+        const std::vector<double>& start = start_positions.empty() ? cur_pos_ : start_positions;
+        for (uint i = 0; i < number_of_goal_joints_; i++) {
+            unsigned int k = goal_joint_indices_[i];
+            const tue::manipulation::JointInfo& js = refgen_.joint_state(k);
+            if (!js.is_set || js.velocity() == 0)
+                refgen_.setJointState(k, start[k], 0);
+        }
+
+        refgen_goal_id_.clear();
+        refgen_passed_waypoints_ = 0;
+        std::stringstream error;
+        if (!refgen_.setGoal(refgen_goal, refgen_goal_id_, error)) {
+            ROS_WARN("Could not interpolate goal: %s", error.str().c_str());
+            gh.setRejected();
+            return false;
+        }
+
+        goal_joint_mask_.assign(joint_names_.size(), false);
+        for (uint i = 0; i < number_of_goal_joints_; i++) {
+            goal_joint_mask_[goal_joint_indices_[i]] = true;
+        }
+
+        reference_end_ = ros::Time(0);
+        streaming_ = true;
+        return true;
+    }
+
+    // Ends the active goal. The result is only sent by sendGoalResult() once mutex_ is released, since the action
+    // server holds its own lock while calling goalCB and cancelCB.
+    void finishGoal(GoalResult result, const std::string& reason = "")
+    {
+        finished_goal_.gh = active_goal_;
+        finished_goal_.result = result;
+        finished_goal_.reason = reason;
+        has_active_goal_ = false;
+        if (interpolate_)
+            refgen_.removeGoal(refgen_goal_id_);
+
+        if (result == GOAL_SUCCEEDED)
+            queueGoalReport("succeeded", reason, diagnostic_msgs::DiagnosticStatus::OK);
+        else
+            queueGoalReport("aborted", reason, diagnostic_msgs::DiagnosticStatus::WARN);
+    }
+
+    void abortGoal(const std::string& reason)
+    {
+        finishGoal(GOAL_ABORTED, reason);
+    }
+
+    // Takes the goal that was ended by the controller, if any. Must be called with mutex_ locked.
+    void takeFinishedGoal(FinishedGoal& goal)
+    {
+        std::swap(goal, finished_goal_);
+        finished_goal_.gh = GoalHandle();
+        finished_goal_.result = GOAL_NONE;
+    }
 
-        for(unsigned int i = 0; i < joint_meas.name.size(); ++i) {
-            std::map<std::string, unsigned int>::iterator it_joint = joint_index_.find(joint_meas.name[i]);
-            if (it_joint != joint_index_.end()) {
-                cur_pos_[joint_meas.name[i]] = joint_meas.position[i];
+    // Must be called without mutex_ locked
+    void sendGoalResult(FinishedGoal& goal)
+    {
+        if (goal.result == GOAL_NONE)
+            return;
+
+        if (goal.result == GOAL_SUCCEEDED)
+            goal.gh.setSucceeded();
+        else
+            goal.gh.setAborted(control_msgs::FollowJointTrajectoryResult(), goal.reason);
+
+        goal.gh = GoalHandle();
+        goal.result = GOAL_NONE;
+    }
+
+    void streamCB(const ros::TimerEvent&)
+    {
+        FinishedGoal finished_goal;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            streamReferences();
+            takeFinishedGoal(finished_goal);
+        }
+        sendGoalResult(finished_goal);
+    }
+
+    // Records the tracking errors of the goal joints in goal_errors_ and the statistics of the active goal, and
+    // queues the positions of all joints for the debug topic
+    void recordTrackingErrors()
+    {
+        for (unsigned int i = 0; i < number_of_goal_joints_; i++) {
+            unsigned int k = goal_joint_indices_[i];
+            goal_errors_[i] = ref_pos_[k] - cur_pos_[k];
+        }
+        tracking_stats_.addSample(goal_errors_);
+
+        if (!tracking_samples_)
+            return;
+
+        TrackingSample* sample = tracking_samples_->writeSlot();
+        if (sample) {
+            sample->stamp = ros::Time::now();
+            sample->reference = ref_pos_;
+            sample->measured = cur_pos_;
+            tracking_samples_->push();
+        }
+    }
+
+    // Queues the statistics of the active goal, which has ended with the given outcome, for goalReportCB. Must be
+    // called with mutex_ locked. The statistics are moved into the report rather than copied; they are restarted
+    // when the next goal is accepted.
+    void queueGoalReport(const char* outcome, const std::string& reason, unsigned char level)
+    {
+        tracking_stats_.finish(ros::Time::now().toSec());
+
+        GoalReport* report = goal_reports_->writeSlot();
+        if (report) {
+            report->outcome = outcome;
+            report->reason = reason;
+            report->level = level;
+            std::swap(report->stats, tracking_stats_);
+            report->goal_joint_indices = goal_joint_indices_;
+            goal_reports_->push();
+        }
+    }
+
+    // Logs and publishes the queued reports of ended goals
+    void goalReportCB(const ros::WallTimerEvent&)
+    {
+        for (const GoalReport* report = goal_reports_->front(); report; report = goal_reports_->front()) {
+            reportGoal(*report);
+            goal_reports_->pop();
+        }
+    }
+
+    void reportGoal(const GoalReport& goal)
+    {
+        const tue::manipulation::TrackingStatistics& stats = goal.stats;
+
+        std::stringstream report;
+        report << "duration " << stats.duration() << " s (nominal " << stats.nominalDuration() << " s), "
+               << stats.numWaypoints() << " waypoints (mean " << stats.meanWaypointTime() << " s, max "
+               << stats.maxWaypointTime() << " s), " << stats.numSamples() << " samples";
+        if (stats.numJoints() > 0 && stats.numSamples() > 0) {
+            unsigned int i = stats.worstJoint();
+            report << ", max error " << stats.maxError(i) << " rad (rms " << stats.rmsError(i) << " rad) on "
+                   << joint_names_[goal.goal_joint_indices[i]];
+        }
+        if (!goal.reason.empty())
+            report << "; " << goal.reason;
+        ROS_INFO("Goal %s: %s", goal.outcome, report.str().c_str());
+
+        diagnostic_msgs::DiagnosticStatus status;
+        status.name = "joint_trajectory_action";
+        status.level = goal.level;
+        status.message = goal.outcome;
+        addDiagnosticValue(status, "reason", goal.reason);
+        addDiagnosticValue(status, "duration", stats.duration());
+        addDiagnosticValue(status, "nominal_duration", stats.nominalDuration());
+        addDiagnosticValue(status, "samples", stats.numSamples());
+        addDiagnosticValue(status, "waypoints", stats.numWaypoints());
+        addDiagnosticValue(status, "mean_waypoint_time", stats.meanWaypointTime());
+        addDiagnosticValue(status, "max_waypoint_time", stats.maxWaypointTime());
+
+        std::vector<double> waypoint_times;
+        stats.recentWaypointTimes(waypoint_times);
+        std::stringstream s;
+        for (unsigned int i = 0; i < waypoint_times.size(); ++i)
+            s << (i > 0 ? " " : "") << waypoint_times[i];
+        addDiagnosticValue(status, "recent_waypoint_times", s.str());
+
+        for (unsigned int i = 0; i < stats.numJoints(); ++i) {
+            const std::string& name = joint_names_[goal.goal_joint_indices[i]];
+            addDiagnosticValue(status, name + "/rms_error", stats.rmsError(i));
+            addDiagnosticValue(status, name + "/max_error", stats.maxError(i));
+        }
+
+        diagnostic_msgs::DiagnosticArray msg;
+        msg.header.stamp = ros::Time::now();
+        msg.status.push_back(status);
+        goal_statistics_pub_.publish(msg);
+    }
+
+    // Publishes the queued tracking samples
+    void trackingErrorCB(const ros::WallTimerEvent&)
+    {
+        for (const TrackingSample* sample = tracking_samples_->front(); sample; sample = tracking_samples_->front()) {
+            tracking_error_msg_.header.stamp = sample->stamp;
+            for (unsigned int k = 0; k < joint_names_.size(); ++k) {
+                tracking_error_msg_.desired.positions[k] = sample->reference[k];
+                tracking_error_msg_.actual.positions[k] = sample->measured[k];
+                tracking_error_msg_.error.positions[k] = sample->reference[k] - sample->measured[k];
+            }
+            tracking_samples_->pop();
+            tracking_error_pub_.publish(tracking_error_msg_);
+        }
+    }
+
+    // Publishes the interpolated references, and checks the tracking error of the active goal against the
+    // trajectory constraints. Called every stream_dt_.
+    void streamReferences()
+    {
+        if (!streaming_)
+            return;
+
+        if (has_active_goal_ && !checkHardwareStatus())
+            return;
+
+        refgen_.calculatePositionReferences(stream_dt_, references_);
+
+        // Scatter the references of the goal joints and braking joints into the messages of their groups
+        bool moving = false;
+        for (unsigned int k = 0; k < joint_names_.size(); ++k) {
+            bool braking = isBraking(k);
+            moving = moving || braking;
+            if ((has_active_goal_ && goal_joint_mask_[k]) || braking) {
+                ref_pos_[k] = references_[k];
+                groups_[joint_group_[k]].msg.position[joint_group_slot_[k]] = references_[k];
+            }
+        }
+
+        publishGoalGroups();
+
+        if (!has_active_goal_) {
+            // Keep publishing until all joints have stopped
+            streaming_ = moving;
+            return;
+        }
+
+        // Record the time at which the references pass each waypoint of the goal
+        unsigned int num_passed;
+        if (refgen_.getNumPassedWaypoints(refgen_goal_id_, num_passed)) {
+            double now = ros::Time::now().toSec();
+            for (; refgen_passed_waypoints_ < num_passed; ++refgen_passed_waypoints_)
+                tracking_stats_.addWaypoint(now);
+        }
+
+        // Check the tracking error and, once the references have reached the end of the trajectory, whether the
+        // final goal constraints are met
+        recordTrackingErrors();
+
+        bool reference_done = (refgen_.getGoalStatus(refgen_goal_id_) == tue::manipulation::JOINT_GOAL_SUCCEEDED);
+        bool converged = reference_done;
+        for (unsigned int i = 0; i < number_of_goal_joints_; i++) {
+            unsigned int k = goal_joint_indices_[i];
+            double abs_error = fabs(goal_errors_[i]);
+
+            if(abs_error > trajectory_constraints_[k]) {
+                ROS_WARN("Aborting because the trajectory constraint of %s (%f) was violated (%f)", joint_names_[k].c_str(), trajectory_constraints_[k], abs_error);
+                abortGoal("trajectory constraint of " + joint_names_[k] + " violated");
+                return;
+            }
+
+            if (abs_error >= final_goal_constraints_[k])
+                converged = false;
+        }
+
+        if (converged)
+        {
+            ROS_INFO("active goal succeeded");
+            finishGoal(GOAL_SUCCEEDED);
+            return;
+        }
+
+        if (reference_done)
+        {
+            if (reference_end_.isZero())
+                reference_end_ = ros::Time::now();
+            else if (ros::Time::now() > reference_end_ + ros::Duration(goal_time_constraint_))
+            {
+                ROS_WARN("Aborting because the final goal constraints were not met in time");
+                abortGoal("final goal constraints not met in time");
+            }
+        }
+    }
+
+    // Publishes the given positions of all joints as references of the groups of the active goal
+    void publishReferences(const std::vector<double>& positions)
+    {
+        for (unsigned int k = 0; k < joint_names_.size(); ++k) {
+            groups_[joint_group_[k]].msg.position[joint_group_slot_[k]] = positions[k];
+        }
+
+        publishGoalGroups();
+    }
+
+    // Publishes the reference messages of the groups of the active goal. The non-blocking publishers of the
+    // control thread drop a reference if the previous one is still being sent.
+    void publishGoalGroups()
+    {
+        for (unsigned int g = 0; g < groups_.size(); ++g) {
+            ControllerGroup& group = groups_[g];
+            if (!group.in_goal)
+                continue;
+
+            if (!group.rt_pub)
+                group.pub.publish(group.msg);
+            else if (group.rt_pub->trylock()) {
+                group.rt_pub->msg_.position = group.msg.position;
+                group.rt_pub->unlockAndPublish();
+            }
+            else
+                ++num_dropped_references_;
+        }
+    }
+
+    void scatterMeasurement(const sensor_msgs::JointState& joint_meas, const MeasurementIndex& meas_index,
+                            std::vector<double>& positions)
+    {
+        for(unsigned int i = 0; i < joint_meas.name.size() && i < joint_meas.position.size(); ++i) {
+            if (meas_index.indices[i] >= 0) {
+                positions[meas_index.indices[i]] = joint_meas.position[i];
             } else {
                 ROS_ERROR("Unknown joint name: %s", joint_meas.name[i].c_str());
             }
         }
+    }
+
+    void armCB(const sensor_msgs::JointState::ConstPtr& joint_meas, unsigned int group)
+    {
+        MeasurementIndex& meas_index = groups_[group].meas_index;
+        if (joint_meas->name != meas_index.names) {
+            meas_index.names = joint_meas->name;
+            meas_index.indices.resize(joint_meas->name.size());
+            for(unsigned int i = 0; i < joint_meas->name.size(); ++i) {
+                std::map<std::string, unsigned int>::const_iterator it_joint = joint_index_.find(joint_meas->name[i]);
+                meas_index.indices[i] = (it_joint != joint_index_.end()) ? (int)it_joint->second : -1;
+            }
+        }
+
+        // With the control thread, the measurements are only handed over; the controller runs at its own rate
+        if (use_control_thread_) {
+            scatterMeasurement(*joint_meas, meas_index, measured_pos_);
+            measurement_buffer_->write(measured_pos_);
+            return;
+        }
+
+        FinishedGoal finished_goal;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            scatterMeasurement(*joint_meas, meas_index, cur_pos_);
+
+            // If no active goal --> Do nothing. When interpolating, the references are published by the timer.
+            if (has_active_goal_ && !interpolate_)
+                controllerCB();
+
+            takeFinishedGoal(finished_goal);
+        }
+        sendGoalResult(finished_goal);
+    }
+
+    // Runs the controller at a fixed rate, on the latest measurements
+    void controlLoop()
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(control_dt_));
+
+        ControlLoopStatistics stats;
+        FinishedGoal finished_goal;
+        Clock::time_point next_tick = Clock::now();
+
+        while (control_running_)
+        {
+            Clock::time_point t_start = Clock::now();
+            stats.jitter.add(std::chrono::duration<double>(t_start - next_tick).count());
+            next_tick += period;
+
+            bool measured = measurement_buffer_->update();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (measured)
+                    cur_pos_ = measurement_buffer_->readBuffer();
+
+                if (interpolate_)
+                    streamReferences();
+                else if (has_active_goal_)
+                    controllerCB();
+
+                takeFinishedGoal(finished_goal);
+                stats.num_dropped_references = num_dropped_references_;
+            }
+            sendGoalResult(finished_goal);
+
+            // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+            // Bookkeeping
+
+            Clock::time_point now = Clock::now();
+            ++stats.num_ticks;
+            stats.max_compute_time = std::max(stats.max_compute_time,
+                                              std::chrono::duration<double>(now - t_start).count());
+
+            // If we overran, start the next tick right away instead of trying to catch up
+            if (now >= next_tick)
+            {
+                ++stats.num_overruns;
+                next_tick = now;
+            }
+
+            statistics_buffer_->write(stats);
+
+            if (next_tick > now)
+                std::this_thread::sleep_until(next_tick);
+        }
+    }
+
+    static void setAffinity(std::thread& thread, int cpu)
+    {
+        if (cpu < 0)
+            return;
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        int error = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpu_set);
+        if (error != 0)
+            ROS_WARN("Could not pin the control thread to CPU %d (error %d)", cpu, error);
+    }
 
-        // If no active goal --> Do nothing
-        if (!has_active_goal_)
+    void statisticsCB(const ros::WallTimerEvent&)
+    {
+        statistics_buffer_->update();
+        const ControlLoopStatistics& stats = statistics_buffer_->readBuffer();
+        if (stats.num_ticks == 0)
             return;
 
-        controllerCB();
+        ROS_INFO("Control loop: %lu ticks, %lu overruns, %lu dropped references, max compute time %.3f ms, jitter: %s",
+                 stats.num_ticks, stats.num_overruns, stats.num_dropped_references, stats.max_compute_time * 1000,
+                 stats.jitter.summary().c_str());
+    }
 
+    // Returns true if any group of the active goal has the given hardware status
+    bool goalGroupHasStatus(unsigned int status) const
+    {
+        for (unsigned int g = 0; g < groups_.size(); ++g) {
+            if (groups_[g].in_goal && groups_[g].status == status)
+                return true;
+        }
+        return false;
+    }
+
+    // Checks the hardware status of the groups of the active goal. Aborts the goal and returns false if it cannot
+    // be reached.
+    bool checkHardwareStatus()
+    {
+        // ToDo: are we happy with this?
+        if ( goalGroupHasStatus(4) ) {
+            ROS_WARN("Hardware is in error, joint trajectory goal cannot be reached, aborting");
+            abortGoal("hardware is in error");
+            return false;
+        } else if ( goalGroupHasStatus(0) ) {
+            ROS_WARN("Hardware is stale, joint trajectory goal cannot be reached, aborting");
+            abortGoal("hardware is stale");
+            return false;
+        } else if ( goalGroupHasStatus(3) ) {
+            ROS_WARN("Hardware is still homing, joint trajectory goal may not be reached");
+        } else if ( goalGroupHasStatus(1) ) {
+            ROS_WARN("Hardware is in idle, joint trajectory goal cannot be reached, aborting");
+            abortGoal("hardware is in idle");
+            return false;
+        }
+        return true;
     }
 
     void controllerCB() {
@@ -265,129 +1263,98 @@ private:
         float abs_error=0.0;
 
         // Check hardware status
-        // ToDo: are we happy with this?
-        if ( arm_status == 2 && torso_status == 2 ) {
-            //ROS_INFO("Hardware status OK");
-        } else if ( arm_status == 4 || torso_status == 4 ) {
-            ROS_WARN("Arm (%u) or torso (%u) is in error, joint trajectory goal cannot be reached, aborting", arm_status, torso_status);
-            active_goal_.setAborted();
-            has_active_goal_=false;
+        if (!checkHardwareStatus())
             return;
-        } else if ( arm_status == 0 || torso_status == 0 ) {
-            ROS_WARN("Arm (%u) or torso (%u) is stale, joint trajectory goal cannot be reached, aborting", arm_status, torso_status);
-            active_goal_.setAborted();
-            has_active_goal_=false;
-            return;
-        } else if ( arm_status == 3 || torso_status == 3 ) {
-            ROS_WARN("Arm (%u) or torso (%u) is still homing, joint trajectory goal may not be reached", arm_status, torso_status);
-        } else if ( arm_status == 1 || torso_status == 1 ) {
-            ROS_WARN("Arm (%u) or torso (%u) is in idle, joint trajectory goal cannot be reached, aborting", arm_status, torso_status);
-            active_goal_.setAborted();
-            has_active_goal_=false;
-            return;
-        }
 
         // Check if the time constraint is not violated
         if(ros::Time::now().toSec() > goal_time_constraint_ + now.toSec())
         {
             ROS_WARN("Aborting because the time constraint was violated");
-            active_goal_.setAborted();
-            has_active_goal_=false;
+            abortGoal("time constraint violated");
             return;
         }
 
-        ///ROS_INFO("Number of joints received goal = %i",active_goal_.getGoal()->trajectory.joint_names.size());
-        ///for (uint ii = 0; ii < active_goal_.getGoal()->trajectory.joint_names.size(); ii++) ROS_INFO("Joint name = %s",active_goal_.getGoal()->trajectory.joint_names[ii].c_str());
+        const trajectory_msgs::JointTrajectory& trajectory = active_goal_msg_->trajectory;
+        const std::vector<double>& ref_positions = trajectory.points[current_point].positions;
 
-        for (unsigned int i = 0; i < active_goal_.getGoal()->trajectory.joint_names.size(); i++) {
-            std::string joint_name = active_goal_.getGoal()->trajectory.joint_names[i];
+        // Scatter the references into the messages of their groups
+        for (unsigned int i = 0; i < number_of_goal_joints_; i++) {
+            unsigned int k = goal_joint_indices_[i];
+            ref_pos_[k] = ref_positions[i]; // Required to push reference
+            groups_[joint_group_[k]].msg.position[joint_group_slot_[k]] = ref_positions[i];
+        }
+
+        recordTrackingErrors();
+
+        for (unsigned int i = 0; i < number_of_goal_joints_; i++) {
+            unsigned int k = goal_joint_indices_[i];
 
             // Compute absolute error
-            double ref_pos = active_goal_.getGoal()->trajectory.points[current_point].positions[i];
-            ref_pos_[joint_name] = ref_pos; // Required to push reference
-            double cur_pos = cur_pos_[joint_name];
-            abs_error = fabs(ref_pos - cur_pos);
-            //ROS_DEBUG("%s: r: %f\t q: %f\t e: %f",joint_name.c_str(), ref_pos_[joint_name], cur_pos_[joint_name], abs_error);
+            abs_error = fabs(goal_errors_[i]);
+            //ROS_DEBUG("%s: r: %f\t q: %f\t e: %f",joint_names_[k].c_str(), ref_pos_[k], cur_pos_[k], abs_error);
 
             // Check trajectory constraint
-            if(abs_error > trajectory_constraints_[joint_name]) {
-                ROS_WARN("Aborting because the trajectory constraint of %s (%f) was violated (%f)", joint_name.c_str(), trajectory_constraints_[joint_name], abs_error);
-                active_goal_.setAborted();
-                has_active_goal_=false;
+            if(abs_error > trajectory_constraints_[k]) {
+                ROS_WARN("Aborting because the trajectory constraint of %s (%f) was violated (%f)", joint_names_[k].c_str(), trajectory_constraints_[k], abs_error);
+                abortGoal("trajectory constraint of " + joint_names_[k] + " violated");
                 return;
             }
 
             // Check if this joint has converged
-            if(current_point < ((int)active_goal_.getGoal()->trajectory.points.size()-1))
+            if(current_point < ((int)trajectory.points.size()-1))
             {
-                if(abs_error < intermediate_goal_constraints_[joint_name])
+                if(abs_error < intermediate_goal_constraints_[k])
                 {
-                    //ROS_DEBUG("intermediate goal constraints for %s converged", joint_name.c_str());
+                    //ROS_DEBUG("intermediate goal constraints for %s converged", joint_names_[k].c_str());
                     converged_joints += 1;
                 }
             }
             else
             {
-                if(abs_error < final_goal_constraints_[joint_name])
+                if(abs_error < final_goal_constraints_[k])
                 {
-                    //ROS_DEBUG("final goal constraints for %s converged", joint_name.c_str());
+                    //ROS_DEBUG("final goal constraints for %s converged", joint_names_[k].c_str());
                     converged_joints += 1;
                 }
             }
 
         }
 
-        // Joint trajectory action should work for both seven (old situation, only arm) and eight (new situation, incl torso) joints
-
-        // Only publish torso if requested
-        if( number_of_goal_joints_ > 7) {
-            sensor_msgs::JointState torso_msg;
-            for (unsigned int i = 0; i < nr_torso_joints_; i++) {
-                torso_msg.name.push_back(joint_names_[i]);
-                torso_msg.position.push_back(ref_pos_[joint_names_[i]]);
-            }
-            torso_pub.publish(torso_msg);
-        }
-
-        // Always publish arm msg
-        sensor_msgs::JointState arm_msg;
-        for (unsigned int i = 0; i < 7; i++) {
-            arm_msg.name.push_back(joint_names_[i+nr_torso_joints_]);
-            arm_msg.position.push_back(ref_pos_[joint_names_[i+nr_torso_joints_]]);
-        }
-        pub.publish(arm_msg);
+        // Only publish the groups that are part of the goal
+        publishGoalGroups();
 
         //if(converged_joints==(int)number_of_goal_joints_)
         if (converged_joints==(int)number_of_goal_joints_)
         {
             now = ros::Time::now();
             current_point = current_point + 1;
+            tracking_stats_.addWaypoint(now.toSec());
             ROS_INFO("every joint has converged, go to the next point");
         }
 
-        if(current_point==(int)active_goal_.getGoal()->trajectory.points.size())
+        if(current_point==(int)trajectory.points.size())
         {
             ROS_INFO("active goal succeeded");
-            active_goal_.setSucceeded();
-            has_active_goal_ = false;
+            finishGoal(GOAL_SUCCEEDED);
         }
 
-        ROS_DEBUG("Converged joints = %i of %i, current_point = %i of %i", converged_joints, (int)number_of_goal_joints_, current_point, (int)active_goal_.getGoal()->trajectory.points.size());
+        ROS_DEBUG("Converged joints = %i of %i, current_point = %i of %i", converged_joints, (int)number_of_goal_joints_, current_point, (int)trajectory.points.size());
     }
 
     void diagnosticsCB(const diagnostic_msgs::DiagnosticArray& diag_array) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
         // Only process data if there is an active goal
         if (has_active_goal_) {
             // Loop through message
             for (unsigned int i = 0; i < diag_array.status.size(); i++ ) {
-                // Check if there is a torso or an arm status status
-                if (diag_array.status[i].name == torso_diag_name) {
-                    torso_status = diag_array.status[i].level;
-                } else if (diag_array.status[i].name == arm_diag_name) {
-                    arm_status = diag_array.status[i].level;
+                // Check if there is a status of one of the groups
+                for (unsigned int g = 0; g < groups_.size(); ++g) {
+                    if (!groups_[g].diagnostics_name.empty() && diag_array.status[i].name == groups_[g].diagnostics_name) {
+                        groups_[g].status = diag_array.status[i].level;
+                    }
                 }
             }
-            //ROS_INFO("Arm status %s = %u, torso status %s = %u", arm_diag_name.c_str(), arm_status, torso_diag_name.c_str(), torso_status);
         }
     }
 
@@ -404,5 +1371,3 @@ int main(int argc, char** argv)
 
     return 0;
 }
-
-
@@ -0,0 +1,81 @@
+#include "tue/manipulation/latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram(double min_latency, double max_latency, unsigned int buckets_per_decade)
+    : log_min_(std::log10(min_latency)), buckets_per_decade_(buckets_per_decade),
+      buckets_(std::max(1.0, std::ceil((std::log10(max_latency) - log_min_) * buckets_per_decade)) + 1, 0)
+{
+    clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void LatencyHistogram::add(double latency)
+{
+    int i = 0;
+    if (latency > 0)
+        i = std::ceil((std::log10(latency) - log_min_) * buckets_per_decade_);
+
+    i = std::max(0, std::min<int>(i, buckets_.size() - 1));
+    ++buckets_[i];
+
+    ++count_;
+    sum_ += latency;
+    min_ = std::min(min_, latency);
+    max_ = std::max(max_, latency);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void LatencyHistogram::clear()
+{
+    std::fill(buckets_.begin(), buckets_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    min_ = 1e100;
+    max_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double LatencyHistogram::percentile(double fraction) const
+{
+    if (count_ == 0)
+        return 0;
+
+    unsigned long n = std::ceil(fraction * count_);
+    unsigned long total = 0;
+    for(unsigned int i = 0; i < buckets_.size(); ++i)
+    {
+        total += buckets_[i];
+        if (total >= n)
+            return std::min(max_, std::pow(10, log_min_ + i / buckets_per_decade_));
+    }
+
+    return max_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string LatencyHistogram::summary() const
+{
+    std::stringstream s;
+    s << "n = " << count_ << ", mean = " << 1000 * mean() << " ms, p50 = " << 1000 * percentile(0.5)
+      << " ms, p90 = " << 1000 * percentile(0.9) << " ms, p99 = " << 1000 * percentile(0.99)
+      << " ms, max = " << 1000 * max() << " ms";
+    return s.str();
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
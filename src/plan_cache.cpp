@@ -0,0 +1,396 @@
+#include "tue/manipulation/plan_cache.h"
+#include "tue/manipulation/chain_model.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+const char PLAN_CACHE_MAGIC[4] = { 'T', 'P', 'L', 'C' };
+
+// magic + version + context checksum + payload checksum + payload size
+const size_t PLAN_CACHE_HEADER_SIZE = 4 + 4 + 8 + 8 + 4;
+
+// ----------------------------------------------------------------------------------------------------
+
+template<typename T>
+void write(std::string& out, const T& value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::string& out, const std::string& s)
+{
+    write<uint32_t>(out, s.size());
+    out.append(s);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+class CacheReader
+{
+
+public:
+
+    CacheReader(const char* data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+    template<typename T>
+    bool read(T& value)
+    {
+        if (pos_ + sizeof(T) > size_)
+            return false;
+        memcpy(&value, data_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    // Reads a uint32 size followed by that many values
+    template<typename T>
+    bool readArray(std::vector<T>& values)
+    {
+        uint32_t n;
+        if (!read(n) || pos_ + n * sizeof(T) > size_)
+            return false;
+        values.resize(n);
+        for(unsigned int i = 0; i < n; ++i)
+            read(values[i]);
+        return true;
+    }
+
+    bool readString(std::string& s)
+    {
+        uint32_t length;
+        if (!read(length) || pos_ + length > size_)
+            return false;
+        s.assign(data_ + pos_, length);
+        pos_ += length;
+        return true;
+    }
+
+    bool atEnd() const { return pos_ == size_; }
+
+private:
+
+    const char* data_;
+    size_t size_;
+    size_t pos_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readPlan(CacheReader& r, CachedPlan& plan)
+{
+    if (!r.readArray(plan.tag))
+        return false;
+
+    uint32_t num_joints, num_points;
+    if (!r.read(num_joints))
+        return false;
+
+    plan.joint_names.resize(num_joints);
+    for(unsigned int i = 0; i < num_joints; ++i)
+    {
+        if (!r.readString(plan.joint_names[i]))
+            return false;
+    }
+
+    if (!r.read(num_points))
+        return false;
+
+    plan.times.resize(num_points);
+    plan.positions.resize(num_points, std::vector<double>(num_joints));
+    plan.velocities.resize(num_points, std::vector<double>(num_joints));
+    for(unsigned int i = 0; i < num_points; ++i)
+    {
+        if (!r.read(plan.times[i]))
+            return false;
+
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            if (!r.read(plan.positions[i][j]))
+                return false;
+        }
+
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            if (!r.read(plan.velocities[i][j]))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+void appendToKey(const std::vector<double>& values, double resolution, PlanCacheKey& key)
+{
+    for(std::vector<double>::const_iterator it = values.begin(); it != values.end(); ++it)
+        key.push_back(static_cast<int32_t>(std::floor(*it / resolution + 0.5)));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+PlanCache::PlanCache(unsigned int capacity) : capacity_(capacity)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PlanCache::setCapacity(unsigned int capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    evict();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+unsigned int PlanCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool PlanCache::get(const PlanCacheKey& key, CachedPlan& plan)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<PlanCacheKey, std::list<Entry>::iterator>::iterator it = index_.find(key);
+    if (it == index_.end())
+        return false;
+
+    // Move to the front (most recently used)
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+    plan = it->second->second;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PlanCache::put(const PlanCacheKey& key, const CachedPlan& plan)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<PlanCacheKey, std::list<Entry>::iterator>::iterator it = index_.find(key);
+    if (it != index_.end())
+    {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        it->second->second = plan;
+        return;
+    }
+
+    entries_.push_front(Entry(key, plan));
+    index_[key] = entries_.begin();
+    evict();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PlanCache::remove(const PlanCacheKey& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::map<PlanCacheKey, std::list<Entry>::iterator>::iterator it = index_.find(key);
+    if (it == index_.end())
+        return;
+
+    entries_.erase(it->second);
+    index_.erase(it);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PlanCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void PlanCache::evict()
+{
+    while (entries_.size() > capacity_)
+    {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool PlanCache::save(const std::string& filename, uint64_t context_checksum, std::string& error) const
+{
+    std::string payload;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        write<uint32_t>(payload, entries_.size());
+        for(std::list<Entry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            const PlanCacheKey& key = it->first;
+            const CachedPlan& plan = it->second;
+
+            write<uint32_t>(payload, key.size());
+            for(unsigned int i = 0; i < key.size(); ++i)
+                write<int32_t>(payload, key[i]);
+
+            write<uint32_t>(payload, plan.tag.size());
+            for(unsigned int i = 0; i < plan.tag.size(); ++i)
+                write<double>(payload, plan.tag[i]);
+
+            unsigned int num_joints = plan.joint_names.size();
+            write<uint32_t>(payload, num_joints);
+            for(unsigned int i = 0; i < num_joints; ++i)
+                writeString(payload, plan.joint_names[i]);
+
+            write<uint32_t>(payload, plan.times.size());
+            for(unsigned int i = 0; i < plan.times.size(); ++i)
+            {
+                write<double>(payload, plan.times[i]);
+                for(unsigned int j = 0; j < num_joints; ++j)
+                    write<double>(payload, plan.positions[i][j]);
+                for(unsigned int j = 0; j < num_joints; ++j)
+                    write<double>(payload, plan.velocities[i][j]);
+            }
+        }
+    }
+
+    std::string data;
+    data.reserve(PLAN_CACHE_HEADER_SIZE + payload.size());
+    data.append(PLAN_CACHE_MAGIC, 4);
+    write<uint32_t>(data, PLAN_CACHE_VERSION);
+    write<uint64_t>(data, context_checksum);
+    write<uint64_t>(data, fnv1aHash(payload.data(), payload.size()));
+    write<uint32_t>(data, payload.size());
+    data.append(payload);
+
+    // Write to a temporary file first, such that a crash never leaves a half-written cache behind
+    std::string tmp_filename = filename + ".tmp";
+    {
+        std::ofstream f(tmp_filename.c_str(), std::ios::binary | std::ios::trunc);
+        if (!f || !f.write(data.data(), data.size()))
+        {
+            error += "Could not write plan cache '" + tmp_filename + "'.";
+            return false;
+        }
+    }
+
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+        error += "Could not replace plan cache '" + filename + "'.";
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool PlanCache::load(const std::string& filename, uint64_t context_checksum, std::string& error)
+{
+    std::ifstream f(filename.c_str(), std::ios::binary);
+    if (!f)
+    {
+        error += "Could not open plan cache '" + filename + "'.";
+        return false;
+    }
+
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    if (data.size() < PLAN_CACHE_HEADER_SIZE || memcmp(data.data(), PLAN_CACHE_MAGIC, 4) != 0)
+    {
+        error += "Not a plan cache";
+        return false;
+    }
+
+    CacheReader header(data.data() + 4, PLAN_CACHE_HEADER_SIZE - 4);
+
+    uint32_t version, payload_size;
+    uint64_t file_context_checksum, payload_checksum;
+    header.read(version);
+    header.read(file_context_checksum);
+    header.read(payload_checksum);
+    header.read(payload_size);
+
+    if (version != PLAN_CACHE_VERSION)
+    {
+        std::stringstream s;
+        s << "Unsupported plan cache version " << version << " (expected " << PLAN_CACHE_VERSION << ")";
+        error += s.str();
+        return false;
+    }
+
+    if (file_context_checksum != context_checksum)
+    {
+        error += "Plan cache was created for a different context";
+        return false;
+    }
+
+    const char* payload = data.data() + PLAN_CACHE_HEADER_SIZE;
+    if (payload_size != data.size() - PLAN_CACHE_HEADER_SIZE || fnv1aHash(payload, payload_size) != payload_checksum)
+    {
+        error += "Plan cache is corrupt";
+        return false;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    CacheReader r(payload, payload_size);
+
+    uint32_t num_entries;
+    if (!r.read(num_entries))
+    {
+        error += "Plan cache is truncated";
+        return false;
+    }
+
+    std::list<Entry> entries;
+    for(unsigned int i = 0; i < num_entries; ++i)
+    {
+        entries.push_back(Entry());
+        if (!r.readArray(entries.back().first) || !readPlan(r, entries.back().second))
+        {
+            error += "Plan cache is truncated";
+            return false;
+        }
+    }
+
+    if (!r.atEnd())
+    {
+        error += "Plan cache contains trailing data";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    entries_.swap(entries);
+    index_.clear();
+    for(std::list<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it)
+        index_[it->first] = it;
+
+    evict();
+    return true;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
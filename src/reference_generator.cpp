@@ -1,4 +1,9 @@
 #include "tue/manipulation/reference_generator.h"
+#include "tue/manipulation/time_optimal_parameterization.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
 
 namespace tue
 {
@@ -85,9 +90,33 @@ void interpolateCubic(trajectory_msgs::JointTrajectoryPoint& p_out,
     p_out.time_from_start = ros::Duration(t_abs);
 }
 
+namespace
+{
+
+// Used to determine the duration of goals that are replaced by their time-optimal parameterization
+const double SIMULATION_TIME_STEP = 0.01;
+const double MAX_SIMULATION_TIME = 600;
+
+// A joint moving slower than this is at rest [rad/s], and a time-optimal trajectory only starts from a joint within
+// this distance of its start position [rad]
+const double REST_VELOCITY = 1e-6;
+const double REST_POSITION_TOLERANCE = 1e-9;
+
+// A sample of a time-optimal trajectory within this distance of a waypoint is taken as that waypoint [rad]
+const double WAYPOINT_MATCH_TOLERANCE = 1e-6;
+
+void setAllPointsAsWaypoints(JointGoal& goal)
+{
+    goal.waypoint_indices.resize(goal.goal_msg.trajectory.points.size());
+    for(unsigned int i = 0; i < goal.waypoint_indices.size(); ++i)
+        goal.waypoint_indices[i] = i;
+}
+
+}
+
 // ----------------------------------------------------------------------------------------------------
 
-ReferenceGenerator::ReferenceGenerator() : next_goal_id_(0)
+ReferenceGenerator::ReferenceGenerator() : next_goal_id_(0), time_optimal_(false), path_resolution_(0.01)
 {
     visualize_ = false;
 
@@ -195,24 +224,29 @@ bool ReferenceGenerator::resetJointState(const std::string& joint_name, double p
 
 bool ReferenceGenerator::setGoal(const control_msgs::FollowJointTrajectoryGoal& goal_msg, std::string& id, std::stringstream& ss)
 {
-    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // The time-optimal parameterization starts from the current positions, if all joints of the goal are at rest
+    std::vector<double> start_positions;
+    for(unsigned int i = 0; i < joint_info_.size() && time_optimal_; ++i)
+        start_positions.push_back(joint_info_[i].position());
 
-    if (id.empty())
+    for(unsigned int i = 0; i < goal_msg.trajectory.joint_names.size(); ++i)
     {
-        std::stringstream s;
-        s << "goal-" << (next_goal_id_++);
-        id = s.str();
+        int idx = joint_index(goal_msg.trajectory.joint_names[i]);
+        if (idx >= 0 && std::abs(joint_info_[idx].velocity()) > REST_VELOCITY)
+            start_positions.clear();
     }
 
-    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    JointGoal goal;
+    return prepareGoal(goal_msg, start_positions, goal, ss) && setGoal(goal, id, ss);
+}
 
-    if (goals_.find(id) != goals_.end())
-    {
-        ss << "Goal with id '" << id << " already exists.\n";
-        return false;
-    }
+// ----------------------------------------------------------------------------------------------------
 
-    JointGoal& goal = goals_[id];
+bool ReferenceGenerator::prepareGoal(const control_msgs::FollowJointTrajectoryGoal& goal_msg,
+                                     const std::vector<double>& start_positions, JointGoal& goal,
+                                     std::stringstream& ss) const
+{
+    goal = JointGoal();
     goal.goal_msg = goal_msg;
     goal.num_goal_joints = goal_msg.trajectory.joint_names.size();
     goal.joint_index_mapping.resize(goal.num_goal_joints);
@@ -220,8 +254,6 @@ bool ReferenceGenerator::setGoal(const control_msgs::FollowJointTrajectoryGoal&
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // Check feasibility of joint goals
 
-    std::set<std::string> goals_to_cancel;
-
     bool goal_ok = true;
     for (unsigned int i = 0; i < goal.num_goal_joints; ++i)
     {
@@ -238,15 +270,6 @@ bool ReferenceGenerator::setGoal(const control_msgs::FollowJointTrajectoryGoal&
 
         const JointInfo& js = joint_info_[idx];
 
-        if (!js.goal_id.empty())
-            goals_to_cancel.insert(js.goal_id);
-
-        if (!js.is_set)
-        {
-            ss << "Joint '" << joint_name << "' initial position and velocity is not set.\n";
-            goal_ok = false;
-        }
-
         if (js.max_vel == 0 || js.max_acc == 0 || (js.min_pos == js.max_pos))
         {
             ss << "Joint '" << joint_name << "' limits not initialized: "
@@ -259,10 +282,7 @@ bool ReferenceGenerator::setGoal(const control_msgs::FollowJointTrajectoryGoal&
     }
 
     if (!goal_ok)
-    {
-        goals_.erase(id);
         return false;
-    }
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // Check if joint goals go out of limits
@@ -286,14 +306,76 @@ bool ReferenceGenerator::setGoal(const control_msgs::FollowJointTrajectoryGoal&
         }
     }
 
+    if (!goal_ok)
+        return false;
+
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    if (!goal_ok)
+    goal.sub_goal_idx = -1;
+    goal.time_since_start = 0;
+    goal.use_cubic_interpolation = false;
+    setAllPointsAsWaypoints(goal);
+
+    if (time_optimal_ && start_positions.size() == joint_info_.size())
+        applyTimeOptimalParameterization(goal, start_positions);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ReferenceGenerator::setGoal(JointGoal& goal, std::string& id, std::stringstream& ss)
+{
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    if (id.empty())
     {
-        goals_.erase(id);
+        std::stringstream s;
+        s << "goal-" << (next_goal_id_++);
+        id = s.str();
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    if (goals_.find(id) != goals_.end())
+    {
+        ss << "Goal with id '" << id << " already exists.\n";
         return false;
     }
 
+    std::set<std::string> goals_to_cancel;
+
+    bool goal_ok = true;
+    for (unsigned int i = 0; i < goal.num_goal_joints; ++i)
+    {
+        const JointInfo& js = joint_info_[goal.joint_index_mapping[i]];
+
+        if (!js.goal_id.empty())
+            goals_to_cancel.insert(js.goal_id);
+
+        if (!js.is_set)
+        {
+            ss << "Joint '" << goal.goal_msg.trajectory.joint_names[i] << "' initial position and velocity is not set.\n";
+            goal_ok = false;
+        }
+
+        // The time-optimal trajectory only holds if the joints are still at rest where it starts; otherwise the
+        // original waypoints are followed
+        if (goal.time_optimal && (std::abs(js.velocity()) > REST_VELOCITY
+                                  || std::abs(js.position() - goal.start_positions[i]) > REST_POSITION_TOLERANCE))
+        {
+            goal.goal_msg.trajectory.points.swap(goal.original_points);
+            goal.original_points.clear();
+            goal.start_positions.clear();
+            goal.time_optimal = false;
+            goal.duration = 0;
+            setAllPointsAsWaypoints(goal);
+        }
+    }
+
+    if (!goal_ok)
+        return false;
+
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
     // Cancel overlapping goals
@@ -306,15 +388,143 @@ bool ReferenceGenerator::setGoal(const control_msgs::FollowJointTrajectoryGoal&
     for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
         joint_info_[goal.joint_index_mapping[i]].goal_id = id;
 
-    goal.sub_goal_idx = -1;
-    goal.time_since_start = 0;
-    goal.use_cubic_interpolation = false;
+    goals_[id] = std::move(goal);
 
     return true;
 }
 
 // ----------------------------------------------------------------------------------------------------
 
+void ReferenceGenerator::applyTimeOptimalParameterization(JointGoal& goal,
+                                                          const std::vector<double>& start_positions) const
+{
+    std::vector<trajectory_msgs::JointTrajectoryPoint>& points = goal.goal_msg.trajectory.points;
+
+    // Respect trajectories that already specify how to move through the waypoints
+    for(unsigned int i = 0; i < points.size(); ++i)
+    {
+        if (!points[i].velocities.empty())
+            return;
+    }
+
+    std::vector<double> max_vel(goal.num_goal_joints), max_acc(goal.num_goal_joints);
+    std::vector<std::vector<double> > waypoints(1, std::vector<double>(goal.num_goal_joints));
+
+    for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
+    {
+        unsigned int idx = goal.joint_index_mapping[i];
+        const JointInfo& js = joint_info_[idx];
+
+        // The parameterization starts at rest
+        waypoints[0][i] = start_positions[idx];
+        max_vel[i] = js.max_vel;
+        max_acc[i] = js.max_acc;
+    }
+
+    for(unsigned int i = 0; i < points.size(); ++i)
+        waypoints.push_back(points[i].positions);
+
+    TimeParameterizedPath path;
+    std::string error;
+    if (!parameterizeTimeOptimal(waypoints, max_vel, max_acc, path_resolution_, path, error))
+        return;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Replace the waypoints by the time-stamped trajectory. The first point is the start position, from
+    // which the cubic interpolation starts. The original waypoints are kept for getGoalDurations.
+
+    goal.start_positions = waypoints[0];
+    goal.original_points.swap(points);
+
+    points.resize(path.times.size());
+    for(unsigned int i = 0; i < path.times.size(); ++i)
+    {
+        trajectory_msgs::JointTrajectoryPoint& p = points[i];
+        p.positions = path.positions[i];
+        p.velocities = path.velocities[i];
+        p.accelerations.clear();
+        p.time_from_start = ros::Duration(path.times[i]);
+    }
+
+    // The path passes the waypoints in order, each at one of its samples. Take the first sample at the waypoint,
+    // or the closest one if none is within the tolerance.
+    goal.waypoint_indices.resize(goal.original_points.size());
+    unsigned int first = 0;
+    for(unsigned int k = 0; k < goal.original_points.size(); ++k)
+    {
+        const std::vector<double>& waypoint = goal.original_points[k].positions;
+        unsigned int best = first;
+        double best_dist = std::numeric_limits<double>::infinity();
+        for(unsigned int i = first; i < points.size(); ++i)
+        {
+            double dist = 0;
+            for(unsigned int j = 0; j < goal.num_goal_joints; ++j)
+                dist = std::max(dist, std::abs(points[i].positions[j] - waypoint[j]));
+
+            if (dist < best_dist)
+            {
+                best = i;
+                best_dist = dist;
+            }
+            if (dist < WAYPOINT_MATCH_TOLERANCE)
+                break;
+        }
+        goal.waypoint_indices[k] = best;
+        first = best;
+    }
+
+    goal.time_optimal = true;
+    goal.duration = path.duration();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double ReferenceGenerator::simulateNominalDuration(const JointGoal& goal) const
+{
+    ReferenceGenerator sim;
+    for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
+    {
+        const std::string& name = goal.goal_msg.trajectory.joint_names[i];
+        const JointInfo& js = joint_info_[goal.joint_index_mapping[i]];
+        sim.initJoint(name, js.max_vel, js.max_acc, js.min_pos, js.max_pos);
+        sim.setJointState(name, goal.start_positions[i], 0);
+    }
+
+    control_msgs::FollowJointTrajectoryGoal goal_msg;
+    goal_msg.trajectory.joint_names = goal.goal_msg.trajectory.joint_names;
+    goal_msg.trajectory.points = goal.original_points;
+
+    std::string sim_id;
+    std::stringstream sim_error;
+    double nominal_duration = 0;
+    if (sim.setGoal(goal_msg, sim_id, sim_error))
+    {
+        std::vector<double> references;
+        while (sim.isActiveGoal(sim_id) && nominal_duration < MAX_SIMULATION_TIME)
+        {
+            sim.calculatePositionReferences(SIMULATION_TIME_STEP, references);
+            nominal_duration += SIMULATION_TIME_STEP;
+        }
+    }
+
+    return nominal_duration;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ReferenceGenerator::getGoalDurations(const std::string& id, double& nominal_duration, double& duration) const
+{
+    std::map<std::string, JointGoal>::const_iterator it = goals_.find(id);
+    if (it == goals_.end() || !it->second.time_optimal)
+        return false;
+
+    nominal_duration = simulateNominalDuration(it->second);
+    duration = it->second.duration;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 bool ReferenceGenerator::setGoal(const std::string& joint_name, double position, JointGoalInfo& info)
 {
     control_msgs::FollowJointTrajectoryGoal goal_msg;
@@ -383,6 +593,181 @@ void ReferenceGenerator::cancelGoal(const std::string& id, JointGoalStatus joint
 
 // ----------------------------------------------------------------------------------------------------
 
+void ReferenceGenerator::removeGoal(const std::string& id)
+{
+    // Only active goals own their joints
+    if (isActiveGoal(id))
+        cancelGoal(id);
+    goals_.erase(id);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ReferenceGenerator::spliceGoal(const std::string& id, const control_msgs::FollowJointTrajectoryGoal& goal_msg,
+                                    double delay, std::stringstream& ss)
+{
+    std::map<std::string, JointGoal>::iterator it = goals_.find(id);
+    if (it == goals_.end() || it->second.status != JOINT_GOAL_ACTIVE)
+    {
+        ss << "Goal '" << id << "' is not active.\n";
+        return false;
+    }
+
+    JointGoal& goal = it->second;
+    std::vector<trajectory_msgs::JointTrajectoryPoint>& points = goal.goal_msg.trajectory.points;
+
+    if (!goal.use_cubic_interpolation)
+    {
+        ss << "Goal '" << id << "' is not following timed points.\n";
+        return false;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Map the joints of the new trajectory onto those of the goal
+
+    const trajectory_msgs::JointTrajectory& trajectory = goal_msg.trajectory;
+    if (trajectory.joint_names.size() != goal.num_goal_joints)
+    {
+        ss << "The new trajectory has " << trajectory.joint_names.size() << " joints, but the goal has "
+           << goal.num_goal_joints << ".\n";
+        return false;
+    }
+
+    std::vector<unsigned int> goal_index(goal.num_goal_joints);
+    for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
+    {
+        int idx = joint_index(trajectory.joint_names[i]);
+        std::vector<unsigned int>::const_iterator it_joint = std::find(goal.joint_index_mapping.begin(),
+                                                                       goal.joint_index_mapping.end(), idx);
+        if (idx < 0 || it_joint == goal.joint_index_mapping.end())
+        {
+            ss << "Joint '" << trajectory.joint_names[i] << "' is not part of the goal.\n";
+            return false;
+        }
+        goal_index[i] = it_joint - goal.joint_index_mapping.begin();
+    }
+
+    for(unsigned int i = 0; i < trajectory.points.size(); ++i)
+    {
+        const trajectory_msgs::JointTrajectoryPoint& p = trajectory.points[i];
+        if (p.positions.size() != goal.num_goal_joints || p.velocities.size() != goal.num_goal_joints)
+        {
+            ss << "Point " << i << " of the new trajectory does not have a position and velocity for every joint.\n";
+            return false;
+        }
+
+        for(unsigned int j = 0; j < goal.num_goal_joints; ++j)
+        {
+            const JointInfo& js = joint_info_[goal.joint_index_mapping[goal_index[j]]];
+            if (p.positions[j] < js.min_pos || p.positions[j] > js.max_pos)
+            {
+                ss << "Joint '" << trajectory.joint_names[j] << "' goes out of limits in point " << i << " "
+                   << "(min = " << js.min_pos << ", max = " << js.max_pos << ", requested goal = " << p.positions[j] << ").\n";
+                return false;
+            }
+        }
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Cut the goal at the splice time, at which the new trajectory starts
+
+    double t_splice = goal.time_since_start + std::max(0.0, delay);
+
+    unsigned int num_new_points = 0;
+    for(unsigned int i = 0; i < trajectory.points.size(); ++i)
+    {
+        if (trajectory.points[i].time_from_start.toSec() > 0)
+            ++num_new_points;
+    }
+
+    if (num_new_points == 0)
+    {
+        ss << "The new trajectory has no points after its start.\n";
+        return false;
+    }
+
+    if (t_splice < points.back().time_from_start.toSec())
+    {
+        // First point after the splice time. The point the goal is currently moving to is at or before it, since
+        // the current time lies before both.
+        unsigned int m = 0;
+        while (points[m].time_from_start.toSec() <= t_splice)
+            ++m;
+
+        trajectory_msgs::JointTrajectoryPoint p_splice;
+        interpolateCubic(p_splice, points[m - 1], points[m], t_splice);
+        p_splice.accelerations.clear();
+        p_splice.time_from_start = ros::Duration(t_splice);
+
+        points.resize(m);
+        if (t_splice > points[m - 1].time_from_start.toSec())
+            points.push_back(p_splice);
+
+        while (!goal.waypoint_indices.empty() && goal.waypoint_indices.back() >= m)
+            goal.waypoint_indices.pop_back();
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Append the new points, in the joint order of the goal
+
+    for(unsigned int i = 0; i < trajectory.points.size(); ++i)
+    {
+        const trajectory_msgs::JointTrajectoryPoint& p_new = trajectory.points[i];
+        if (p_new.time_from_start.toSec() <= 0)
+            continue;
+
+        goal.waypoint_indices.push_back(points.size());
+        points.push_back(trajectory_msgs::JointTrajectoryPoint());
+        trajectory_msgs::JointTrajectoryPoint& p = points.back();
+        p.positions.resize(goal.num_goal_joints);
+        p.velocities.resize(goal.num_goal_joints);
+        for(unsigned int j = 0; j < goal.num_goal_joints; ++j)
+        {
+            p.positions[goal_index[j]] = p_new.positions[j];
+            p.velocities[goal_index[j]] = p_new.velocities[j];
+        }
+        p.time_from_start = ros::Duration(t_splice + p_new.time_from_start.toSec());
+    }
+
+    if (goal.time_optimal)
+        goal.duration = points.back().time_from_start.toSec();
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ReferenceGenerator::getRemainingTime(const std::string& id, double& remaining_time) const
+{
+    std::map<std::string, JointGoal>::const_iterator it = goals_.find(id);
+    if (it == goals_.end() || it->second.status != JOINT_GOAL_ACTIVE || !it->second.use_cubic_interpolation)
+        return false;
+
+    const JointGoal& goal = it->second;
+    remaining_time = std::max(0.0, goal.goal_msg.trajectory.points.back().time_from_start.toSec() - goal.time_since_start);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ReferenceGenerator::getNumPassedWaypoints(const std::string& id, unsigned int& num_passed) const
+{
+    std::map<std::string, JointGoal>::const_iterator it = goals_.find(id);
+    if (it == goals_.end())
+        return false;
+
+    // All points before the one the goal is moving to have been passed, and all points of a finished goal
+    const JointGoal& goal = it->second;
+    unsigned int num_passed_points = goal.status == JOINT_GOAL_SUCCEEDED ? goal.goal_msg.trajectory.points.size()
+                                                                         : std::max(0, goal.sub_goal_idx);
+
+    num_passed = std::lower_bound(goal.waypoint_indices.begin(), goal.waypoint_indices.end(), num_passed_points)
+            - goal.waypoint_indices.begin();
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 bool ReferenceGenerator::calculatePositionReferencesInternal(JointGoal& goal, double dt)
 {
     time_ += dt;
@@ -437,6 +822,14 @@ bool ReferenceGenerator::calculatePositionReferencesInternal(JointGoal& goal, do
             for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
                 joint_info_[goal.joint_index_mapping[i]].goal_id.clear();
 
+            // The last interpolation step may have ended just before the final point, so end exactly in it
+            if (goal.use_cubic_interpolation)
+            {
+                const trajectory_msgs::JointTrajectoryPoint& p_final = goal.goal_msg.trajectory.points.back();
+                for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
+                    joint_info_[goal.joint_index_mapping[i]].interpolator.setState(p_final.positions[i], p_final.velocities[i]);
+            }
+
 //            std::cout << "Goal reached in " << goal.time_since_start << " seconds" << std::endl;
 
             goal.status = JOINT_GOAL_SUCCEEDED;
@@ -452,8 +845,22 @@ bool ReferenceGenerator::calculatePositionReferencesInternal(JointGoal& goal, do
                 && goal.goal_msg.trajectory.points[goal.sub_goal_idx - 1].velocities.size() == goal.num_goal_joints
                 && (sub_goal.time_from_start - goal.goal_msg.trajectory.points[goal.sub_goal_idx - 1].time_from_start).toSec() > 0)
         {
+            // When continuing from a previous cubic segment, keep the time that has passed since its end, such that
+            // dense trajectories are not slowed down by a time step per point
+            if (!goal.use_cubic_interpolation)
+                goal.time_since_start = goal.goal_msg.trajectory.points[goal.sub_goal_idx - 1].time_from_start.toSec();
+
             goal.use_cubic_interpolation = true;
-            goal.time_since_start = goal.goal_msg.trajectory.points[goal.sub_goal_idx - 1].time_from_start.toSec();
+
+            // Skip the points that were already passed within the last time step
+            const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = goal.goal_msg.trajectory.points;
+            while (goal.sub_goal_idx + 1 < points.size()
+                   && goal.time_since_start >= points[goal.sub_goal_idx].time_from_start.toSec()
+                   && points[goal.sub_goal_idx + 1].velocities.size() == goal.num_goal_joints
+                   && (points[goal.sub_goal_idx + 1].time_from_start - points[goal.sub_goal_idx].time_from_start).toSec() > 0)
+            {
+                ++goal.sub_goal_idx;
+            }
         }
         else
         {
@@ -573,8 +980,11 @@ bool ReferenceGenerator::calculatePositionReferencesInternal(JointGoal& goal, do
     {
         const trajectory_msgs::JointTrajectoryPoint& prev_sub_goal = goal.goal_msg.trajectory.points[goal.sub_goal_idx - 1];
 
+        // The time may have passed the sub goal if it could not be skipped, e.g. because it is the last point. Do not
+        // extrapolate the segment beyond it.
         trajectory_msgs::JointTrajectoryPoint p_interpolated;
-        interpolateCubic(p_interpolated, prev_sub_goal, sub_goal, goal.time_since_start);
+        interpolateCubic(p_interpolated, prev_sub_goal, sub_goal,
+                         std::min(goal.time_since_start, sub_goal.time_from_start.toSec()));
 
         // Update the state of the interpolators (otherwise we'll have a problem if we switch to non-cubic interpolation)
         for(unsigned int i = 0; i < goal.num_goal_joints; ++i)
@@ -0,0 +1,162 @@
+#include "tue/manipulation/self_collision.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+const double EPSILON = 1e-12;
+
+inline double clamp01(double v)
+{
+    v = v > 0.0 ? v : 0.0;
+    return v < 1.0 ? v : 1.0;
+}
+
+inline double atLeastEpsilon(double v)
+{
+    return v > EPSILON ? v : EPSILON;
+}
+
+// Closest points between segments (p1, p1 + d1) and (p2, p2 + d2), see Ericson, Real-Time Collision Detection,
+// section 5.1.9. All special cases (degenerate or parallel segments) are handled with selects instead of
+// branches, such that the same computation maps directly onto SIMD instructions.
+inline double distanceSquared(double p1x, double p1y, double p1z, double d1x, double d1y, double d1z,
+                              double p2x, double p2y, double p2z, double d2x, double d2y, double d2z)
+{
+    double rx = p1x - p2x;
+    double ry = p1y - p2y;
+    double rz = p1z - p2z;
+
+    double a = d1x * d1x + d1y * d1y + d1z * d1z;
+    double e = d2x * d2x + d2y * d2y + d2z * d2z;
+    double b = d1x * d2x + d1y * d2y + d1z * d2z;
+    double c = d1x * rx + d1y * ry + d1z * rz;
+    double f = d2x * rx + d2y * ry + d2z * rz;
+
+    double a_safe = atLeastEpsilon(a);
+    double e_safe = atLeastEpsilon(e);
+
+    // Closest point on the infinite lines; for parallel or degenerate segments start with s = 0
+    double denom = a * e - b * b;
+    double s = clamp01((b * f - c * e) / atLeastEpsilon(denom));
+    s = denom > EPSILON ? s : 0.0;
+
+    // Closest point on segment 2 given s
+    double t = (b * s + f) / e_safe;
+    double t_clamped = clamp01(t);
+
+    // If t was clamped (or segment 2 is a point), recompute s for the clamped t
+    double s_recomputed = clamp01((b * t_clamped - c) / a_safe);
+    bool recompute_s = (t != t_clamped) | (e <= EPSILON);
+    s = recompute_s ? s_recomputed : s;
+    s = a <= EPSILON ? 0.0 : s;
+
+    double dx = rx + d1x * s - d2x * t_clamped;
+    double dy = ry + d1y * s - d2y * t_clamped;
+    double dz = rz + d1z * s - d2z * t_clamped;
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+#ifdef __SSE2__
+
+inline __m128d dot(__m128d ax, __m128d ay, __m128d az, __m128d bx, __m128d by, __m128d bz)
+{
+    return _mm_add_pd(_mm_add_pd(_mm_mul_pd(ax, bx), _mm_mul_pd(ay, by)), _mm_mul_pd(az, bz));
+}
+
+inline __m128d clamp01(__m128d v)
+{
+    return _mm_min_pd(_mm_max_pd(v, _mm_setzero_pd()), _mm_set1_pd(1.0));
+}
+
+// Returns a where mask is set, b otherwise
+inline __m128d select(__m128d mask, __m128d a, __m128d b)
+{
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+#endif
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+void segmentDistancesSquared(const SegmentBatch& a, const SegmentBatch& b, unsigned int n, double* dist_sq)
+{
+    unsigned int i = 0;
+
+#ifdef __SSE2__
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d eps = _mm_set1_pd(EPSILON);
+
+    // Two segment pairs per iteration, same computation as distanceSquared
+    for(; i + 1 < n; i += 2)
+    {
+        __m128d p1x = _mm_loadu_pd(&a.x0[i]), p1y = _mm_loadu_pd(&a.y0[i]), p1z = _mm_loadu_pd(&a.z0[i]);
+        __m128d p2x = _mm_loadu_pd(&b.x0[i]), p2y = _mm_loadu_pd(&b.y0[i]), p2z = _mm_loadu_pd(&b.z0[i]);
+
+        __m128d d1x = _mm_sub_pd(_mm_loadu_pd(&a.x1[i]), p1x);
+        __m128d d1y = _mm_sub_pd(_mm_loadu_pd(&a.y1[i]), p1y);
+        __m128d d1z = _mm_sub_pd(_mm_loadu_pd(&a.z1[i]), p1z);
+        __m128d d2x = _mm_sub_pd(_mm_loadu_pd(&b.x1[i]), p2x);
+        __m128d d2y = _mm_sub_pd(_mm_loadu_pd(&b.y1[i]), p2y);
+        __m128d d2z = _mm_sub_pd(_mm_loadu_pd(&b.z1[i]), p2z);
+
+        __m128d rx = _mm_sub_pd(p1x, p2x);
+        __m128d ry = _mm_sub_pd(p1y, p2y);
+        __m128d rz = _mm_sub_pd(p1z, p2z);
+
+        __m128d aa = dot(d1x, d1y, d1z, d1x, d1y, d1z);
+        __m128d e = dot(d2x, d2y, d2z, d2x, d2y, d2z);
+        __m128d bb = dot(d1x, d1y, d1z, d2x, d2y, d2z);
+        __m128d c = dot(d1x, d1y, d1z, rx, ry, rz);
+        __m128d f = dot(d2x, d2y, d2z, rx, ry, rz);
+
+        __m128d denom = _mm_sub_pd(_mm_mul_pd(aa, e), _mm_mul_pd(bb, bb));
+        __m128d s = clamp01(_mm_div_pd(_mm_sub_pd(_mm_mul_pd(bb, f), _mm_mul_pd(c, e)), _mm_max_pd(denom, eps)));
+        s = select(_mm_cmpgt_pd(denom, eps), s, zero);
+
+        __m128d t = _mm_div_pd(_mm_add_pd(_mm_mul_pd(bb, s), f), _mm_max_pd(e, eps));
+        __m128d t_clamped = clamp01(t);
+
+        __m128d s_recomputed = clamp01(_mm_div_pd(_mm_sub_pd(_mm_mul_pd(bb, t_clamped), c), _mm_max_pd(aa, eps)));
+        s = select(_mm_or_pd(_mm_cmpneq_pd(t, t_clamped), _mm_cmple_pd(e, eps)), s_recomputed, s);
+        s = select(_mm_cmpgt_pd(aa, eps), s, zero);
+
+        __m128d dx = _mm_sub_pd(_mm_add_pd(rx, _mm_mul_pd(d1x, s)), _mm_mul_pd(d2x, t_clamped));
+        __m128d dy = _mm_sub_pd(_mm_add_pd(ry, _mm_mul_pd(d1y, s)), _mm_mul_pd(d2y, t_clamped));
+        __m128d dz = _mm_sub_pd(_mm_add_pd(rz, _mm_mul_pd(d1z, s)), _mm_mul_pd(d2z, t_clamped));
+
+        _mm_storeu_pd(&dist_sq[i], dot(dx, dy, dz, dx, dy, dz));
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        dist_sq[i] = distanceSquared(a.x0[i], a.y0[i], a.z0[i], a.x1[i] - a.x0[i], a.y1[i] - a.y0[i], a.z1[i] - a.z0[i],
+                                     b.x0[i], b.y0[i], b.z0[i], b.x1[i] - b.x0[i], b.y1[i] - b.y0[i], b.z1[i] - b.z0[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double segmentDistanceSquared(const KDL::Vector& p1, const KDL::Vector& q1, const KDL::Vector& p2, const KDL::Vector& q2)
+{
+    KDL::Vector d1 = q1 - p1;
+    KDL::Vector d2 = q2 - p2;
+    return distanceSquared(p1.x(), p1.y(), p1.z(), d1.x(), d1.y(), d1.z(),
+                           p2.x(), p2.y(), p2.z(), d2.x(), d2.y(), d2.z());
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
@@ -0,0 +1,540 @@
+#include "tue/manipulation/time_optimal_parameterization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+// Upper bound on the squared path velocity, used where no joint moves along the path
+const double MAX_PATH_VELOCITY_SQ = 1e6;
+
+const double EPSILON = 1e-9;
+
+// Relative violation of the limits that is accepted in the result, to allow for rounding
+const double LIMIT_TOLERANCE = 1e-6;
+
+// Maximum number of times a piece is parameterized again with tightened limits
+const unsigned int MAX_LIMIT_ITERATIONS = 50;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Monotone piecewise cubic Hermite interpolation (Fritsch-Carlson) of one joint over the path parameter
+class PchipSpline
+{
+
+public:
+
+    void init(const std::vector<double>& s, const std::vector<double>& y)
+    {
+        s_ = s;
+        y_ = y;
+
+        unsigned int n = s.size();
+        d_.assign(n, 0);
+
+        std::vector<double> h(n - 1), delta(n - 1);
+        for(unsigned int k = 0; k + 1 < n; ++k)
+        {
+            h[k] = s[k + 1] - s[k];
+            delta[k] = (y[k + 1] - y[k]) / h[k];
+        }
+
+        // Use the secants at the ends, such that the path never starts or ends with a zero tangent
+        d_[0] = delta[0];
+        d_[n - 1] = delta[n - 2];
+
+        for(unsigned int k = 1; k + 1 < n; ++k)
+        {
+            if (delta[k - 1] * delta[k] <= 0)
+                continue;
+
+            double w1 = 2 * h[k] + h[k - 1];
+            double w2 = h[k] + 2 * h[k - 1];
+            d_[k] = (w1 + w2) / (w1 / delta[k - 1] + w2 / delta[k]);
+        }
+    }
+
+    // Position and first and second derivative with respect to the path parameter on segment k
+    void evaluate(unsigned int k, double s, double& y, double& dy, double& ddy) const
+    {
+        double h = s_[k + 1] - s_[k];
+        double t = (s - s_[k]) / h;
+        double t2 = t * t;
+        double t3 = t * t2;
+
+        double y0 = y_[k];
+        double y1 = y_[k + 1];
+        double d0 = d_[k];
+        double d1 = d_[k + 1];
+
+        y = (2 * t3 - 3 * t2 + 1) * y0 + (t3 - 2 * t2 + t) * h * d0 + (-2 * t3 + 3 * t2) * y1 + (t3 - t2) * h * d1;
+        dy = (6 * t2 - 6 * t) * (y0 - y1) / h + (3 * t2 - 4 * t + 1) * d0 + (3 * t2 - 2 * t) * d1;
+        ddy = ((12 * t - 6) * (y0 - y1) / h + (6 * t - 4) * d0 + (6 * t - 2) * d1) / h;
+    }
+
+private:
+
+    std::vector<double> s_, y_, d_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Acceleration constraint of one joint at a path sample: |a * u + b * x| <= max_acc, with x the squared path
+// velocity and u the path acceleration
+struct AccelerationConstraint
+{
+    double a, b, max_acc;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Path sample with its constraints. At waypoints the second derivative of the spline is discontinuous, so
+// the constraints of both adjacent segments are added.
+struct PathSample
+{
+    double s;
+
+    std::vector<double> q, dq;
+
+    // Bound on x following from the velocity limits
+    double max_x;
+
+    std::vector<AccelerationConstraint> constraints;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+void addConstraints(const std::vector<PchipSpline>& splines, unsigned int k, const std::vector<double>& max_vel,
+                    const std::vector<double>& max_acc, bool set_state, PathSample& sample)
+{
+    unsigned int num_joints = splines.size();
+
+    if (set_state)
+    {
+        sample.q.resize(num_joints);
+        sample.dq.resize(num_joints);
+        sample.max_x = MAX_PATH_VELOCITY_SQ;
+    }
+
+    for(unsigned int j = 0; j < num_joints; ++j)
+    {
+        double y, dy, ddy;
+        splines[j].evaluate(k, sample.s, y, dy, ddy);
+
+        if (set_state)
+        {
+            sample.q[j] = y;
+            sample.dq[j] = dy;
+
+            if (std::abs(dy) > EPSILON)
+                sample.max_x = std::min(sample.max_x, (max_vel[j] * max_vel[j]) / (dy * dy));
+        }
+
+        AccelerationConstraint c;
+        c.a = dy;
+        c.b = ddy;
+        c.max_acc = max_acc[j];
+        sample.constraints.push_back(c);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Restricts max_x such that c0 + c1 * x <= 0 for all x in [0, max_x], given that it holds for x = 0
+void applyBound(double c0, double c1, double& max_x)
+{
+    if (c1 > 0)
+        max_x = std::min(max_x, -c0 / c1);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Given that the squared path velocities in [0, max_x_next] are controllable at the next sample (at distance
+// ds), returns the largest controllable squared path velocity at this sample. All constraints are linear in
+// (u, x) and are satisfied at x = u = 0, so the controllable set is an interval [0, max_x] that follows from
+// intersecting half-lines.
+double maxControllableVelocitySq(const PathSample& sample, double ds, double max_x_next)
+{
+    double max_x = sample.max_x;
+
+    // Per joint the allowed path acceleration is [alpha + beta * x, gamma + beta * x]
+    std::vector<double> alpha, beta, gamma;
+    for(std::vector<AccelerationConstraint>::const_iterator it = sample.constraints.begin(); it != sample.constraints.end(); ++it)
+    {
+        const AccelerationConstraint& c = *it;
+        if (std::abs(c.a) < EPSILON)
+        {
+            if (std::abs(c.b) > EPSILON)
+                max_x = std::min(max_x, c.max_acc / std::abs(c.b));
+            continue;
+        }
+
+        alpha.push_back(-c.max_acc / std::abs(c.a));
+        beta.push_back(-c.b / c.a);
+        gamma.push_back(c.max_acc / std::abs(c.a));
+    }
+
+    for(unsigned int j = 0; j < alpha.size(); ++j)
+    {
+        // The allowed path acceleration interval must be non-empty
+        for(unsigned int k = 0; k < alpha.size(); ++k)
+            applyBound(alpha[j] - gamma[k], beta[j] - beta[k], max_x);
+
+        // Braking as hard as possible must bring us within the controllable set of the next sample ...
+        applyBound(2 * ds * alpha[j] - max_x_next, 1 + 2 * ds * beta[j], max_x);
+
+        // ... and accelerating as hard as possible must not make the path velocity negative
+        applyBound(-2 * ds * gamma[j], -(1 + 2 * ds * beta[j]), max_x);
+    }
+
+    return std::max(0.0, max_x);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double maxPathAcceleration(const PathSample& sample, double x)
+{
+    double u_max = std::numeric_limits<double>::infinity();
+    for(std::vector<AccelerationConstraint>::const_iterator it = sample.constraints.begin(); it != sample.constraints.end(); ++it)
+    {
+        const AccelerationConstraint& c = *it;
+        if (std::abs(c.a) > EPSILON)
+            u_max = std::min(u_max, c.max_acc / std::abs(c.a) - c.b * x / c.a);
+    }
+    return u_max;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Ratios of the largest acceleration and velocity of the cubic Hermite segment from (q0, v0) to (q1, v1) in dt to
+// the limits. The acceleration of a cubic is linear in time, so it is extreme at the ends; the velocity can also
+// be extreme where the acceleration changes sign.
+void hermiteLimitRatios(double q0, double v0, double q1, double v1, double dt, double max_vel, double max_acc,
+                        double& acc_ratio, double& vel_ratio)
+{
+    double dq = q1 - q0;
+    double a0 = (6 * dq - dt * (4 * v0 + 2 * v1)) / (dt * dt);
+    double a1 = (-6 * dq + dt * (2 * v0 + 4 * v1)) / (dt * dt);
+    acc_ratio = std::max(std::abs(a0), std::abs(a1)) / max_acc;
+
+    double v_max = std::max(std::abs(v0), std::abs(v1));
+    if ((a0 > 0) != (a1 > 0))
+    {
+        double t = a0 / (a0 - a1) * dt;
+        v_max = std::max(v_max, std::abs(v0 + a0 * t + (a1 - a0) * t * t / (2 * dt)));
+    }
+    vel_ratio = v_max / max_vel;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Parameterizes the path through knots [first, last], starting and ending at rest, and appends the result
+bool parameterizePiece(const std::vector<double>& all_knots, const std::vector<std::vector<double> >& joint_positions,
+                       unsigned int first, unsigned int last, const std::vector<double>& max_vel,
+                       const std::vector<double>& max_acc, double path_resolution, TimeParameterizedPath& result,
+                       std::string& error)
+{
+    unsigned int num_joints = joint_positions.size();
+
+    std::vector<double> knots(all_knots.begin() + first, all_knots.begin() + last + 1);
+
+    std::vector<PchipSpline> splines(num_joints);
+    for(unsigned int j = 0; j < num_joints; ++j)
+    {
+        std::vector<double> y(joint_positions[j].begin() + first, joint_positions[j].begin() + last + 1);
+        splines[j].init(knots, y);
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Sample the path
+
+    std::vector<PathSample> samples;
+    for(unsigned int k = 0; k + 1 < knots.size(); ++k)
+    {
+        unsigned int n = std::max<unsigned int>(1, std::ceil((knots[k + 1] - knots[k]) / path_resolution));
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            samples.push_back(PathSample());
+            PathSample& sample = samples.back();
+            sample.s = knots[k] + (knots[k + 1] - knots[k]) * i / n;
+            addConstraints(splines, k, max_vel, max_acc, true, sample);
+
+            if (i == 0 && k > 0)
+                addConstraints(splines, k - 1, max_vel, max_acc, false, sample);
+        }
+    }
+
+    samples.push_back(PathSample());
+    samples.back().s = knots.back();
+    addConstraints(splines, knots.size() - 2, max_vel, max_acc, true, samples.back());
+
+    unsigned int N = samples.size() - 1;
+
+    // The limits are imposed at the samples, with a constant path acceleration in between, but the result is
+    // followed by cubic Hermite interpolation between the samples. Where the path velocity changes abruptly (near
+    // sharp waypoints) the Hermite segments can exceed the limits. The limits of the samples around such segments
+    // are therefore tightened, and the piece is parameterized again until all segments are within the limits.
+    std::vector<double> max_x(N + 1), x(N + 1), times(N + 1);
+    std::vector<std::vector<double> > velocities(N + 1, std::vector<double>(num_joints));
+    for(unsigned int iteration = 0; ; ++iteration)
+    {
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Backward pass: controllable sets, ending at rest
+
+        max_x[N] = 0;
+        for(int i = N - 1; i >= 0; --i)
+            max_x[i] = maxControllableVelocitySq(samples[i], samples[i + 1].s - samples[i].s, max_x[i + 1]);
+
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Forward pass: greedily accelerate, starting at rest
+
+        x[0] = 0;
+        for(unsigned int i = 0; i < N; ++i)
+        {
+            double ds = samples[i + 1].s - samples[i].s;
+            double u = std::min(maxPathAcceleration(samples[i], x[i]), (max_x[i + 1] - x[i]) / (2 * ds));
+            x[i + 1] = std::max(0.0, std::min(max_x[i + 1], x[i] + 2 * ds * u));
+        }
+        x[N] = 0;
+
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Convert to time-stamped points
+
+        times[0] = 0;
+        for(unsigned int i = 0; i <= N; ++i)
+        {
+            if (i > 0)
+            {
+                double v_sum = std::sqrt(x[i - 1]) + std::sqrt(x[i]);
+                if (v_sum < EPSILON)
+                {
+                    error += "Path can not be traversed within the limits.\n";
+                    return false;
+                }
+                times[i] = times[i - 1] + 2 * (samples[i].s - samples[i - 1].s) / v_sum;
+            }
+
+            double v = std::sqrt(x[i]);
+            for(unsigned int j = 0; j < num_joints; ++j)
+                velocities[i][j] = samples[i].dq[j] * v;
+        }
+
+        // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+        // Check the Hermite segments, and tighten the limits around the ones that violate them
+
+        bool within_limits = true;
+        for(unsigned int i = 0; i < N; ++i)
+        {
+            double acc_ratio = 0, vel_ratio = 0;
+            for(unsigned int j = 0; j < num_joints; ++j)
+            {
+                double a, v;
+                hermiteLimitRatios(samples[i].q[j], velocities[i][j], samples[i + 1].q[j], velocities[i + 1][j],
+                                   times[i + 1] - times[i], max_vel[j], max_acc[j], a, v);
+                acc_ratio = std::max(acc_ratio, a);
+                vel_ratio = std::max(vel_ratio, v);
+            }
+
+            if (acc_ratio <= 1 + LIMIT_TOLERANCE && vel_ratio <= 1 + LIMIT_TOLERANCE)
+                continue;
+
+            within_limits = false;
+            for(unsigned int k = i; k <= i + 1; ++k)
+            {
+                PathSample& sample = samples[k];
+                if (acc_ratio > 1)
+                {
+                    for(unsigned int c = 0; c < sample.constraints.size(); ++c)
+                        sample.constraints[c].max_acc /= acc_ratio;
+                }
+                if (vel_ratio > 1)
+                    sample.max_x /= vel_ratio * vel_ratio;
+            }
+        }
+
+        if (within_limits)
+            break;
+
+        if (iteration + 1 == MAX_LIMIT_ITERATIONS)
+        {
+            error += "Could not keep the interpolated path within the limits.\n";
+            return false;
+        }
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Append the result. The first point coincides with the last point of the previous piece.
+
+    double t_start = result.duration();
+    for(unsigned int i = (result.times.empty() ? 0 : 1); i <= N; ++i)
+    {
+        result.times.push_back(t_start + times[i]);
+        result.positions.push_back(samples[i].q);
+        result.velocities.push_back(velocities[i]);
+    }
+
+    return true;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+bool parameterizeTimeOptimal(const std::vector<std::vector<double> >& waypoints,
+                             const std::vector<double>& max_vel, const std::vector<double>& max_acc,
+                             double path_resolution, TimeParameterizedPath& result, std::string& error)
+{
+    unsigned int num_joints = max_vel.size();
+
+    if (max_acc.size() != num_joints || path_resolution <= 0)
+    {
+        error += "Invalid limits or path resolution.\n";
+        return false;
+    }
+
+    for(unsigned int j = 0; j < num_joints; ++j)
+    {
+        if (max_vel[j] <= 0 || max_acc[j] <= 0)
+        {
+            error += "Joint limits must be positive.\n";
+            return false;
+        }
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Chord-length parameterization, skipping duplicate waypoints
+
+    std::vector<double> knots;
+    std::vector<std::vector<double> > joint_positions(num_joints);
+
+    for(unsigned int i = 0; i < waypoints.size(); ++i)
+    {
+        const std::vector<double>& p = waypoints[i];
+        if (p.size() != num_joints)
+        {
+            std::stringstream s;
+            s << "Waypoint " << i << " has " << p.size() << " joints, expected " << num_joints << ".\n";
+            error += s.str();
+            return false;
+        }
+
+        double s = 0;
+        if (!knots.empty())
+        {
+            double dist_sq = 0;
+            for(unsigned int j = 0; j < num_joints; ++j)
+            {
+                double d = p[j] - joint_positions[j].back();
+                dist_sq += d * d;
+            }
+
+            if (dist_sq < EPSILON * EPSILON)
+                continue;
+
+            s = knots.back() + std::sqrt(dist_sq);
+        }
+
+        knots.push_back(s);
+        for(unsigned int j = 0; j < num_joints; ++j)
+            joint_positions[j].push_back(p[j]);
+    }
+
+    if (knots.size() < 2)
+    {
+        error += "Path has no length.\n";
+        return false;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Split the path where it has to come to a stop (every joint reverses or stands still), since the
+    // tangent of the path vanishes there. Each piece is parameterized from rest to rest.
+
+    result.times.clear();
+    result.positions.clear();
+    result.velocities.clear();
+
+    unsigned int first = 0;
+    for(unsigned int k = 1; k < knots.size(); ++k)
+    {
+        bool stop = true;
+        for(unsigned int j = 0; j < num_joints && stop && k + 1 < knots.size(); ++j)
+        {
+            const std::vector<double>& y = joint_positions[j];
+            if ((y[k] - y[k - 1]) * (y[k + 1] - y[k]) > 0)
+                stop = false;
+        }
+
+        if (!stop)
+            continue;
+
+        if (!parameterizePiece(knots, joint_positions, first, k, max_vel, max_acc, path_resolution, result, error))
+            return false;
+
+        first = k;
+    }
+
+    // Make sure the waypoints at the ends are reached exactly
+    result.positions.front() = waypoints.front();
+    result.positions.back() = waypoints.back();
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool checkLimits(const TimeParameterizedPath& path, const std::vector<double>& max_vel,
+                 const std::vector<double>& max_acc, std::string& error)
+{
+    unsigned int num_joints = max_vel.size();
+
+    if (max_acc.size() != num_joints || path.positions.size() != path.times.size()
+            || path.velocities.size() != path.times.size())
+    {
+        error += "Invalid limits or path.\n";
+        return false;
+    }
+
+    for(unsigned int i = 0; i + 1 < path.times.size(); ++i)
+    {
+        double dt = path.times[i + 1] - path.times[i];
+        if (dt <= 0 || path.positions[i].size() != num_joints || path.velocities[i].size() != num_joints
+                || path.positions[i + 1].size() != num_joints || path.velocities[i + 1].size() != num_joints)
+        {
+            std::stringstream s;
+            s << "Segment " << i << " is invalid.\n";
+            error += s.str();
+            return false;
+        }
+
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            double acc_ratio, vel_ratio;
+            hermiteLimitRatios(path.positions[i][j], path.velocities[i][j], path.positions[i + 1][j],
+                               path.velocities[i + 1][j], dt, max_vel[j], max_acc[j], acc_ratio, vel_ratio);
+
+            if (acc_ratio > 1 + LIMIT_TOLERANCE || vel_ratio > 1 + LIMIT_TOLERANCE)
+            {
+                std::stringstream s;
+                s << "Segment " << i << " exceeds the limits of joint " << j << " (velocity " << vel_ratio
+                  << ", acceleration " << acc_ratio << " times the limit).\n";
+                error += s.str();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
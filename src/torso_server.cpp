@@ -12,6 +12,14 @@
 
 #include <control_msgs/FollowJointTrajectoryAction.h>
 
+#include <tue/manipulation/joint_measurement_buffer.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <sstream>
+
 double EPSILON = 0.005; // tolerance for determining whether goal is reached (in meters)
 
 actionlib::SimpleActionServer<control_msgs::FollowJointTrajectoryAction>* as_;
@@ -19,28 +27,367 @@ actionlib::SimpleActionServer<control_msgs::FollowJointTrajectoryAction>* as_;
 ros::Publisher torso_pub_;
 ros::Subscriber torso_sub_;
 
-bool meas_received;
-sensor_msgs::JointState torso_meas_;
+// Latest measurement, written by the subscriber callback and read by the goal callback (which runs in the thread of
+// the action server)
+tue::manipulation::JointMeasurementBuffer measurements_;
+
+// Maps the joints of a goal onto the joints of the measurements. It is built when a goal is accepted and only
+// rebuilt when the joint names of the measurements change, such that no names are compared on every tick.
+struct JointMap {
+    std::shared_ptr<const std::vector<std::string> > layout; // measurement joint names the indices refer to
+    std::vector<unsigned int> meas_index;                     // for every goal joint
+};
+
+// Returns false if a joint of the goal is not measured
+bool mapGoalJoints(const std::vector<std::string>& goal_joints,
+                   const std::shared_ptr<const std::vector<std::string> >& layout, JointMap& map, std::string& error) {
+    map.meas_index.resize(goal_joints.size());
+    for (unsigned int i = 0; i < goal_joints.size(); i++) {
+        std::vector<std::string>::const_iterator it = std::find(layout->begin(), layout->end(), goal_joints[i]);
+        if (it == layout->end()) {
+            error = "Joint '" + goal_joints[i] + "' is not measured";
+            map.layout.reset();
+            return false;
+        }
+        map.meas_index[i] = it - layout->begin();
+    }
+    map.layout = layout;
+    return true;
+}
+
+// Returns false if a point of the goal does not have a position for every joint
+bool checkGoalPoints(const control_msgs::FollowJointTrajectoryGoal& goal, std::string& error) {
+    const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = goal.trajectory.points;
+    for (unsigned int i = 0; i < points.size(); i++) {
+        if (points[i].positions.size() != goal.trajectory.joint_names.size()) {
+            std::stringstream ss;
+            ss << "Point " << i << " has " << points[i].positions.size() << " positions for "
+               << goal.trajectory.joint_names.size() << " joints";
+            error = ss.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copies the measured positions of the goal joints, in the order of the goal
+void mapPositions(const JointMap& map, const std::vector<double>& meas_position, std::vector<double>& positions) {
+    positions.resize(map.meas_index.size());
+    for (unsigned int i = 0; i < map.meas_index.size(); i++) {
+        positions[i] = meas_position[map.meas_index[i]];
+    }
+}
+
+// Returns true if all positions are within tolerance of the target (all in goal order)
+bool withinTolerance(const std::vector<double>& target, const std::vector<double>& positions,
+                     const std::vector<double>& tolerance) {
+    for (unsigned int i = 0; i < positions.size(); i++) {
+        if (!(fabs(target[i] - positions[i]) < tolerance[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// In event-driven mode, the goal is executed by the measurement callback: convergence is checked as soon as a
+// measurement arrives, and the reference is interpolated from one waypoint to the next
+bool event_driven_;
+double max_velocity_; // for interpolating between waypoints (in meters per second, 0 = no limit)
+
+struct GoalExecution {
+    control_msgs::FollowJointTrajectoryGoalConstPtr goal;
+    std::vector<double> goal_tolerance;
+    JointMap joint_map;
+    std::string error;                  // set if the goal cannot be executed
+    int error_code;                     // FollowJointTrajectoryResult error code that goes with the error
+    bool active;
+    bool succeeded;
+    bool preempt_requested;
+    bool started;                       // false until the first measurement after the goal was set
+
+    // The reference moves from segment_start to the current waypoint in segment_duration
+    unsigned int goal_index;
+    std::vector<double> segment_start;
+    ros::Time segment_start_time;
+    double segment_duration;
+
+    sensor_msgs::JointState ref;
+    control_msgs::FollowJointTrajectoryFeedback feedback;
+};
+
+// Guards execution_. The action server is never called with it locked, since the action server calls
+// preemptCb with its own lock held.
+std::mutex execution_mutex_;
+std::condition_variable execution_cv_;
+GoalExecution execution_;
+
+void setGoalTolerance(const control_msgs::FollowJointTrajectoryGoalConstPtr goal, std::vector<double>& goal_tolerance);
+
+// Starts a segment from the given positions to the current waypoint, which takes at least the time between the
+// waypoints and, if a maximum velocity is given, the time needed at that velocity
+void startSegment(GoalExecution& ex, const std::vector<double>& start, const ros::Time& time) {
+    const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = ex.goal->trajectory.points;
+    const trajectory_msgs::JointTrajectoryPoint& p = points[ex.goal_index];
+
+    ex.segment_start = start;
+    ex.segment_start_time = time;
+    ex.segment_duration = p.time_from_start.toSec();
+    if (ex.goal_index > 0) {
+        ex.segment_duration -= points[ex.goal_index - 1].time_from_start.toSec();
+    }
+    if (max_velocity_ > 0) {
+        for (unsigned int i = 0; i < p.positions.size() && i < start.size(); i++) {
+            ex.segment_duration = std::max(ex.segment_duration, fabs(p.positions[i] - start[i]) / max_velocity_);
+        }
+    }
+}
+
+// Reorders the reference positions of a previous goal into the joint order of the next goal, such that the next
+// goal can continue from them. Clears them if the next goal has a joint the previous goal did not have, in which
+// case the next goal starts from the measured positions.
+void mapReference(const std::vector<std::string>& joint_names, sensor_msgs::JointState& ref) {
+    if (ref.position.size() != ref.name.size() || ref.name == joint_names) {
+        return;
+    }
+
+    std::vector<double> positions(joint_names.size());
+    for (unsigned int i = 0; i < joint_names.size(); i++) {
+        std::vector<std::string>::const_iterator it = std::find(ref.name.begin(), ref.name.end(), joint_names[i]);
+        if (it == ref.name.end()) {
+            ref.position.clear();
+            return;
+        }
+        positions[i] = ref.position[it - ref.name.begin()];
+    }
+    ref.position.swap(positions);
+}
+
+// Sets the goal to execute on the next measurements. Must be called with execution_mutex_ locked.
+void setExecutionGoal(const control_msgs::FollowJointTrajectoryGoalConstPtr& goal) {
+    GoalExecution& ex = execution_;
+    ex.goal = goal;
+    ex.joint_map.layout.reset();
+    ex.error.clear();
+    ex.error_code = 0;
+    if (!checkGoalPoints(*goal, ex.error)) {
+        ex.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+        ex.active = false;
+        ex.succeeded = false;
+        execution_cv_.notify_all();
+        return;
+    }
+
+    mapReference(goal->trajectory.joint_names, ex.ref);
+    setGoalTolerance(goal, ex.goal_tolerance);
+
+    // A goal without points has succeeded right away
+    ex.active = !goal->trajectory.points.empty();
+    ex.succeeded = !ex.active;
+    ex.started = false;
+    ex.goal_index = 0;
+    ex.ref.name = goal->trajectory.joint_names;
+    ex.feedback.joint_names = goal->trajectory.joint_names;
+}
+
+// Advances the goal on a new measurement, and fills the reference and feedback to publish. Returns false if there
+// is nothing to publish. Must be called with execution_mutex_ locked.
+bool updateExecution(const std::shared_ptr<const std::vector<std::string> >& meas_layout,
+                     const std::vector<double>& meas_position, const ros::Time& time) {
+    GoalExecution& ex = execution_;
+    if (!ex.active) {
+        return false;
+    }
+
+    const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = ex.goal->trajectory.points;
+    unsigned int n_joints = ex.goal->trajectory.joint_names.size();
+
+    if (meas_layout != ex.joint_map.layout
+            && !mapGoalJoints(ex.goal->trajectory.joint_names, meas_layout, ex.joint_map, ex.error)) {
+        ex.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_JOINTS;
+        ex.active = false;
+        execution_cv_.notify_all();
+        return false;
+    }
+
+    std::vector<double>& positions = ex.feedback.actual.positions;
+    mapPositions(ex.joint_map, meas_position, positions);
+
+    if (!ex.started) {
+        // Start moving from the measured positions (or, when taking over from a previous goal, its reference,
+        // which setExecutionGoal has put in the joint order of this goal)
+        if (ex.ref.position.size() == n_joints) {
+            startSegment(ex, ex.ref.position, time);
+        } else {
+            startSegment(ex, positions, time);
+        }
+        ex.started = true;
+    }
+
+    // Waypoints of which the reference has arrived and the measurements are within tolerance are completed right
+    // away, without waiting for a next tick
+    while (true) {
+        const trajectory_msgs::JointTrajectoryPoint& p = points[ex.goal_index];
+
+        double f = 1;
+        if (ex.segment_duration > 0) {
+            f = std::min(1.0, (time - ex.segment_start_time).toSec() / ex.segment_duration);
+        }
+
+        ex.ref.position.resize(n_joints);
+        for (unsigned int i = 0; i < n_joints; i++) {
+            ex.ref.position[i] = ex.segment_start[i] + f * (p.positions[i] - ex.segment_start[i]);
+        }
+        ex.ref.velocity = p.velocities;
+        ex.ref.effort = p.effort;
+
+        if (f < 1 || !withinTolerance(p.positions, positions, ex.goal_tolerance)) {
+            break;
+        }
+
+        if (ex.goal_index + 1 == points.size()) {
+            ex.active = false;
+            ex.succeeded = true;
+            execution_cv_.notify_all();
+            break;
+        }
+
+        ++ex.goal_index;
+        startSegment(ex, p.positions, time);
+    }
+
+    ex.ref.header.stamp = time;
+    ex.feedback.header.stamp = time;
+    ex.feedback.desired = points[ex.goal_index];
+    ex.feedback.desired.positions = ex.ref.position;
+    return true;
+}
 
 void torsoMeasurementCb(const sensor_msgs::JointStateConstPtr& meas) {
-    torso_meas_ = *meas;
-    meas_received = true;
+    if (!measurements_.write(meas->name, meas->position, meas->header.stamp.toSec())) {
+        ROS_WARN_THROTTLE(1.0, "Torso measurement has %d names but %d positions", (int)meas->name.size(),
+                          (int)meas->position.size());
+        return;
+    }
+
+    if (!event_driven_) {
+        return;
+    }
+
+    sensor_msgs::JointState ref;
+    control_msgs::FollowJointTrajectoryFeedback feedback;
+    {
+        std::lock_guard<std::mutex> lock(execution_mutex_);
+        if (!updateExecution(measurements_.writtenLayout(), meas->position, ros::Time::now())) {
+            return;
+        }
+        ref = execution_.ref;
+        feedback = execution_.feedback;
+    }
+
+    torso_pub_.publish(ref);
+    as_->publishFeedback(feedback);
 }
 
+void preemptCb() {
+    std::lock_guard<std::mutex> lock(execution_mutex_);
+    execution_.preempt_requested = true;
+    execution_cv_.notify_all();
+}
+
+// Fills the tolerance of every goal joint, in the order of the goal
 void setGoalTolerance(const control_msgs::FollowJointTrajectoryGoalConstPtr goal, std::vector<double>& goal_tolerance) {
-    int n_joints = goal->trajectory.joint_names.size();
-    goal_tolerance.resize(n_joints, EPSILON);
-    for (unsigned int i = 0; i < n_joints; i++) {
-        for (unsigned int j = 0; j < goal->goal_tolerance.size(); j++) {
-            if (goal->trajectory.joint_names[i] == goal->goal_tolerance[j].name) {
-                goal_tolerance[i] = goal->goal_tolerance[j].position;
+    const std::vector<std::string>& joint_names = goal->trajectory.joint_names;
+    goal_tolerance.assign(joint_names.size(), EPSILON);
+
+    std::map<std::string, unsigned int> joint_index;
+    for (unsigned int i = 0; i < joint_names.size(); i++) {
+        joint_index[joint_names[i]] = i;
+    }
+
+    for (unsigned int j = 0; j < goal->goal_tolerance.size(); j++) {
+        std::map<std::string, unsigned int>::const_iterator it = joint_index.find(goal->goal_tolerance[j].name);
+        if (it != joint_index.end()) {
+            goal_tolerance[it->second] = goal->goal_tolerance[j].position;
+        }
+    }
+}
+
+// Waits while the measurement callback executes the goal, and handles new goals and preemption
+void executeEventDriven(const control_msgs::FollowJointTrajectoryGoalConstPtr& torso_goal) {
+
+    measurements_.update();
+    if (!measurements_.hasMeasurement()) {
+        ROS_WARN("Torso server has not received any measurements yet, aborting");
+        as_->setAborted();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(execution_mutex_);
+        execution_.ref.position.clear();
+        setExecutionGoal(torso_goal);
+    }
+
+    ros::NodeHandle n;
+    while (n.ok()) {
+        bool succeeded;
+        std::string error;
+        int error_code;
+        {
+            std::unique_lock<std::mutex> lock(execution_mutex_);
+
+            // The timeout only bounds the reaction to a shutdown; goals and preemption notify
+            if (!execution_.succeeded && execution_.error.empty() && !execution_.preempt_requested) {
+                execution_cv_.wait_for(lock, std::chrono::milliseconds(100));
+            }
+            succeeded = execution_.succeeded;
+            error = execution_.error;
+            error_code = execution_.error_code;
+            execution_.preempt_requested = false;
+        }
+
+        if (!error.empty()) {
+            ROS_ERROR("%s, aborting", error.c_str());
+            control_msgs::FollowJointTrajectoryResult result;
+            result.error_code = error_code;
+            as_->setAborted(result, error);
+            return;
+        }
+
+        if (succeeded) {
+            control_msgs::FollowJointTrajectoryResult result;
+            result.error_code = 0;
+            as_->setSucceeded(result, "Torso goal succeeded!");
+            return;
+        }
+
+        // A new goal continues from the reference of the current one
+        if (as_->isNewGoalAvailable()) {
+            ROS_INFO("New goal received.");
+            control_msgs::FollowJointTrajectoryGoalConstPtr goal = as_->acceptNewGoal();
+            std::lock_guard<std::mutex> lock(execution_mutex_);
+            setExecutionGoal(goal);
+        } else if (as_->isPreemptRequested()) {
+            {
+                std::lock_guard<std::mutex> lock(execution_mutex_);
+                execution_.active = false;
             }
+            as_->setPreempted();
+            return;
         }
     }
+
+    std::lock_guard<std::mutex> lock(execution_mutex_);
+    execution_.active = false;
 }
 
 void goalCb(const control_msgs::FollowJointTrajectoryGoalConstPtr& torso_goal) {
 
+    if (event_driven_) {
+        executeEventDriven(torso_goal);
+        return;
+    }
+
     ros::Rate r(10);
     ros::NodeHandle n;
     control_msgs::FollowJointTrajectoryGoalConstPtr goal = torso_goal;
@@ -48,15 +395,17 @@ void goalCb(const control_msgs::FollowJointTrajectoryGoalConstPtr& torso_goal) {
     sensor_msgs::JointState torso_ref;
 
     int goal_index = 0;
-    int n_joints = goal->trajectory.joint_names.size();
     torso_ref.name = goal->trajectory.joint_names;
     feedback.joint_names = goal->trajectory.joint_names;
     std::vector<double> goal_tolerance;
     setGoalTolerance(goal, goal_tolerance);
+    JointMap joint_map;
+    bool goal_checked = false;
 
     while(n.ok() && as_->isActive()) {
         
-        if (!meas_received) {
+        measurements_.update();
+        if (!measurements_.hasMeasurement()) {
             ROS_WARN("Torso server has not received any measurements yet, aborting");
             as_->setAborted();
             return;
@@ -65,17 +414,39 @@ void goalCb(const control_msgs::FollowJointTrajectoryGoalConstPtr& torso_goal) {
         torso_ref.header.stamp = ros::Time::now();
 
         // ToDo: check time?
-        // ToDo: assumes measurements and references in the same order
 
         // Check if new goal is available
         if (as_->isNewGoalAvailable()) {
             ROS_INFO("New goal received.");
             goal = as_->acceptNewGoal();
             goal_index = 0;
-            n_joints = goal->trajectory.joint_names.size();
             torso_ref.name = goal->trajectory.joint_names;
             feedback.joint_names = goal->trajectory.joint_names;
             setGoalTolerance(goal, goal_tolerance);
+            joint_map.layout.reset();
+            goal_checked = false;
+        }
+
+        // Check every point of a newly accepted goal, which is indexed by joint from here on
+        std::string error;
+        if (!goal_checked && !checkGoalPoints(*goal, error)) {
+            ROS_ERROR("%s, aborting", error.c_str());
+            control_msgs::FollowJointTrajectoryResult result;
+            result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_GOAL;
+            as_->setAborted(result, error);
+            return;
+        }
+        goal_checked = true;
+
+        // Map the goal joints onto the measurements when a goal is accepted or the measured joints change
+        const tue::manipulation::JointMeasurement& meas = measurements_.latest();
+        if (meas.joint_names != joint_map.layout
+                && !mapGoalJoints(goal->trajectory.joint_names, meas.joint_names, joint_map, error)) {
+            ROS_ERROR("%s, aborting", error.c_str());
+            control_msgs::FollowJointTrajectoryResult result;
+            result.error_code = control_msgs::FollowJointTrajectoryResult::INVALID_JOINTS;
+            as_->setAborted(result, error);
+            return;
         }
 
         if (goal_index == goal->trajectory.points.size()) {
@@ -91,19 +462,12 @@ void goalCb(const control_msgs::FollowJointTrajectoryGoalConstPtr& torso_goal) {
 
             // Publish feedback
             feedback.header.stamp = ros::Time::now();
-            feedback.actual.positions = torso_meas_.position;
+            mapPositions(joint_map, meas.position, feedback.actual.positions);
             feedback.desired = goal->trajectory.points[goal_index];
             // ToDo: error?
             as_->publishFeedback(feedback);
 
-            // Count number of converged joints
-            unsigned int n_converged = 0;
-            for (unsigned int i = 0; i < n_joints; i++) {
-                if (fabs(torso_ref.position[i] - torso_meas_.position[i]) < goal_tolerance[i]) {
-                    ++n_converged;
-                }
-            }
-            if (n_converged == n_joints) {
+            if (withinTolerance(torso_ref.position, feedback.actual.positions, goal_tolerance)) {
                 ++goal_index;
             }
 
@@ -117,15 +481,20 @@ void goalCb(const control_msgs::FollowJointTrajectoryGoalConstPtr& torso_goal) {
 
 int main(int argc, char** argv) {
 
-    meas_received = false;
-
     ros::init(argc, argv, "torso_server");
 	ros::NodeHandle nh("~");
 
+    nh.param("event_driven", event_driven_, false);
+    nh.param("max_velocity", max_velocity_, 0.0);
+    execution_.active = false;
+    execution_.succeeded = false;
+    execution_.preempt_requested = false;
+
     torso_pub_ = nh.advertise<sensor_msgs::JointState>("references", 1);
     torso_sub_ = nh.subscribe("measurements", 10, &torsoMeasurementCb);
 
     as_ = new actionlib::SimpleActionServer<control_msgs::FollowJointTrajectoryAction>(nh, nh.getNamespace(), &goalCb, false);
+    as_->registerPreemptCallback(&preemptCb);
     as_->start();
 
 	ROS_INFO("Action server is active and spinning...");
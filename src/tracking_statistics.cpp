@@ -0,0 +1,99 @@
+#include "tue/manipulation/tracking_statistics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tue
+{
+namespace manipulation
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+TrackingStatistics::TrackingStatistics(unsigned int waypoint_capacity)
+    : waypoint_times_(std::max(1u, waypoint_capacity), 0)
+{
+    start(0, 0, 0);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TrackingStatistics::start(unsigned int num_joints, double t_start, double nominal_duration)
+{
+    sum_squared_error_.assign(num_joints, 0);
+    max_error_.assign(num_joints, 0);
+    num_samples_ = 0;
+
+    num_waypoints_ = 0;
+    sum_waypoint_time_ = 0;
+    max_waypoint_time_ = 0;
+    t_last_waypoint_ = t_start;
+
+    t_start_ = t_start;
+    t_end_ = t_start;
+    nominal_duration_ = nominal_duration;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TrackingStatistics::addSample(const std::vector<double>& errors)
+{
+    unsigned int n = std::min<unsigned int>(errors.size(), sum_squared_error_.size());
+    for(unsigned int j = 0; j < n; ++j)
+    {
+        double e = std::abs(errors[j]);
+        sum_squared_error_[j] += e * e;
+        max_error_[j] = std::max(max_error_[j], e);
+    }
+    ++num_samples_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TrackingStatistics::addWaypoint(double t)
+{
+    double dt = t - t_last_waypoint_;
+    t_last_waypoint_ = t;
+
+    waypoint_times_[num_waypoints_ % waypoint_times_.size()] = dt;
+    ++num_waypoints_;
+    sum_waypoint_time_ += dt;
+    max_waypoint_time_ = std::max(max_waypoint_time_, dt);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TrackingStatistics::finish(double t)
+{
+    t_end_ = t;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double TrackingStatistics::rmsError(unsigned int j) const
+{
+    return num_samples_ > 0 ? std::sqrt(sum_squared_error_[j] / num_samples_) : 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+unsigned int TrackingStatistics::worstJoint() const
+{
+    return std::max_element(max_error_.begin(), max_error_.end()) - max_error_.begin();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TrackingStatistics::recentWaypointTimes(std::vector<double>& times) const
+{
+    unsigned long capacity = waypoint_times_.size();
+    unsigned long n = std::min(num_waypoints_, capacity);
+
+    times.resize(n);
+    for(unsigned long i = 0; i < n; ++i)
+        times[i] = waypoint_times_[(num_waypoints_ - n + i) % capacity];
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
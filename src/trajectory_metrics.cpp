@@ -0,0 +1,98 @@
+#include "tue/manipulation/trajectory_metrics.h"
+
+#include <cmath>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+// Points closer together in time are not used for differentiation [s]
+const double MIN_TIME_STEP = 1e-6;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Differentiates the samples x (at times t) using finite differences. The derivative is located halfway
+// between two samples.
+void differentiate(const std::vector<double>& t, const std::vector<std::vector<double> >& x,
+                   std::vector<double>& t_out, std::vector<std::vector<double> >& x_out)
+{
+    t_out.clear();
+    x_out.clear();
+
+    for(unsigned int i = 1; i < x.size(); ++i)
+    {
+        double dt = t[i] - t[i - 1];
+        if (dt < MIN_TIME_STEP)
+            continue;
+
+        std::vector<double> dx(x[i].size());
+        for(unsigned int j = 0; j < dx.size(); ++j)
+            dx[j] = (x[i][j] - x[i - 1][j]) / dt;
+
+        t_out.push_back((t[i] + t[i - 1]) / 2);
+        x_out.push_back(dx);
+    }
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void computeTrajectoryMetrics(const std::vector<double>& times, const std::vector<std::vector<double> >& positions,
+                              TrajectoryMetrics& metrics)
+{
+    metrics = TrajectoryMetrics();
+
+    if (positions.empty() || times.size() != positions.size())
+        return;
+
+    metrics.duration = times.back() - times.front();
+
+    for(unsigned int i = 1; i < positions.size(); ++i)
+    {
+        double d_sq = 0;
+        for(unsigned int j = 0; j < positions[i].size(); ++j)
+        {
+            double d = positions[i][j] - positions[i - 1][j];
+            d_sq += d * d;
+        }
+        metrics.path_length += std::sqrt(d_sq);
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Jerk: third derivative of the positions
+
+    std::vector<double> t_vel, t_acc, t_jerk;
+    std::vector<std::vector<double> > vel, acc, jerk;
+    differentiate(times, positions, t_vel, vel);
+    differentiate(t_vel, vel, t_acc, acc);
+    differentiate(t_acc, acc, t_jerk, jerk);
+
+    if (jerk.empty())
+        return;
+
+    // Integrate the squared jerk norm, holding every jerk sample over the interval it was computed from
+    double integral = 0;
+    double total_time = 0;
+    for(unsigned int i = 0; i < jerk.size(); ++i)
+    {
+        double dt = t_acc[i + 1] - t_acc[i];
+
+        double j_sq = 0;
+        for(unsigned int k = 0; k < jerk[i].size(); ++k)
+            j_sq += jerk[i][k] * jerk[i][k];
+
+        integral += j_sq * dt;
+        total_time += dt;
+    }
+
+    metrics.rms_jerk = std::sqrt(integral / total_time);
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
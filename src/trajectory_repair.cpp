@@ -0,0 +1,427 @@
+#include "tue/manipulation/trajectory_repair.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace tue
+{
+namespace manipulation
+{
+
+namespace
+{
+
+// Tolerance on the position limits [rad], and relative tolerance on the velocity and acceleration limits
+const double POSITION_TOLERANCE = 1e-9;
+const double RELATIVE_TOLERANCE = 1e-3;
+
+// Segments shorter than this are not checked and not used for velocity estimation [s]
+const double MIN_TIME_STEP = 1e-9;
+
+// The correction of a position violation is blended in and out over a period on either side of the violation,
+// which is long enough for the correction to use at most this fraction of the velocity and acceleration limits
+const double BLEND_LIMIT_FRACTION = 0.25;
+
+// Minimum blend period [s]
+const double MIN_BLEND_TIME = 0.05;
+
+// Upper bound on the rate at which the speed may change when slowing down [1/s]
+const double MAX_SLOW_DOWN_RATE = 10;
+
+const unsigned int MAX_ITERATIONS = 100;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Estimates the velocities of point i from the slopes of the adjacent segments: their average, or zero if the
+// joint changes direction. The first and last point keep their velocities.
+void estimateVelocity(const std::vector<double>& t, const std::vector<std::vector<double> >& q, unsigned int i,
+                      std::vector<std::vector<double> >& v)
+{
+    unsigned int num_joints = q[i].size();
+    if (v[i].size() != num_joints)
+        v[i].assign(num_joints, 0);
+
+    if (i == 0 || i + 1 == q.size())
+        return;
+
+    double dt0 = t[i] - t[i - 1];
+    double dt1 = t[i + 1] - t[i];
+
+    for(unsigned int j = 0; j < num_joints; ++j)
+    {
+        double d0 = dt0 > MIN_TIME_STEP ? (q[i][j] - q[i - 1][j]) / dt0 : 0;
+        double d1 = dt1 > MIN_TIME_STEP ? (q[i + 1][j] - q[i][j]) / dt1 : 0;
+        v[i][j] = d0 * d1 <= 0 ? 0 : (d0 + d1) / 2;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Returns whether the position of joint j is within its upper (sign 1) or lower (sign -1) limit
+bool withinLimit(const JointLimitTable& limits, unsigned int j, double sign, double q)
+{
+    return sign > 0 ? q <= limits.upper[j] + POSITION_TOLERANCE : q >= limits.lower[j] - POSITION_TOLERANCE;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Pulls all runs of points beyond a position limit back within the limit, blending the correction in and out
+// over the neighbouring points using a raised cosine. Marks the changed points and returns the number of
+// violating (point, joint) pairs.
+unsigned int repairPositions(const JointLimitTable& limits, const std::vector<double>& t,
+                             std::vector<std::vector<double> >& q, std::vector<bool>& changed)
+{
+    unsigned int num_violations = 0;
+    unsigned int n = q.size();
+
+    for(unsigned int j = 0; j < limits.size(); ++j)
+    {
+        unsigned int i = 0;
+        while (i < n)
+        {
+            double sign;
+            if (q[i][j] > limits.upper[j] + POSITION_TOLERANCE)
+                sign = 1;
+            else if (q[i][j] < limits.lower[j] - POSITION_TOLERANCE)
+                sign = -1;
+            else
+            {
+                ++i;
+                continue;
+            }
+
+            // Find the run of points beyond this limit, and its largest excess
+            unsigned int begin = i;
+            double max_excess = 0;
+            for(; i < n; ++i)
+            {
+                double excess = sign > 0 ? q[i][j] - limits.upper[j] : limits.lower[j] - q[i][j];
+                if (excess <= POSITION_TOLERANCE)
+                    break;
+
+                max_excess = std::max(max_excess, excess);
+                ++num_violations;
+            }
+            unsigned int end = i;
+
+            // A raised cosine of height e over period T has a peak velocity of pi e / (2 T) and a peak
+            // acceleration of pi^2 e / (2 T^2)
+            double blend_time = MIN_BLEND_TIME;
+            if (limits.max_velocity[j] > 0)
+                blend_time = std::max(blend_time, M_PI * max_excess / (2 * BLEND_LIMIT_FRACTION * limits.max_velocity[j]));
+            if (limits.max_acceleration[j] > 0)
+                blend_time = std::max(blend_time, M_PI * std::sqrt(max_excess / (2 * BLEND_LIMIT_FRACTION
+                                                                                 * limits.max_acceleration[j])));
+
+            // The first and last point are within the limits and stay where they are, so the blend ends there at
+            // the latest. It also ends before it would push a point beyond the opposite limit, which would start an
+            // ever growing correction of the runs on either side where the joint moves over nearly the whole range.
+            double blend_in = std::min(blend_time, t[begin] - t[0]);
+            unsigned int k_begin = begin;
+            while (k_begin > 1 && t[begin] - t[k_begin - 1] < blend_in)
+            {
+                double w = 0.5 * (1 + std::cos(M_PI * (t[begin] - t[k_begin - 1]) / blend_in));
+                if (!withinLimit(limits, j, -sign, q[k_begin - 1][j] - sign * max_excess * w))
+                {
+                    blend_in = t[begin] - t[k_begin - 1];
+                    break;
+                }
+                --k_begin;
+            }
+
+            double blend_out = std::min(blend_time, t[n - 1] - t[end - 1]);
+            unsigned int k_end = end;
+            while (k_end + 1 < n && t[k_end] - t[end - 1] < blend_out)
+            {
+                double w = 0.5 * (1 + std::cos(M_PI * (t[k_end] - t[end - 1]) / blend_out));
+                if (!withinLimit(limits, j, -sign, q[k_end][j] - sign * max_excess * w))
+                {
+                    blend_out = t[k_end] - t[end - 1];
+                    break;
+                }
+                ++k_end;
+            }
+
+            for(unsigned int k = k_begin; k < k_end; ++k)
+            {
+                double w = 1;
+                if (k < begin)
+                    w = 0.5 * (1 + std::cos(M_PI * (t[begin] - t[k]) / blend_in));
+                else if (k >= end)
+                    w = 0.5 * (1 + std::cos(M_PI * (t[k] - t[end - 1]) / blend_out));
+
+                q[k][j] -= sign * max_excess * w;
+                changed[k] = true;
+            }
+        }
+    }
+
+    return num_violations;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Largest absolute velocity and acceleration of joint j on the cubic Hermite segment from point i to i + 1, which
+// is how the controllers interpolate the trajectory. The acceleration of a cubic is linear in time, so it is
+// extreme at the ends; the velocity can also be extreme where the acceleration changes sign.
+void segmentExtremes(const std::vector<double>& t, const std::vector<std::vector<double> >& q,
+                     const std::vector<std::vector<double> >& v, unsigned int i, unsigned int j,
+                     double& vel, double& acc)
+{
+    double dt = t[i + 1] - t[i];
+    double dq = q[i + 1][j] - q[i][j];
+    double v0 = v[i][j];
+    double v1 = v[i + 1][j];
+
+    double a0 = (6 * dq - dt * (4 * v0 + 2 * v1)) / (dt * dt);
+    double a1 = (-6 * dq + dt * (2 * v0 + 4 * v1)) / (dt * dt);
+    acc = std::max(std::abs(a0), std::abs(a1));
+
+    vel = std::max(std::abs(v0), std::abs(v1));
+    if ((a0 > 0) != (a1 > 0))
+    {
+        double s = a0 / (a0 - a1) * dt;
+        vel = std::max(vel, std::abs(v0 + a0 * s + (a1 - a0) * s * s / (2 * dt)));
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Determines for every segment the largest rate [1/s] at which the speed of the trajectory may change when it is
+// slowed down. Slowing down by a factor f scales the velocities by the speed s = 1 / f; a speed that changes over
+// time itself accelerates a joint moving at (original) velocity v by at most v (ds / dt), so the rate is chosen
+// such that this stays within a fraction of the acceleration limit.
+void slowDownRates(const JointLimitTable& limits, const std::vector<double>& t,
+                   const std::vector<std::vector<double> >& q, const std::vector<std::vector<double> >& v,
+                   std::vector<double>& max_rate)
+{
+    unsigned int n = q.size();
+    max_rate.assign(n < 2 ? 0 : n - 1, MAX_SLOW_DOWN_RATE);
+    for(unsigned int i = 0; i + 1 < n; ++i)
+    {
+        if (t[i + 1] - t[i] < MIN_TIME_STEP)
+            continue;
+
+        for(unsigned int j = 0; j < limits.size(); ++j)
+        {
+            double vel, acc;
+            segmentExtremes(t, q, v, i, j, vel, acc);
+            if (limits.max_acceleration[j] > 0 && vel > 0)
+                max_rate[i] = std::min(max_rate[i], BLEND_LIMIT_FRACTION * limits.max_acceleration[j] / vel);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Slows down all segments that exceed a velocity or acceleration limit, and their neighbours to a lesser
+// extent. The slow-down factors are relative to the original times t0 and only increase; they decay over the
+// neighbouring segments at the given rates, such that segments away from the violations keep their original
+// timing. Updates the times, marks the points adjacent to segments of which the timing changed and returns the
+// number of those segments. Whatever the slow-down still leaves beyond the limits is caught by the next call.
+unsigned int retime(const JointLimitTable& limits, const std::vector<double>& t0, const std::vector<double>& max_rate,
+                    const std::vector<std::vector<double> >& q, std::vector<std::vector<double> >& v,
+                    std::vector<double>& factor, std::vector<double>& t, std::vector<bool>& changed,
+                    unsigned int& num_velocity_violations, unsigned int& num_acceleration_violations)
+{
+    unsigned int n = q.size();
+    if (n < 2)
+        return 0;
+
+    std::vector<double> new_factor(factor);
+    for(unsigned int i = 0; i + 1 < n; ++i)
+    {
+        if (t[i + 1] - t[i] < MIN_TIME_STEP)
+            continue;
+
+        for(unsigned int j = 0; j < limits.size(); ++j)
+        {
+            double vel, acc;
+            segmentExtremes(t, q, v, i, j, vel, acc);
+
+            // Velocities scale with 1 / factor, accelerations with 1 / factor^2
+            double max_vel = limits.max_velocity[j];
+            if (max_vel > 0 && vel > max_vel * (1 + RELATIVE_TOLERANCE))
+            {
+                new_factor[i] = std::max(new_factor[i], factor[i] * vel / max_vel);
+                ++num_velocity_violations;
+            }
+
+            double max_acc = limits.max_acceleration[j];
+            if (max_acc > 0 && acc > max_acc * (1 + RELATIVE_TOLERANCE))
+            {
+                new_factor[i] = std::max(new_factor[i], factor[i] * std::sqrt(acc / max_acc));
+                ++num_acceleration_violations;
+            }
+        }
+    }
+
+    // Let the slow-down decay over the neighbouring segments, such that the speed changes gradually
+    for(unsigned int i = 1; i < new_factor.size(); ++i)
+        new_factor[i] = std::max(new_factor[i], 1 / (1 / new_factor[i - 1] + max_rate[i] * (t0[i + 1] - t0[i])));
+    for(unsigned int i = new_factor.size() - 1; i > 0; --i)
+        new_factor[i - 1] = std::max(new_factor[i - 1], 1 / (1 / new_factor[i] + max_rate[i - 1] * (t0[i] - t0[i - 1])));
+
+    unsigned int num_retimed = 0;
+    for(unsigned int i = 0; i + 1 < n; ++i)
+    {
+        if (new_factor[i] > factor[i])
+        {
+            changed[i] = true;
+            changed[i + 1] = true;
+            ++num_retimed;
+        }
+
+        if (new_factor[i] > 1)
+            t[i + 1] = t[i] + (t0[i + 1] - t0[i]) * new_factor[i];
+        else
+            t[i + 1] = t[i] + (t0[i + 1] - t0[i]);
+    }
+
+    // The first and last point keep their velocity direction, but slow down with their segment
+    for(unsigned int j = 0; j < v[0].size(); ++j)
+        v[0][j] *= factor.front() / new_factor.front();
+    for(unsigned int j = 0; j < v[n - 1].size(); ++j)
+        v[n - 1][j] *= factor.back() / new_factor.back();
+
+    factor.swap(new_factor);
+    return num_retimed;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+bool repairTrajectory(const JointLimitTable& limits, std::vector<double>& times,
+                      std::vector<std::vector<double> >& positions, std::vector<std::vector<double> >& velocities,
+                      TrajectoryRepairStatistics& stats, std::string& error)
+{
+    stats = TrajectoryRepairStatistics();
+
+    unsigned int n = positions.size();
+    if (n == 0)
+        return true;
+
+    if (times.size() != n || (!velocities.empty() && velocities.size() != n))
+    {
+        error += "Number of times, positions and velocities differ";
+        return false;
+    }
+
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        if (positions[i].size() != limits.size())
+        {
+            std::stringstream s;
+            s << "Point " << i << " has " << positions[i].size() << " positions, but there are limits for "
+              << limits.size() << " joints";
+            error += s.str();
+            return false;
+        }
+
+        if (i > 0 && times[i] < times[i - 1])
+        {
+            error += "Times are not increasing";
+            return false;
+        }
+    }
+
+    // The start and the goal are kept, so they must be within the position limits
+    for(unsigned int j = 0; j < limits.size(); ++j)
+    {
+        for(unsigned int k = 0; k < 2; ++k)
+        {
+            double q = k == 0 ? positions.front()[j] : positions.back()[j];
+            if (q < limits.lower[j] - POSITION_TOLERANCE || q > limits.upper[j] + POSITION_TOLERANCE)
+            {
+                std::stringstream s;
+                s << (k == 0 ? "Start" : "Goal") << " position " << q << " of joint " << j << " is outside the limits ["
+                  << limits.lower[j] << ", " << limits.upper[j] << "]";
+                error += s.str();
+                return false;
+            }
+        }
+    }
+
+    // Estimate missing velocities
+    velocities.resize(n);
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        if (velocities[i].size() != limits.size())
+            estimateVelocity(times, positions, i, velocities);
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    double original_duration = times.back() - times.front();
+    std::vector<bool> changed(n, false);
+
+    // Pull the positions within the limits
+    for(unsigned int it = 0; ; ++it)
+    {
+        if (it == MAX_ITERATIONS)
+        {
+            error += "Trajectory could not be repaired within the joint position limits";
+            return false;
+        }
+
+        changed.assign(n, false);
+        unsigned int num_position_violations = repairPositions(limits, times, positions, changed);
+        if (it == 0)
+            stats.num_position_violations = num_position_violations;
+
+        if (num_position_violations == 0)
+            break;
+
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            if (changed[i])
+                estimateVelocity(times, positions, i, velocities);
+        }
+    }
+
+    // Slow down the segments that exceed the velocity or acceleration limits, relative to the original timing
+    std::vector<double> original_times(times);
+    std::vector<double> max_rate;
+    slowDownRates(limits, original_times, positions, velocities, max_rate);
+    std::vector<double> factor(n - 1, 1);
+
+    for(unsigned int it = 0; it < MAX_ITERATIONS; ++it)
+    {
+        changed.assign(n, false);
+        unsigned int num_velocity_violations = 0, num_acceleration_violations = 0;
+        unsigned int num_retimed = retime(limits, original_times, max_rate, positions, velocities, factor, times,
+                                          changed, num_velocity_violations, num_acceleration_violations);
+
+        for(unsigned int i = 0; i < n; ++i)
+        {
+            if (changed[i])
+                estimateVelocity(times, positions, i, velocities);
+        }
+
+        if (it == 0)
+        {
+            stats.num_velocity_violations = num_velocity_violations;
+            stats.num_acceleration_violations = num_acceleration_violations;
+        }
+
+        if (num_retimed == 0)
+        {
+            for(unsigned int i = 0; i + 1 < n; ++i)
+            {
+                if (factor[i] > 1)
+                    ++stats.num_retimed_segments;
+            }
+            stats.added_duration = (times.back() - times.front()) - original_duration;
+            return true;
+        }
+    }
+
+    error += "Trajectory could not be repaired within the joint limits";
+    return false;
+}
+
+} // end namespace tue
+
+} // end namespace manipulation
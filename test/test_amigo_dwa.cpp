@@ -1,4 +1,5 @@
 #include <tue/manipulation/dwa.h>
+#include <tue/manipulation/dwa_controller.h>
 
 #include <iostream>
 #include <fstream>
@@ -11,9 +12,7 @@
 #include <control_msgs/FollowJointTrajectoryActionGoal.h>
 
 tue::manipulation::DWA dwa;
-KDL::JntArray q_current(8);
-std::vector<bool> q_set(8, false);
-int num_joints_set = 0;
+tue::manipulation::DWAController* controller = 0;
 
 ros::Publisher pub_torso, pub_arm;
 
@@ -67,23 +66,7 @@ private:
 
 void jointStateCallback(const sensor_msgs::JointState& joint_msg)
 {
-    for(unsigned int i = 0; i < joint_msg.name.size(); ++i)
-    {
-        unsigned int i_joint;
-        if (dwa.getJointIndex(joint_msg.name[i], i_joint))
-        {
-            q_current(i_joint) = joint_msg.position[i];
-            if (!q_set[i_joint])
-            {
-                ++num_joints_set;
-                q_set[i_joint] = true;
-            }
-        }
-        else
-        {
-            std::cout << "Unknown joint:" << joint_msg.name[i] << std::endl;
-        }
-    }
+    controller->setJointPositions(joint_msg.name, joint_msg.position);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -174,33 +157,30 @@ int main(int argc, char **argv)
 
     dwa.setConstraint(new GraspContraint(geo::Pose3D(0.7, -0.2, 0.8)));
 
-    for(unsigned int i = 0; i < q_current.rows(); ++i)
-        q_current(i) = 0;
-
     double dt = 0.05;
 
     // - - - - - - - - - - - - - - - - - - - - - -
 
-    ros::Rate r(1.0 / dt);
-    while(ros::ok())
-    {
-        ros::spinOnce();
-
-        if (num_joints_set < q_current.rows())
-            continue;
+    // Joint states are received on the spinner thread, references are sent from the controller thread
+    controller = new tue::manipulation::DWAController(dwa);
+    controller->start(1.0 / dt, &sendReference);
 
-        std::vector<double> q_wanted(q_current.rows());
-        dwa.calculateVelocity(q_current, dt, q_wanted);
-
-        sendReference(q_wanted);
-
-//        for(unsigned int i = 0; i< q_wanted.size(); ++i)
-//            std::cout << q_wanted[i] << " ";
-//        std::cout << std::endl;
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
 
+    ros::WallRate r(1);
+    while(ros::ok())
+    {
         r.sleep();
+
+        const tue::manipulation::DWAControllerStatistics& stats = controller->statistics();
+        ROS_INFO("DWA: %lu ticks, %lu deadline misses, compute time %.2f ms (mean %.2f ms, max %.2f ms), "
+                 "%u samples (step %.3f)", stats.num_ticks, stats.num_deadline_misses, stats.compute_time * 1000,
+                 stats.mean_compute_time * 1000, stats.max_compute_time * 1000, stats.num_samples, stats.vel_step);
     }
 
+    controller->stop();
+    delete controller;
 
     return 0;
 }
@@ -0,0 +1,112 @@
+#include <tue/manipulation/ik_solver.h>
+#include <tue/manipulation/dwa.h>
+#include <tue/manipulation/chain_model.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+#include <ros/package.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Initializes an IK solver and a DWA for both arms, like a node that serves both sides would do
+bool initAll(const std::string& urdf_xml)
+{
+    const char* tips[] = { "grippoint_left", "grippoint_right" };
+
+    for(unsigned int i = 0; i < 2; ++i)
+    {
+        std::string error;
+
+        tue::IKSolver solver;
+        if (!solver.initFromURDF(urdf_xml, "base_link", tips[i], 500, error, false))
+        {
+            std::cout << error << std::endl;
+            return false;
+        }
+
+        tue::manipulation::DWA dwa;
+        if (!dwa.initFromURDF(urdf_xml, "base_link", tips[i], error))
+        {
+            std::cout << error << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    // - - - - - - - - - - - Read the robot URDF description into a string - - - - - - - - - - -
+
+    if (argc < 2) {
+        std::cout << "Usage: 'rosrun tue_manipulation test_chain_model_cache [robot_name] [num_iterations]'" << std::endl;
+        return 1;
+    }
+
+    std::string robot_name(argv[1]);
+    unsigned int num_iterations = 10;
+    if (argc > 2)
+        num_iterations = atoi(argv[2]);
+
+    std::string robot_urdf_path = ros::package::getPath(robot_name+"_description") + "/urdf/"+robot_name+".urdf";
+    std::ifstream f(robot_urdf_path.c_str());
+
+    if (!f.is_open())
+    {
+        std::cout << "Could not load URDF description: '" << robot_urdf_path << "'." << std::endl;
+        return 1;
+    }
+
+    std::stringstream buffer;
+    buffer << f.rdbuf();
+    std::string urdf_xml = buffer.str();
+
+    // - - - - - - - - - - - Startup time without cache - - - - - - - - - - -
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < num_iterations; ++i)
+    {
+        tue::manipulation::ChainModelCache::clear();
+        if (!initAll(urdf_xml))
+            return 1;
+    }
+    double t_uncached = secondsSince(start) / num_iterations;
+
+    // - - - - - - - - - - - Startup time with cache - - - - - - - - - - -
+
+    tue::manipulation::ChainModelCache::clear();
+
+    start = std::chrono::steady_clock::now();
+    if (!initAll(urdf_xml))
+        return 1;
+    double t_first = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < num_iterations; ++i)
+    {
+        if (!initAll(urdf_xml))
+            return 1;
+    }
+    double t_cached = secondsSince(start) / num_iterations;
+
+    std::cout << "Initializing 2 IK solvers and 2 DWAs:" << std::endl;
+    std::cout << "    without cache:    " << t_uncached * 1000 << " ms" << std::endl;
+    std::cout << "    first (parsing):  " << t_first * 1000 << " ms" << std::endl;
+    std::cout << "    cached:           " << t_cached * 1000 << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <tue/manipulation/joint_measurement_buffer.h>
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Writes measurements as fast as possible from one thread, switching between two joint layouts, while another
+// thread reads as fast as possible. Every measurement has all positions equal to its stamp, and the number of
+// positions tells the layout apart, so the reader can check that each snapshot is complete and consistent.
+bool testStress(unsigned int num_measurements)
+{
+    std::vector<std::string> names_a, names_b;
+    names_a.push_back("torso_joint");
+    names_b.push_back("torso_joint");
+    names_b.push_back("neck_pan_joint");
+    names_b.push_back("neck_tilt_joint");
+
+    tue::manipulation::JointMeasurementBuffer buffer(3);
+    std::atomic<bool> done(false);
+
+    std::thread writer([&]()
+    {
+        std::vector<double> pos_a(names_a.size()), pos_b(names_b.size());
+        for(unsigned int i = 1; i <= num_measurements; ++i)
+        {
+            bool use_b = (i / 1000) % 2 == 1;
+            std::vector<double>& pos = use_b ? pos_b : pos_a;
+            for(unsigned int j = 0; j < pos.size(); ++j)
+                pos[j] = i;
+            buffer.write(use_b ? names_b : names_a, pos, i);
+
+            // Lets the reader interleave, also on a single core
+            if (i % 64 == 0)
+                std::this_thread::yield();
+        }
+        done = true;
+    });
+
+    bool ok = true;
+    unsigned long num_reads = 0, num_layout_changes = 0;
+    double last_stamp = 0;
+    const std::vector<std::string>* last_layout = 0;
+    while (true)
+    {
+        bool finished = done;
+        if (!buffer.update())
+        {
+            if (finished)
+                break;
+            std::this_thread::yield();
+            continue;
+        }
+
+        const tue::manipulation::JointMeasurement& m = buffer.latest();
+        ++num_reads;
+
+        // Stamps never go back, positions belong to the stamp, and the layout matches the positions
+        if (m.stamp <= last_stamp || m.position.size() != m.joint_names->size())
+            ok = false;
+        for(unsigned int j = 0; j < m.position.size(); ++j)
+        {
+            if (m.position[j] != m.stamp)
+                ok = false;
+        }
+
+        bool use_b = ((unsigned int)m.stamp / 1000) % 2 == 1;
+        if (*m.joint_names != (use_b ? names_b : names_a))
+            ok = false;
+
+        if (m.joint_names.get() != last_layout)
+            ++num_layout_changes;
+
+        last_stamp = m.stamp;
+        last_layout = m.joint_names.get();
+    }
+
+    writer.join();
+
+    // The last measurement must always arrive
+    ok = ok && last_stamp == num_measurements;
+
+    std::cout << "Stress: " << num_reads << " of " << num_measurements << " measurements read, "
+              << num_layout_changes << " layout changes: " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool testWrite()
+{
+    tue::manipulation::JointMeasurementBuffer buffer;
+
+    std::vector<std::string> names(2, "joint");
+    std::vector<double> pos(2, 1.0);
+
+    bool ok = !buffer.hasMeasurement()
+            && !buffer.write(names, std::vector<double>(1), 1)
+            && !buffer.update()
+            && buffer.write(names, pos, 1)
+            && buffer.update()
+            && buffer.hasMeasurement()
+            && buffer.latest().position == pos;
+
+    // The same names keep the same layout
+    const std::vector<std::string>* layout = buffer.latest().joint_names.get();
+    ok = ok && buffer.write(names, pos, 2) && buffer.update() && buffer.latest().joint_names.get() == layout;
+
+    std::cout << "Write: " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int num_measurements = 1000000;
+    if (argc > 1)
+        num_measurements = atoi(argv[1]);
+
+    bool ok = testWrite();
+    ok = testStress(num_measurements) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -12,6 +12,9 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    // If 'optimize' is given, the timing in the file is ignored and the waypoints are time-optimally parameterized
+    bool optimize = (argc > 2 && std::string(argv[2]) == "optimize");
+
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     // Read trajectory from file
 
@@ -23,6 +26,7 @@ int main(int argc, char **argv)
     }
 
     tue::manipulation::ReferenceGenerator refgen;
+    refgen.setTimeOptimalParameterization(optimize);
 
     int num_joints;
     file >> num_joints;
@@ -50,7 +54,8 @@ int main(int argc, char **argv)
     while(file >> v)
     {
         trajectory_msgs::JointTrajectoryPoint p;
-        p.time_from_start = ros::Duration(v);
+        if (!optimize)
+            p.time_from_start = ros::Duration(v);
 
         for(unsigned int i = 0; i < num_joints; ++i)
         {
@@ -61,7 +66,8 @@ int main(int argc, char **argv)
         for(unsigned int i = 0; i < num_joints; ++i)
         {
             file >> v;
-            p.velocities.push_back(v);
+            if (!optimize)
+                p.velocities.push_back(v);
         }
 
         goal.trajectory.points.push_back(p);
@@ -79,6 +85,11 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    double nominal_duration, duration;
+    if (refgen.getGoalDurations(id, nominal_duration, duration))
+        std::cout << "Time-optimal parameterization: " << duration << " seconds instead of " << nominal_duration
+                  << " seconds (saved " << nominal_duration - duration << " seconds)" << std::endl;
+
     double dt = 0.01;
     double time = 0;
 
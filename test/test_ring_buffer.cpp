@@ -0,0 +1,155 @@
+#include <tue/manipulation/ring_buffer.h>
+#include <tue/manipulation/tracking_statistics.h>
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Pushes samples of which all elements equal the sample index from one thread and checks on another thread that
+// they arrive complete and in order
+bool testHandoff(unsigned int num_samples, unsigned int capacity, unsigned int sample_size)
+{
+    tue::manipulation::RingBuffer<std::vector<double> > buffer(capacity, std::vector<double>(sample_size));
+
+    std::thread writer([&]()
+    {
+        for(unsigned int i = 0; i < num_samples; )
+        {
+            std::vector<double>* slot = buffer.writeSlot();
+            if (!slot)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for(unsigned int j = 0; j < sample_size; ++j)
+                (*slot)[j] = i;
+            buffer.push();
+            ++i;
+        }
+    });
+
+    bool ok = true;
+    for(unsigned int i = 0; i < num_samples; )
+    {
+        const std::vector<double>* sample = buffer.front();
+        if (!sample)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for(unsigned int j = 0; j < sample_size; ++j)
+        {
+            if ((*sample)[j] != i)
+                ok = false;
+        }
+        buffer.pop();
+        ++i;
+    }
+
+    writer.join();
+
+    std::cout << "Handoff of " << num_samples << " samples through " << capacity << " slots: "
+              << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool testOverflow(unsigned int capacity)
+{
+    tue::manipulation::RingBuffer<int> buffer(capacity);
+
+    for(unsigned int i = 0; i < capacity + 5; ++i)
+        buffer.push(i);
+
+    bool ok = (buffer.numDropped() == 5);
+    for(unsigned int i = 0; i < capacity; ++i)
+    {
+        if (!buffer.front() || *buffer.front() != (int)i)
+            ok = false;
+        buffer.pop();
+    }
+    ok = ok && !buffer.front();
+
+    std::cout << "Overflow: " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// A push() after a failed writeSlot() must not publish the unfilled slot, even if the reader freed one in between
+bool testPushWithoutSlot()
+{
+    tue::manipulation::RingBuffer<int> buffer(2);
+    buffer.push(1);
+    buffer.push(2);
+
+    bool ok = !buffer.writeSlot() && buffer.numDropped() == 1;
+    buffer.pop();
+    ok = ok && !buffer.push();
+
+    ok = ok && buffer.front() && *buffer.front() == 2;
+    buffer.pop();
+    ok = ok && !buffer.front();
+
+    std::cout << "Push without slot: " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool testTrackingStatistics()
+{
+    tue::manipulation::TrackingStatistics stats(4);
+    stats.start(2, 10, 3);
+
+    std::vector<double> errors(2);
+    for(unsigned int i = 0; i < 4; ++i)
+    {
+        errors[0] = (i % 2 == 0) ? 0.1 : -0.1;
+        errors[1] = 0.05 * i;
+        stats.addSample(errors);
+    }
+
+    for(unsigned int i = 1; i <= 6; ++i)
+        stats.addWaypoint(10 + 0.5 * i);
+    stats.finish(13.5);
+
+    std::vector<double> recent;
+    stats.recentWaypointTimes(recent);
+
+    bool ok = std::abs(stats.rmsError(0) - 0.1) < 1e-9
+            && std::abs(stats.maxError(1) - 0.15) < 1e-9
+            && stats.worstJoint() == 1
+            && stats.numWaypoints() == 6
+            && recent.size() == 4
+            && std::abs(stats.meanWaypointTime() - 0.5) < 1e-9
+            && std::abs(stats.duration() - 3.5) < 1e-9;
+
+    std::cout << "Tracking statistics: " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int num_samples = 1000000;
+    if (argc > 1)
+        num_samples = atoi(argv[1]);
+
+    bool ok = true;
+    ok = testHandoff(num_samples, 1, 16) && ok;
+    ok = testHandoff(num_samples, 1000, 16) && ok;
+    ok = testOverflow(10) && ok;
+    ok = testPushWithoutSlot() && ok;
+    ok = testTrackingStatistics() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include <tue/manipulation/self_collision.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Straightforward branching implementation of the closest points between two segments (Ericson, Real-Time
+// Collision Detection, section 5.1.9), as a reference for the branch-free scalar and SSE2 kernels
+double referenceDistanceSquared(const KDL::Vector& p1, const KDL::Vector& q1, const KDL::Vector& p2, const KDL::Vector& q2)
+{
+    const double eps = 1e-12;
+
+    KDL::Vector d1 = q1 - p1;
+    KDL::Vector d2 = q2 - p2;
+    KDL::Vector r = p1 - p2;
+    double a = KDL::dot(d1, d1);
+    double e = KDL::dot(d2, d2);
+    double f = KDL::dot(d2, r);
+
+    double s, t;
+    if (a <= eps && e <= eps)
+    {
+        s = t = 0;
+    }
+    else if (a <= eps)
+    {
+        s = 0;
+        t = std::min(1.0, std::max(0.0, f / e));
+    }
+    else
+    {
+        double c = KDL::dot(d1, r);
+        if (e <= eps)
+        {
+            t = 0;
+            s = std::min(1.0, std::max(0.0, -c / a));
+        }
+        else
+        {
+            double b = KDL::dot(d1, d2);
+            double denom = a * e - b * b;
+            s = denom > eps ? std::min(1.0, std::max(0.0, (b * f - c * e) / denom)) : 0;
+            t = (b * s + f) / e;
+            if (t < 0)
+            {
+                t = 0;
+                s = std::min(1.0, std::max(0.0, -c / a));
+            }
+            else if (t > 1)
+            {
+                t = 1;
+                s = std::min(1.0, std::max(0.0, (b - c) / a));
+            }
+        }
+    }
+
+    KDL::Vector d = (p1 + d1 * s) - (p2 + d2 * t);
+    return KDL::dot(d, d);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double random(double min, double max)
+{
+    return min + (max - min) * (double)rand() / RAND_MAX;
+}
+
+KDL::Vector randomVector()
+{
+    return KDL::Vector(random(-1, 1), random(-1, 1), random(-1, 1));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Generates segment pairs of several kinds: general, (anti)parallel, collinear, and with one or both segments of
+// zero length. Compares the batched (SSE2 if available) and single-pair kernels against the reference.
+bool testRandom(unsigned int num_pairs)
+{
+    tue::manipulation::SegmentBatch a, b;
+    a.resize(num_pairs);
+    b.resize(num_pairs);
+
+    std::vector<double> reference(num_pairs);
+    for(unsigned int i = 0; i < num_pairs; ++i)
+    {
+        KDL::Vector p1 = randomVector(), q1 = randomVector(), p2 = randomVector(), q2 = randomVector();
+
+        switch (i % 6)
+        {
+        case 1: q2 = p2 + (q1 - p1) * random(-2, 2); break;          // parallel or anti-parallel
+        case 2: p2 = p1 + (q1 - p1) * random(-1, 2);                // collinear
+                q2 = p1 + (q1 - p1) * random(-1, 2); break;
+        case 3: q1 = p1; break;                                      // first segment is a point
+        case 4: q2 = p2; break;                                      // second segment is a point
+        case 5: q1 = p1; q2 = p2; break;                             // both are points
+        }
+
+        a.set(i, p1, q1);
+        b.set(i, p2, q2);
+        reference[i] = referenceDistanceSquared(p1, q1, p2, q2);
+    }
+
+    std::vector<double> batched(num_pairs);
+    tue::manipulation::segmentDistancesSquared(a, b, num_pairs, &batched[0]);
+
+    bool ok = true;
+    double max_error = 0;
+    for(unsigned int i = 0; i < num_pairs; ++i)
+    {
+        KDL::Vector p1(a.x0[i], a.y0[i], a.z0[i]), q1(a.x1[i], a.y1[i], a.z1[i]);
+        KDL::Vector p2(b.x0[i], b.y0[i], b.z0[i]), q2(b.x1[i], b.y1[i], b.z1[i]);
+        double single = tue::manipulation::segmentDistanceSquared(p1, q1, p2, q2);
+
+        double error = std::max(std::abs(batched[i] - reference[i]), std::abs(single - reference[i]));
+        max_error = std::max(max_error, error);
+        if (error > 1e-9)
+        {
+            if (ok)
+                std::cout << "Pair " << i << " (kind " << i % 6 << "): reference " << reference[i] << ", batched "
+                          << batched[i] << ", single " << single << std::endl;
+            ok = false;
+        }
+    }
+
+    std::cout << "Random segment pairs: " << num_pairs << " pairs, max error " << max_error << ": "
+              << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool testKnown()
+{
+    // Crossing segments at distance 1, parallel segments at distance 2, and a point next to a segment end
+    bool ok = std::abs(tue::manipulation::segmentDistanceSquared(
+                           KDL::Vector(-1, 0, 0), KDL::Vector(1, 0, 0), KDL::Vector(0, -1, 1), KDL::Vector(0, 1, 1)) - 1) < 1e-12
+            && std::abs(tue::manipulation::segmentDistanceSquared(
+                           KDL::Vector(0, 0, 0), KDL::Vector(1, 0, 0), KDL::Vector(0.5, 2, 0), KDL::Vector(3, 2, 0)) - 4) < 1e-12
+            && std::abs(tue::manipulation::segmentDistanceSquared(
+                           KDL::Vector(0, 0, 0), KDL::Vector(1, 0, 0), KDL::Vector(2, 1, 0), KDL::Vector(2, 1, 0)) - 2) < 1e-12;
+
+    std::cout << "Known distances: " << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    srand(1);
+
+    unsigned int num_pairs = 100001;
+    if (argc > 1)
+        num_pairs = atoi(argv[1]);
+
+    bool ok = testKnown();
+    ok = testRandom(num_pairs) && ok;
+
+    return ok ? 0 : 1;
+}
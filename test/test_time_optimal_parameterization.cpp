@@ -0,0 +1,150 @@
+#include <tue/manipulation/time_optimal_parameterization.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------------------------------
+
+const double TOLERANCE = 1e-5;
+
+double random(double min, double max)
+{
+    return min + (max - min) * (double)rand() / RAND_MAX;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Checks that the cubic Hermite interpolation of the result (as done by the reference generator) stays within the
+// limits, that the path starts and ends at rest at the first and last waypoint, and that it passes through all
+// waypoints. Keeps track of the largest ratios of acceleration and velocity to the limits.
+bool checkPath(const std::vector<std::vector<double> >& waypoints, const std::vector<double>& max_vel,
+               const std::vector<double>& max_acc, const tue::manipulation::TimeParameterizedPath& path,
+               double& worst_acc_ratio, double& worst_vel_ratio)
+{
+    unsigned int num_joints = max_vel.size();
+    unsigned int n = path.times.size();
+    bool ok = n >= 2;
+
+    unsigned int i_waypoint = 0;
+    for(unsigned int i = 0; ok && i < n; ++i)
+    {
+        // Waypoints are passed in order
+        double dist = 0;
+        for(unsigned int j = 0; j < num_joints; ++j)
+            dist = std::max(dist, std::abs(path.positions[i][j] - waypoints[i_waypoint][j]));
+        if (dist < TOLERANCE && i_waypoint + 1 < waypoints.size())
+            ++i_waypoint;
+
+        if (i + 1 == n)
+            break;
+
+        double dt = path.times[i + 1] - path.times[i];
+        if (!(dt > 0))
+            return false;
+
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            double q0 = path.positions[i][j], q1 = path.positions[i + 1][j];
+            double v0 = path.velocities[i][j], v1 = path.velocities[i + 1][j];
+
+            // The acceleration is linear over a cubic segment, so it is extreme at its ends
+            double a0 = (6 * (q1 - q0) - dt * (4 * v0 + 2 * v1)) / (dt * dt);
+            double a1 = (-6 * (q1 - q0) + dt * (2 * v0 + 4 * v1)) / (dt * dt);
+            worst_acc_ratio = std::max(worst_acc_ratio, std::max(std::abs(a0), std::abs(a1)) / max_acc[j]);
+
+            // Sample the velocity within the segment
+            for(double f = 0; f <= 1; f += 0.05)
+            {
+                double t = f * dt;
+                double v = v0 + a0 * t + (a1 - a0) * t * t / (2 * dt);
+                worst_vel_ratio = std::max(worst_vel_ratio, std::abs(v) / max_vel[j]);
+            }
+        }
+    }
+
+    for(unsigned int j = 0; ok && j < num_joints; ++j)
+    {
+        ok = std::abs(path.positions.front()[j] - waypoints.front()[j]) < TOLERANCE
+                && std::abs(path.positions.back()[j] - waypoints.back()[j]) < TOLERANCE
+                && std::abs(path.velocities.front()[j]) < TOLERANCE
+                && std::abs(path.velocities.back()[j]) < TOLERANCE;
+    }
+
+    return ok && i_waypoint + 1 == waypoints.size();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Random waypoints for a random number of joints with random limits. Many of the waypoints are stop waypoints
+// (where all joints reverse), around which the path velocity changes most abruptly.
+bool testRandom(unsigned int num_cases, double path_resolution)
+{
+    bool ok = true;
+    double worst_acc_ratio = 0, worst_vel_ratio = 0;
+    for(unsigned int c = 0; c < num_cases; ++c)
+    {
+        unsigned int num_joints = 1 + rand() % 6;
+        unsigned int num_waypoints = 2 + rand() % 6;
+
+        std::vector<double> max_vel(num_joints), max_acc(num_joints);
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            max_vel[j] = random(0.3, 2);
+            max_acc[j] = random(0.3, 3);
+        }
+
+        std::vector<std::vector<double> > waypoints(num_waypoints, std::vector<double>(num_joints));
+        for(unsigned int i = 0; i < num_waypoints; ++i)
+        {
+            for(unsigned int j = 0; j < num_joints; ++j)
+                waypoints[i][j] = random(-2, 2);
+        }
+
+        tue::manipulation::TimeParameterizedPath path;
+        std::string error;
+        if (!tue::manipulation::parameterizeTimeOptimal(waypoints, max_vel, max_acc, path_resolution, path, error))
+        {
+            std::cout << "Case " << c << ": " << error;
+            ok = false;
+            continue;
+        }
+
+        if (!checkPath(waypoints, max_vel, max_acc, path, worst_acc_ratio, worst_vel_ratio))
+        {
+            std::cout << "Case " << c << ": path does not start, end or pass through the waypoints" << std::endl;
+            ok = false;
+        }
+
+        // The check used before executing must accept every path the parameterization produces
+        if (!tue::manipulation::checkLimits(path, max_vel, max_acc, error))
+        {
+            std::cout << "Case " << c << ": " << error;
+            ok = false;
+        }
+    }
+
+    ok = ok && worst_acc_ratio < 1 + TOLERANCE && worst_vel_ratio < 1 + TOLERANCE;
+
+    std::cout << "Random waypoints (resolution " << path_resolution << "): largest acceleration "
+              << worst_acc_ratio << " x limit, largest velocity " << worst_vel_ratio << " x limit: "
+              << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    srand(1);
+
+    unsigned int num_cases = 200;
+    if (argc > 1)
+        num_cases = atoi(argv[1]);
+
+    bool ok = testRandom(num_cases, 0.01);
+    ok = testRandom(num_cases / 4, 0.002) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -6,13 +6,11 @@
 int main (int argc, char **argv) {
   ros::init(argc, argv, "test_client");
 
-  if (argc != 2) {
-      ROS_ERROR("Arguments: SPINDLE_HEIGHT. Please note that this test client has been developed for AMIGO");
+  if (argc < 2) {
+      ROS_ERROR("Arguments: SPINDLE_HEIGHT [SPINDLE_HEIGHT ...]. Please note that this test client has been developed for AMIGO");
 	  return 1;
   }
 
-  double spindle_height = atof(argv[1]);
-
   // create the action client
   //actionlib::SimpleActionClient<amigo_actions::AmigoSpindleCommandAction> ac("spindle_server");
   actionlib::SimpleActionClient<control_msgs::FollowJointTrajectoryAction> ac("torso_server");
@@ -23,13 +21,16 @@ int main (int argc, char **argv) {
   goal.trajectory.header.stamp = ros::Time::now();
   goal.trajectory.joint_names.resize(1);
   goal.trajectory.joint_names[0] = "torso_joint";
-  goal.trajectory.points.resize(1);
-  goal.trajectory.points[0].positions.resize(1);
-  goal.trajectory.points[0].positions[0] = spindle_height;
-
+  // Every height is a waypoint
+  goal.trajectory.points.resize(argc - 1);
+  for (int i = 1; i < argc; i++) {
+      goal.trajectory.points[i - 1].positions.resize(1);
+      goal.trajectory.points[i - 1].positions[0] = atof(argv[i]);
+  }
 
+  ros::WallTime start = ros::WallTime::now();
   actionlib::SimpleClientGoalState state = ac.sendGoalAndWait(goal);
-  ROS_WARN("Current state: %s", state.toString().c_str());
+  ROS_WARN("Current state: %s (after %.3f s)", state.toString().c_str(), (ros::WallTime::now() - start).toSec());
 
   ros::shutdown();
 
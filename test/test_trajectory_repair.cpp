@@ -0,0 +1,263 @@
+#include <tue/manipulation/trajectory_repair.h>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+// ----------------------------------------------------------------------------------------------------
+
+double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Creates a trajectory of sinusoids of which some exceed the position, velocity or acceleration limits. Every
+// sinusoid spans a whole number of half periods, such that the trajectory starts and ends within the limits.
+void createTrajectory(unsigned int num_points, unsigned int num_joints, std::vector<double>& times,
+                      std::vector<std::vector<double> >& positions, std::vector<std::vector<double> >& velocities)
+{
+    double dt = 0.01;
+    double duration = (num_points - 1) * dt;
+
+    times.resize(num_points);
+    positions.assign(num_points, std::vector<double>(num_joints));
+    velocities.assign(num_points, std::vector<double>(num_joints));
+
+    for(unsigned int i = 0; i < num_points; ++i)
+    {
+        times[i] = i * dt;
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            double amplitude = 0.9 + 0.05 * j;      // limits are at +/- 1, so the later joints exceed them
+            double omega = M_PI * (1 + j / 2) / duration;
+            positions[i][j] = amplitude * std::sin(omega * times[i]);
+            velocities[i][j] = amplitude * omega * std::cos(omega * times[i]);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// The original repair: clamp every position, looking up the limits by joint name
+void clampTrajectory(const std::vector<std::string>& joint_names, const std::map<std::string, std::pair<double, double> >& limits,
+                     std::vector<std::vector<double> >& positions)
+{
+    for(unsigned int i = 0; i < joint_names.size(); ++i)
+    {
+        for(unsigned int j = 0; j < positions.size(); ++j)
+        {
+            std::pair<double, double> l = limits.find(joint_names[i])->second;
+            positions[j][i] = std::min(std::max(l.first, positions[j][i]), l.second);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Returns the largest change of the finite-difference joint velocity between two consecutive segments
+double maxVelocityJump(const std::vector<double>& times, const std::vector<std::vector<double> >& positions)
+{
+    double max_jump = 0;
+    for(unsigned int i = 1; i + 1 < positions.size(); ++i)
+    {
+        for(unsigned int j = 0; j < positions[i].size(); ++j)
+        {
+            double v0 = (positions[i][j] - positions[i - 1][j]) / (times[i] - times[i - 1]);
+            double v1 = (positions[i + 1][j] - positions[i][j]) / (times[i + 1] - times[i]);
+            max_jump = std::max(max_jump, std::abs(v1 - v0));
+        }
+    }
+    return max_jump;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Checks the positions, and the velocities and accelerations of the cubic Hermite segments between the points, as
+// the controllers interpolate them, against the limits
+bool withinLimits(const tue::manipulation::JointLimitTable& limits, const std::vector<double>& times,
+                  const std::vector<std::vector<double> >& positions, const std::vector<std::vector<double> >& velocities)
+{
+    for(unsigned int i = 0; i < positions.size(); ++i)
+    {
+        for(unsigned int j = 0; j < limits.size(); ++j)
+        {
+            if (positions[i][j] < limits.lower[j] - 1e-6 || positions[i][j] > limits.upper[j] + 1e-6)
+                return false;
+            if (std::abs(velocities[i][j]) > limits.max_velocity[j] * 1.01)
+                return false;
+
+            if (i + 1 == positions.size())
+                continue;
+
+            double dt = times[i + 1] - times[i];
+            double dq = positions[i + 1][j] - positions[i][j];
+            double a0 = (6 * dq - dt * (4 * velocities[i][j] + 2 * velocities[i + 1][j])) / (dt * dt);
+            double a1 = (-6 * dq + dt * (2 * velocities[i][j] + 4 * velocities[i + 1][j])) / (dt * dt);
+            if (std::max(std::abs(a0), std::abs(a1)) > limits.max_acceleration[j] * 1.01)
+                return false;
+        }
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// A slow motion with one short bump that exceeds all limits must only be changed around the bump
+bool testIsolatedViolation(const tue::manipulation::JointLimitTable& limits)
+{
+    unsigned int num_points = 1001;
+    unsigned int num_joints = limits.size();
+    double dt = 0.01;
+    double t_bump = 5;
+    double width = 0.15;
+
+    std::vector<double> times(num_points);
+    std::vector<std::vector<double> > positions(num_points, std::vector<double>(num_joints));
+    std::vector<std::vector<double> > velocities(num_points, std::vector<double>(num_joints));
+    for(unsigned int i = 0; i < num_points; ++i)
+    {
+        times[i] = i * dt;
+        for(unsigned int j = 0; j < num_joints; ++j)
+        {
+            positions[i][j] = 0.5 * std::sin(0.5 * times[i]);
+            velocities[i][j] = 0.25 * std::cos(0.5 * times[i]);
+        }
+
+        double x = (times[i] - t_bump) / width;
+        positions[i][0] += 0.8 * std::exp(-x * x);
+        velocities[i][0] += -1.6 * x / width * std::exp(-x * x);
+    }
+
+    std::vector<double> repaired_times = times;
+    std::vector<std::vector<double> > repaired = positions, repaired_velocities = velocities;
+    tue::manipulation::TrajectoryRepairStatistics stats;
+    std::string error;
+    if (!tue::manipulation::repairTrajectory(limits, repaired_times, repaired, repaired_velocities, stats, error))
+    {
+        std::cout << "Isolated violation: " << error << std::endl;
+        return false;
+    }
+
+    bool ok = stats.num_position_violations > 0 && stats.num_velocity_violations > 0
+            && stats.num_acceleration_violations > 0;
+    ok = ok && withinLimits(limits, repaired_times, repaired, repaired_velocities);
+
+    // Segments more than 3 seconds away from the bump keep their positions, velocities and durations
+    unsigned int num_untouched = 0;
+    for(unsigned int i = 0; i + 1 < num_points; ++i)
+    {
+        if (std::abs(times[i] - t_bump) < 3 || std::abs(times[i + 1] - t_bump) < 3)
+            continue;
+
+        double duration = times[i + 1] - times[i];
+        double repaired_duration = repaired_times[i + 1] - repaired_times[i];
+        ok = ok && std::abs(repaired_duration - duration) < 1e-9 && repaired[i] == positions[i]
+                && repaired[i + 1] == positions[i + 1] && repaired_velocities[i] == velocities[i];
+        ++num_untouched;
+    }
+
+    std::cout << "Isolated violation: " << stats.num_retimed_segments << " retimed segments, added duration "
+              << stats.added_duration << " s, " << num_untouched << " distant segments checked: "
+              << (ok ? "OK" : "FAILED") << std::endl;
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int num_points = 1000;
+    if (argc > 1)
+        num_points = atoi(argv[1]);
+
+    unsigned int num_repetitions = 100;
+    if (argc > 2)
+        num_repetitions = atoi(argv[2]);
+
+    unsigned int num_joints = 7;
+
+    std::vector<std::string> joint_names;
+    std::map<std::string, std::pair<double, double> > limit_map;
+    tue::manipulation::JointLimitTable limits;
+    limits.resize(num_joints);
+    for(unsigned int j = 0; j < num_joints; ++j)
+    {
+        std::stringstream s;
+        s << "joint" << j;
+        joint_names.push_back(s.str());
+        limit_map[s.str()] = std::make_pair(-1.0, 1.0);
+
+        limits.lower[j] = -1;
+        limits.upper[j] = 1;
+        limits.max_velocity[j] = 1.2;
+        limits.max_acceleration[j] = 1.5;
+    }
+
+    std::vector<double> times;
+    std::vector<std::vector<double> > positions, velocities;
+    createTrajectory(num_points, num_joints, times, positions, velocities);
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Clamping
+
+    std::vector<std::vector<double> > clamped;
+    std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+    for(unsigned int k = 0; k < num_repetitions; ++k)
+    {
+        clamped = positions;
+        clampTrajectory(joint_names, limit_map, clamped);
+    }
+    double clamp_time = secondsSince(t_start) / num_repetitions;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Repair
+
+    std::vector<double> repaired_times;
+    std::vector<std::vector<double> > repaired, repaired_velocities;
+    tue::manipulation::TrajectoryRepairStatistics stats;
+    std::string error;
+
+    t_start = std::chrono::steady_clock::now();
+    for(unsigned int k = 0; k < num_repetitions; ++k)
+    {
+        repaired_times = times;
+        repaired = positions;
+        repaired_velocities = velocities;
+        if (!tue::manipulation::repairTrajectory(limits, repaired_times, repaired, repaired_velocities, stats, error))
+        {
+            std::cout << error << std::endl;
+            return 1;
+        }
+    }
+    double repair_time = secondsSince(t_start) / num_repetitions;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Validate the result
+
+    bool ok = withinLimits(limits, repaired_times, repaired, repaired_velocities);
+
+    // The start and the goal are kept
+    bool endpoints_kept = repaired.front() == positions.front() && repaired.back() == positions.back();
+
+    std::cout << num_points << " points, " << num_joints << " joints" << std::endl;
+    std::cout << "Violations: " << stats.num_position_violations << " position, " << stats.num_velocity_violations
+              << " velocity, " << stats.num_acceleration_violations << " acceleration" << std::endl;
+    std::cout << "Retimed segments: " << stats.num_retimed_segments << ", added duration: " << stats.added_duration
+              << " s" << std::endl;
+    std::cout << "Clamp:  " << clamp_time * 1e6 << " us, max velocity jump " << maxVelocityJump(times, clamped)
+              << " rad/s" << std::endl;
+    std::cout << "Repair: " << repair_time * 1e6 << " us, max velocity jump "
+              << maxVelocityJump(repaired_times, repaired) << " rad/s" << std::endl;
+    std::cout << (ok ? "OK" : "FAILED: repaired trajectory exceeds the limits") << std::endl;
+    std::cout << (endpoints_kept ? "OK" : "FAILED: start or goal moved") << std::endl;
+
+    ok = ok && endpoints_kept;
+    ok = testIsolatedViolation(limits) && ok;
+
+    return ok ? 0 : 1;
+}
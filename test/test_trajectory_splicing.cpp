@@ -0,0 +1,225 @@
+#include <tue/manipulation/reference_generator.h>
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+
+// ----------------------------------------------------------------------------------------------------
+
+const unsigned int NUM_JOINTS = 2;
+const double DT = 0.01;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Creates a timed trajectory of raised cosines, starting at rest in 0 at time 0
+void createTrajectory(double amplitude, double omega, double duration, control_msgs::FollowJointTrajectoryGoal& goal)
+{
+    goal.trajectory.joint_names.clear();
+    goal.trajectory.points.clear();
+
+    for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+    {
+        std::stringstream s;
+        s << "joint" << j;
+        goal.trajectory.joint_names.push_back(s.str());
+    }
+
+    for(double t = 0; t < duration + 1e-9; t += 0.1)
+    {
+        trajectory_msgs::JointTrajectoryPoint p;
+        for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+        {
+            double a = amplitude * (j + 1);
+            p.positions.push_back(a * (1 - std::cos(omega * t)));
+            p.velocities.push_back(a * omega * std::sin(omega * t));
+        }
+        p.time_from_start = ros::Duration(t);
+        goal.trajectory.points.push_back(p);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void initReferenceGenerator(tue::manipulation::ReferenceGenerator& refgen)
+{
+    std::vector<std::string> joint_names;
+    for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+    {
+        std::stringstream s;
+        s << "joint" << j;
+        joint_names.push_back(s.str());
+    }
+
+    refgen.setJointNames(joint_names);
+    for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+    {
+        refgen.initJoint(j, 2, 2, -10, 10);
+        refgen.setJointState(j, 0, 0);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Runs the reference generator until it has no active goals, and returns the largest change of the reference
+// velocity (estimated from the positions) between two consecutive time steps
+double run(tue::manipulation::ReferenceGenerator& refgen, std::vector<double>& prev_pos, std::vector<double>& prev_vel,
+           double& time, double max_time = 1e9)
+{
+    std::vector<double> references;
+    double max_jump = 0;
+    double t_end = time + max_time;
+    while (refgen.hasActiveGoals() && time < t_end)
+    {
+        refgen.calculatePositionReferences(DT, references);
+        time += DT;
+
+        for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+        {
+            double v = (references[j] - prev_pos[j]) / DT;
+            max_jump = std::max(max_jump, std::abs(v - prev_vel[j]));
+            prev_pos[j] = references[j];
+            prev_vel[j] = v;
+        }
+    }
+    return max_jump;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Executes a first trajectory for one second, and then switches to a second trajectory that should start half a
+// second later, either by splicing it in or by replacing the first trajectory
+bool test(bool splice)
+{
+    tue::manipulation::ReferenceGenerator refgen;
+    initReferenceGenerator(refgen);
+
+    control_msgs::FollowJointTrajectoryGoal goal1, goal2;
+    createTrajectory(0.5, 2, 3, goal1);
+    createTrajectory(0.3, 3, 2, goal2);
+
+    std::string id;
+    std::stringstream error;
+    if (!refgen.setGoal(goal1, id, error))
+    {
+        std::cout << error.str() << std::endl;
+        return false;
+    }
+
+    std::vector<double> pos(NUM_JOINTS, 0), vel(NUM_JOINTS, 0);
+    double time = 0;
+    double max_jump = run(refgen, pos, vel, time, 1);
+
+    // The first trajectory has a point every 0.1 s, of which those up to the current time have been passed
+    unsigned int num_passed_before = 0;
+    refgen.getNumPassedWaypoints(id, num_passed_before);
+
+    // The second trajectory starts where the first one is half a second later
+    double t_splice = time + 0.5;
+    for(unsigned int i = 0; i < goal2.trajectory.points.size(); ++i)
+    {
+        for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+            goal2.trajectory.points[i].positions[j] += 0.5 * (j + 1) * (1 - std::cos(2 * t_splice));
+    }
+
+    if (splice)
+    {
+        if (!refgen.spliceGoal(id, goal2, 0.5, error))
+        {
+            std::cout << error.str() << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        std::string id2;
+        if (!refgen.setGoal(goal2, id2, error))
+        {
+            std::cout << error.str() << std::endl;
+            return false;
+        }
+    }
+
+    max_jump = std::max(max_jump, run(refgen, pos, vel, time));
+
+    unsigned int num_passed = 0;
+    refgen.getNumPassedWaypoints(id, num_passed);
+
+    std::cout << (splice ? "Splice:  " : "Replace: ") << "total time " << time << " s, max velocity jump "
+              << max_jump << " rad/s, " << num_passed << " waypoints passed" << std::endl;
+
+    if (!splice)
+        return true;
+
+    // The spliced trajectory should keep the timing of both parts, and the velocity should not change faster than
+    // the largest acceleration of the two trajectories (a w^2 of the last joint), plus some margin for the transition
+    double max_acc = std::max(0.5 * NUM_JOINTS * 2 * 2, 0.3 * NUM_JOINTS * 3 * 3);
+    // All waypoints of the first trajectory up to the splice (at 1.5 s) and all of the second one (after its start)
+    // are passed, but not the point inserted at the splice
+    unsigned int num_waypoints2 = goal2.trajectory.points.size() - 1;
+    bool waypoints_ok = num_passed_before >= 10 && num_passed_before <= 11
+            && num_passed >= num_waypoints2 + 15 && num_passed <= num_waypoints2 + 16;
+
+    return std::abs(time - 3.5) < 2 * DT && max_jump < 1.5 * max_acc * DT && waypoints_ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Follows a trajectory that still moves at its last point, and of which the last segment lies between two time
+// steps, such that the time has passed the last point when the goal starts moving to it. Checks that the references
+// do not pass that point while the goal is active (after it, the joints brake).
+bool testFinalPoint()
+{
+    tue::manipulation::ReferenceGenerator refgen;
+    initReferenceGenerator(refgen);
+
+    control_msgs::FollowJointTrajectoryGoal goal;
+    createTrajectory(0.5, 1, 1.4, goal);
+    for(double t = 1.492; t < 1.5; t += 0.005)
+    {
+        trajectory_msgs::JointTrajectoryPoint p;
+        for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+        {
+            double a = 0.5 * (j + 1);
+            p.positions.push_back(a * (1 - std::cos(t)));
+            p.velocities.push_back(a * std::sin(t));
+        }
+        p.time_from_start = ros::Duration(t);
+        goal.trajectory.points.push_back(p);
+    }
+    const trajectory_msgs::JointTrajectoryPoint& p_final = goal.trajectory.points.back();
+
+    std::string id;
+    std::stringstream error;
+    if (!refgen.setGoal(goal, id, error))
+    {
+        std::cout << error.str() << std::endl;
+        return false;
+    }
+
+    std::vector<double> references;
+    double max_overshoot = 0;
+    while (refgen.hasActiveGoals())
+    {
+        refgen.calculatePositionReferences(DT, references);
+        if (refgen.getGoalStatus(id) != tue::manipulation::JOINT_GOAL_ACTIVE)
+            break;
+
+        for(unsigned int j = 0; j < NUM_JOINTS; ++j)
+            max_overshoot = std::max(max_overshoot, references[j] - p_final.positions[j]);
+    }
+
+    std::cout << "Final point: max overshoot " << max_overshoot << " rad" << std::endl;
+    return max_overshoot < 1e-9;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    bool ok = test(false);
+    ok = test(true) && ok;
+    ok = testFinalPoint() && ok;
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
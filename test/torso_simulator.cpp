@@ -0,0 +1,50 @@
+#include <ros/ros.h>
+#include <sensor_msgs/JointState.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Simulates a torso that moves towards the reference at a limited velocity, for running the torso server without
+// hardware
+
+sensor_msgs::JointState ref_;
+bool ref_received_ = false;
+
+void referenceCb(const sensor_msgs::JointStateConstPtr& ref) {
+    ref_ = *ref;
+    ref_received_ = true;
+}
+
+int main(int argc, char** argv) {
+    ros::init(argc, argv, "torso_simulator");
+    ros::NodeHandle nh("~");
+
+    double rate, max_velocity, initial_position;
+    nh.param("rate", rate, 100.0);
+    nh.param("max_velocity", max_velocity, 0.07);
+    nh.param("initial_position", initial_position, 0.35);
+
+    ros::Publisher meas_pub = nh.advertise<sensor_msgs::JointState>("measurements", 1);
+    ros::Subscriber ref_sub = nh.subscribe("references", 1, &referenceCb);
+
+    sensor_msgs::JointState meas;
+    meas.name.push_back("torso_joint");
+    meas.position.push_back(initial_position);
+
+    ros::Rate r(rate);
+    while (ros::ok()) {
+        ros::spinOnce();
+
+        if (ref_received_ && !ref_.position.empty()) {
+            double step = max_velocity / rate;
+            double error = ref_.position[0] - meas.position[0];
+            meas.position[0] += std::max(-step, std::min(step, error));
+        }
+
+        meas.header.stamp = ros::Time::now();
+        meas_pub.publish(meas);
+        r.sleep();
+    }
+
+    return 0;
+}